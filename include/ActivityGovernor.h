@@ -0,0 +1,75 @@
+#ifndef ACTIVITY_GOVERNOR_H
+#define ACTIVITY_GOVERNOR_H
+
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+
+enum class ActivityState {
+    ACTIVE,
+    IDLE
+};
+
+
+struct ActivitySettings {
+    int activeFps;                  // analysis rate while there is motion
+    int idleFps;                    // analysis rate after idleAfterMs without motion
+    int idleAfterMs;
+    int active3AInterval;           // run 3A tuning every N analysed frames
+    int idle3AInterval;
+
+    ActivitySettings()
+        : activeFps(30), idleFps(2), idleAfterMs(10000),
+          active3AInterval(1), idle3AInterval(10) {}
+};
+
+
+struct ActivityStats {
+    ActivityState state;
+    double activeSeconds;
+    double idleSeconds;
+    uint64_t activeFrames;          // frames analysed in each state
+    uint64_t idleFrames;
+    int transitions;
+};
+
+
+// per-camera governor that drops analysis to a low rate while nothing moves
+// and returns to full rate on the first frame with motion
+class ActivityGovernor {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    ActivitySettings settings;
+    ActivityState state;
+    Clock::time_point stateSince;
+    Clock::time_point lastMotion;
+    Clock::time_point lastAnalysis;
+    bool analysedOnce;
+    uint64_t analysedInState;
+
+    mutable std::mutex statsMutex;
+    ActivityStats stats;
+
+    void enterState(ActivityState next, Clock::time_point now);
+
+public:
+    ActivityGovernor(const ActivitySettings &settings = ActivitySettings());
+    ~ActivityGovernor();
+
+    // true when enough time has passed to analyse the current frame
+    bool shouldAnalyse();
+    bool shouldRun3A() const;
+
+    // feeds the motion result of an analysed frame, returns true on a state change
+    bool reportMotion(bool motion);
+
+    ActivityState getState() const;
+    int getTargetFps() const;
+    int getFramePeriodMs() const;
+    ActivitySettings getSettings() const;
+    ActivityStats getStats() const;
+};
+
+#endif
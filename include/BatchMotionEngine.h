@@ -0,0 +1,129 @@
+#ifndef BATCH_MOTION_ENGINE_H
+#define BATCH_MOTION_ENGINE_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+#include "RegionExtractor.h"
+
+
+// latest motion analysis result for one camera
+struct BatchMotionResult {
+    bool motionDetected;
+    std::vector<cv::Rect> regions;  // in source frame coordinates
+    uint64_t frameSeq;              // number of frames analysed so far
+};
+
+
+struct BatchMotionStats {
+    uint64_t batches;
+    uint64_t framesProcessed;
+    int lastBatchFrames;
+    double lastBatchMs;             // wall time of the last batch
+    double avgBatchMs;              // moving average of batch latency
+    double peakBatchMs;
+    double framesPerSecond;         // sustained camera-frames/s since start
+};
+
+
+// analyses the latest luma frame of every camera as one batch per tick on a
+// fixed worker pool. reference frames of all cameras share one contiguous arena
+class BatchMotionEngine {
+private:
+    struct Slot {
+        std::string camId;
+        int index;
+
+        std::mutex mutex;           // guards staged, hasNew, settings and result
+        cv::Mat incoming;           // owned by the submitting camera thread
+        cv::Mat staged;             // latest luma waiting for the next batch
+        bool hasNew;
+        cv::Size sourceSize;
+        int threshold;
+        double minArea;
+        BatchMotionResult result;
+
+        // only touched by the worker that processes the slot in a batch
+        cv::Mat work;
+        cv::Size workSourceSize;
+        int workThreshold;
+        double workMinArea;
+        bool initialized;
+        RegionExtractor extractor;
+    };
+
+    struct WorkerScratch {
+        cv::Mat blurred;
+        cv::Mat delta;
+        cv::Mat thresh;
+        std::vector<cv::Rect> regions;
+    };
+
+    cv::Size analysisSize;          // every camera is analysed at this size
+    cv::Size blurSize;
+    int workerCount;
+
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::map<std::string, int> slotIndex;
+    cv::Mat arena;                  // one reference frame per row
+    cv::Mat dilateKernel;
+
+    // worker pool
+    std::vector<std::thread> workers;
+    std::mutex poolMutex;
+    std::condition_variable workCv;
+    std::condition_variable doneCv;
+    std::vector<int> jobs;
+    size_t nextJob;
+    size_t jobsRemaining;
+    uint64_t generation;
+    bool stopping;
+
+    // batch clock
+    std::mutex batchMutex;
+    std::thread tickThread;
+    std::atomic<bool> running;
+    int tickMs;
+
+    mutable std::mutex statsMutex;
+    BatchMotionStats stats;
+    std::chrono::steady_clock::time_point startTime;
+
+    void workerLoop();
+    void tickLoop();
+    void processSlot(Slot &slot, WorkerScratch &scratch);
+
+public:
+    BatchMotionEngine(const cv::Size &analysisSize = cv::Size(320, 240), int workerCount = 0);
+    ~BatchMotionEngine();
+
+    // cameras must be added before start(), the arena is sized once
+    bool addCamera(const std::string &camId, int threshold = 25, double minArea = 500.0);
+    bool hasCamera(const std::string &camId) const;
+    bool setThreshold(const std::string &camId, int threshold);
+    bool setMinArea(const std::string &camId, double minArea);
+
+    // called from the camera thread, converts to luma at analysis size
+    bool submitFrame(const std::string &camId, const cv::Mat &frame);
+    bool getResult(const std::string &camId, BatchMotionResult &result);
+
+    bool start(int tickMs = 33);
+    bool stop();
+    bool isRunning() const;
+
+    // processes every camera with a new frame, returns the batch size
+    int runBatch();
+
+    BatchMotionStats getStats() const;
+    int getWorkerCount() const;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef BLUR_ENGINE_H
+#define BLUR_ENGINE_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+enum class BlurMethod {
+    GAUSSIAN,                       // cv::GaussianBlur, exact, cost grows with the kernel
+    RECURSIVE,                      // Young-van Vliet IIR Gaussian, same cost for any sigma
+    STACKED_BOX                     // three running-sum box passes, same cost for any sigma
+};
+
+
+// Gaussian-like blur with a choice of method. the recursive and box methods
+// run each pass down the columns, a whole row of floats at a time, and do
+// the horizontal pass the same way on the transposed image. borders are
+// replicated. they are meant for sigma >= 2.5 on 8-bit input, anything else
+// goes through cv::GaussianBlur. keeps its scratch buffers between calls, not
+// thread safe, one per thread
+class BlurEngine {
+private:
+    BlurMethod method;
+    cv::Mat work;
+    cv::Mat transposed;
+    cv::Mat scratch;                // box pass output, one per orientation so
+    cv::Mat transposedScratch;      // neither is resized from call to call
+    std::vector<float> edge;
+    std::vector<float> sums;
+
+    void recursiveColumns(cv::Mat &image, double sigma);
+    void boxColumns(cv::Mat &image, cv::Mat &spare, const int *radii, int passes);
+
+public:
+    BlurEngine(BlurMethod method = BlurMethod::GAUSSIAN);
+
+    void setMethod(BlurMethod method);
+    BlurMethod getMethod() const;
+
+    // same size and sigma rules as cv::GaussianBlur: ksize 0 derives the
+    // size from sigma, sigma 0 derives sigma from ksize. dst may be src
+    void blur(const cv::Mat &src, cv::Mat &dst, int ksize, double sigma = 0);
+
+    static const char *methodName(BlurMethod method);
+};
+
+#endif
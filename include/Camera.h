@@ -5,6 +5,8 @@
 #include <memory>
 #include <opencv2/opencv.hpp>
 
+#include "StreamFormat.h"
+
 
 // 3A setting structures
 struct AESettings {
@@ -69,7 +71,19 @@ public:
     std::string getName() const;
     bool getConnectStatus() const;
     void setResolution(int width, int height);
-    void setFPS(int fps);
+    int getWidth() const;
+    int getHeight() const;
+    virtual void setFPS(int fps);     // sources that can change rate live override this
+    int getFPS() const;
+
+    // slows capture down to fps without changing the rate getFPS and
+    // getStreamFormat report, fps at or above that rate restores it. false
+    // when the source cannot, a network stream keeps sending at its own
+    // rate and must be read at that rate
+    virtual bool setCaptureRate(int fps);
+
+    // what the connected stream delivers, size unknown until connected
+    StreamFormat getStreamFormat() const;
 
 
     // ===== 3A tuning functions ===== //
@@ -103,6 +117,7 @@ public:
 
     // combined 3A tuning
     bool run3ATuning();
+    void apply3ASettings();             // apply current corrections without re-tuning
     void reset3ASettings();
 
 protected:
@@ -110,6 +125,7 @@ protected:
     void updateHistory(std::vector<double> &history, double value);
     double calculateMovingAverage(const std::vector<double> &history, int window);
     cv::Mat convertToGray(const cv::Mat &frame);
+    void readStreamFormat(cv::VideoCapture &capture);
 };
 
 #endif
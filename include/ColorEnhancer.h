@@ -0,0 +1,38 @@
+#ifndef COLOR_ENHANCER_H
+#define COLOR_ENHANCER_H
+
+#include <opencv2/opencv.hpp>
+
+
+// contrast, brightness and saturation folded into one per-pixel affine
+// transform. saturation scales the chroma around the pixel's luma, as in
+// YCbCr, so brightness and hue are kept, but it is not the HSV S channel of
+// DisplayEnhancement::enhanceSaturation. out = alpha * (Y + s * (in - Y)) + beta,
+// clipped once at the end instead of after every step. the matrix and the
+// gray LUT are rebuilt only when the parameters change. not thread safe,
+// one per thread
+class ColorEnhancer {
+private:
+    double alpha;                   // contrast
+    int beta;                       // brightness
+    double saturation;              // 1.0 leaves colours unchanged
+    bool dirty;
+
+    cv::Mat colorMatrix;            // 3x4 for BGR, the 4th column is beta
+    cv::Mat alphaMatrix;            // 4x5 for BGRA, alpha channel passed through
+    cv::Mat grayLut;                // alpha * v + beta for single channel input
+
+    void rebuild();
+
+public:
+    ColorEnhancer(double alpha = 1.0, int beta = 0, double saturation = 1.0);
+
+    void setParams(double alpha, int beta, double saturation);
+    bool isIdentity() const;
+
+    // one pass over 8-bit gray, BGR or BGRA rows, split over OpenCV's
+    // threads. dst may be src
+    bool apply(const cv::Mat &src, cv::Mat &dst);
+};
+
+#endif
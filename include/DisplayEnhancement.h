@@ -5,15 +5,28 @@
 #include <vector>
 #include <opencv2/opencv.hpp>
 
+#include "BlurEngine.h"
+#include "ColorEnhancer.h"
+
 
 class DisplayEnhancement {
+private:
+    BlurEngine blurEngine;          // for the unsharp mask
+    ColorEnhancer colorEnhancer;    // fused contrast and saturation
+
 public:
-    DisplayEnhancement();
+    DisplayEnhancement(BlurMethod blurMethod = BlurMethod::GAUSSIAN);
     ~DisplayEnhancement();
 
+    void setBlurMethod(BlurMethod method);
+
     cv::Mat enhanceContrast(const cv::Mat &src, double alpha, int beta);
     cv::Mat enhanceSharpness(const cv::Mat &src, double amount);
     cv::Mat enhanceSaturation(const cv::Mat &src, double factor);
+
+    // contrast, brightness and saturation in one pass instead of a
+    // convertTo plus an HSV round trip, see ColorEnhancer
+    cv::Mat enhanceColor(const cv::Mat &src, double alpha, int beta, double saturation);
 };
 
 #endif
@@ -0,0 +1,58 @@
+#ifndef ENHANCEMENT_PIPELINE_H
+#define ENHANCEMENT_PIPELINE_H
+
+#include <opencv2/opencv.hpp>
+
+#include "BlurEngine.h"
+#include "ColorEnhancer.h"
+
+
+struct EnhancementSettings {
+    double contrast;                // alpha, 1.0 leaves the image unchanged
+    int brightness;                 // beta
+    double saturation;
+    double sharpness;               // unsharp mask amount, 0 disables sharpening
+    double sharpenSigma;            // blur of the detail layer, in full-size pixels
+
+    EnhancementSettings()
+        : contrast(1.0), brightness(0), saturation(1.0), sharpness(0.0), sharpenSigma(3.0) {}
+};
+
+
+// DisplayEnhancement's steps, contrast -> saturation -> sharpening, as one
+// object that keeps its buffers between frames. contrast and saturation are
+// one ColorEnhancer pass. sharpening adds a luma-only detail layer, luma
+// minus its blur, to every channel, so the colours do not fringe. the blur
+// runs at half size with half the sigma and is upscaled back. once the
+// frame size settles, a frame costs no allocations of its own. not thread
+// safe, one per display thread
+class EnhancementPipeline {
+private:
+    EnhancementSettings settings;
+    ColorEnhancer color;
+    BlurEngine blur;
+
+    cv::Mat luma;                   // full size
+    cv::Mat halfLuma;
+    cv::Mat halfBlurred;
+    cv::Mat blurredLuma;            // halfBlurred upscaled to full size
+
+    void sharpen(cv::Mat &image);
+
+public:
+    EnhancementPipeline(const EnhancementSettings &settings = EnhancementSettings());
+
+    void setSettings(const EnhancementSettings &settings);
+    EnhancementSettings getSettings() const;
+    void setBlurMethod(BlurMethod method);
+
+    // enhances frame in place
+    bool process(cv::Mat &frame);
+
+    // writes into dst, which is reused when it already has the size and
+    // type of src, so it can be a preallocated buffer or an ROI of one.
+    // dst may be src
+    bool process(const cv::Mat &src, cv::Mat &dst);
+};
+
+#endif
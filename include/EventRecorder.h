@@ -0,0 +1,78 @@
+#ifndef EVENT_RECORDER_H
+#define EVENT_RECORDER_H
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+#include "VideoRecorder.h"
+#include "PreRollBuffer.h"
+
+
+struct EventRecordingSettings {
+    int preRollMs;                  // footage kept from before the trigger
+    int postRollMs;                 // recording continues this long after the last motion
+    size_t preRollBudgetBytes;      // memory cap of the pre-roll buffer
+    int jpegQuality;                // pre-roll compression quality
+    int fps;
+
+    EventRecordingSettings()
+        : preRollMs(10000), postRollMs(5000), preRollBudgetBytes(24 * 1024 * 1024),
+          jpegQuality(80), fps(30) {}
+};
+
+
+// motion-triggered recording for one camera. keeps a compressed pre-roll
+// while idle, and on motion opens a new file starting with the pre-roll.
+// a finished event is closed on a separate thread, so the capture thread
+// does not wait for its writer to drain. meant to be used from the
+// capture thread
+class EventRecorder {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    std::string camId;
+    std::string outputDir;
+    EventRecordingSettings settings;
+    PreRollBuffer preRoll;
+    std::unique_ptr<VideoRecorder> recorder;    // the event being recorded, null while idle
+    Clock::time_point lastMotion;
+    int eventCount;
+
+    // finished events waiting for their writer to drain and close
+    std::deque<std::unique_ptr<VideoRecorder>> closing;
+    RecorderStats lastStats;        // of the last closed event
+    mutable std::mutex closeMutex;
+    std::condition_variable closeCv;
+    std::thread closer;             // started with the first event, joined by stop()
+    bool stopping;
+
+    bool startEvent(const cv::Mat &frame);
+    void endEvent();
+    void closerLoop();
+
+public:
+    EventRecorder(const std::string &camId, const std::string &outputDir,
+                  const EventRecordingSettings &settings = EventRecordingSettings());
+    ~EventRecorder();
+
+    // feeds one frame and the motion decision for it, returns true while an
+    // event is being recorded
+    bool processFrame(const cv::Mat &frame, bool motion);
+
+    // ends the current event and waits until every event is closed
+    void stop();
+
+    bool isRecording() const;
+    int getEventCount() const;
+    size_t getPreRollBytes() const;
+    double getPreRollSeconds() const;
+    RecorderStats getRecorderStats() const;
+};
+
+#endif
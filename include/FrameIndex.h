@@ -0,0 +1,139 @@
+#ifndef FRAME_INDEX_H
+#define FRAME_INDEX_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+
+// sidecar index written next to a recording as <recording>.idx. a fixed
+// header, written when the index is opened, followed by one fixed-size entry
+// per written frame. entries are appended in batches of at most a second of
+// frames, so an index cut short by a crash is still readable up to its last
+// complete entry and misses at most the last second. entry times are steady
+// clock offsets from the header's wall clock start, a clock change while
+// recording can't reorder them
+
+enum FrameIndexFlags {
+    FRAME_KEYFRAME = 1,             // decodable on its own, seek target
+    FRAME_MOTION = 2                // motion was detected on this frame
+};
+
+
+// what the backend could tell the index, in FrameIndexHeader::contents.
+// without offsets, seek by frameNumber. without keyframes, every entry may
+// be a seek target and the decoder finds the keyframe before it
+enum FrameIndexContents {
+    INDEX_HAS_OFFSETS = 1,          // entries carry byte offsets
+    INDEX_HAS_KEYFRAMES = 2         // entries carry FRAME_KEYFRAME
+};
+
+
+struct FrameIndexEntry {
+    int64_t elapsedMs;              // steady clock ms since FrameIndexHeader::startTimeMs,
+                                    // negative for pre-roll captured before it
+    uint64_t offset;                // byte offset of the frame in the recording, or
+                                    // FRAME_OFFSET_UNKNOWN without INDEX_HAS_OFFSETS
+    uint32_t frameNumber;           // position in the recording, from 0
+    uint32_t flags;
+};
+
+
+struct FrameIndexHeader {
+    char magic[4];                  // "SVIX"
+    uint32_t version;
+    uint32_t fpsMilli;              // frames per second * 1000
+    uint32_t width;
+    uint32_t height;
+    uint32_t contents;              // FrameIndexContents
+    int64_t startTimeMs;            // wall clock ms since the epoch, when the index was opened
+};
+
+
+// byte offset used when the container does not expose one, seek by
+// frameNumber instead
+const uint64_t FRAME_OFFSET_UNKNOWN = UINT64_MAX;
+
+
+class FrameIndexWriter {
+private:
+    FILE *file;
+    std::string path;
+    std::vector<FrameIndexEntry> pending;   // written out in batches
+    std::chrono::steady_clock::time_point startedAt;
+
+    bool flush();
+
+public:
+    FrameIndexWriter();
+    ~FrameIndexWriter();
+
+    // contents says which FrameIndexContents the entries will carry
+    bool open(const std::string &filename, double fps, const cv::Size &frameSize,
+              uint32_t contents);
+    bool append(const FrameIndexEntry &entry);
+    bool close();
+
+    // FrameIndexEntry::elapsedMs for a frame captured at the given time
+    int64_t elapsedMs(std::chrono::steady_clock::time_point when) const;
+
+    bool isOpen() const;
+};
+
+
+// reads an index through a read-only mapping, lookups are binary searches
+// over the entries and never touch the recording itself. times passed in and
+// out are wall clock ms since the epoch
+class FrameIndexReader {
+private:
+    struct MotionRun {
+        size_t first;
+        size_t last;                // inclusive
+    };
+
+    int fd;
+    void *mapping;
+    size_t mappingSize;
+    const FrameIndexHeader *header;
+    const FrameIndexEntry *entries;
+    size_t count;
+    std::vector<MotionRun> motionRuns;  // collected on open, in entry order
+
+    size_t lowerBound(int64_t timestampMs) const;
+
+public:
+    FrameIndexReader();
+    ~FrameIndexReader();
+
+    FrameIndexReader(const FrameIndexReader &) = delete;
+    FrameIndexReader &operator=(const FrameIndexReader &) = delete;
+
+    bool open(const std::string &filename);
+    void close();
+
+    // last keyframe at or before the given time, the place to start
+    // decoding to show that moment. an index without keyframes gives the
+    // last frame at or before it. false if the recording starts later
+    bool seekToTime(int64_t timestampMs, FrameIndexEntry &entry) const;
+
+    // first frame with motion at or after the given time
+    bool nextMotion(int64_t timestampMs, FrameIndexEntry &entry) const;
+
+    size_t size() const;
+    const FrameIndexEntry &at(size_t i) const;
+    int64_t timeOf(const FrameIndexEntry &entry) const;
+    int64_t getStartTime() const;
+    int64_t getEndTime() const;
+    double getFps() const;
+    cv::Size getFrameSize() const;
+    bool hasOffsets() const;
+    bool hasKeyframes() const;
+
+    static std::string indexPathFor(const std::string &recording);
+    static int64_t nowMs();
+};
+
+#endif
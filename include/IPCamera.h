@@ -13,7 +13,7 @@ private:
     std::string streamUrl;
     cv::VideoCapture capture;
     
-    std::string buildStreamUrl();
+    std::string buildStreamUrl() const;
 
 public:
     IPCamera(const std::string &id, const std::string &name, 
@@ -27,6 +27,7 @@ public:
 
     void setCredentials(const std::string &user, const std::string &pass);
     void setStreamUrl(const std::string &url);
+    std::string getStreamUrl() const;
     std::string getIPAddress() const;
 };
 
@@ -0,0 +1,36 @@
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+#include <vector>
+#include <memory>
+#include <opencv2/opencv.hpp>
+
+
+// libjpeg compressor that is created once and reused for every frame, along
+// with its output buffer, so steady-state encoding does not allocate. takes
+// 8-bit gray, BGR or BGRA frames. not thread safe, one per thread
+class JpegEncoder {
+private:
+    std::vector<unsigned char> output;  // grown while encoding, never shrinks
+
+    struct Handle;                  // libjpeg state, kept out of this header
+    std::unique_ptr<Handle> handle;
+    unsigned long encodedSize;
+    std::vector<unsigned char *> rows;
+    cv::Mat rgbScratch;
+
+public:
+    JpegEncoder();
+    ~JpegEncoder();
+
+    JpegEncoder(const JpegEncoder &) = delete;
+    JpegEncoder &operator=(const JpegEncoder &) = delete;
+
+    // the result stays valid until the next call
+    bool encode(const cv::Mat &frame, int quality);
+
+    const unsigned char *data() const;
+    unsigned long size() const;
+};
+
+#endif
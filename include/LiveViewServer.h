@@ -0,0 +1,130 @@
+#ifndef LIVE_VIEW_SERVER_H
+#define LIVE_VIEW_SERVER_H
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+#include "MosaicCompositor.h"
+
+
+struct LiveViewSettings {
+    std::string bindAddress;        // loopback only by default
+    int port;
+    int jpegQuality;
+    int maxFps;                     // per stream
+    int encoderThreads;
+    int maxClients;
+
+    LiveViewSettings()
+        : bindAddress("127.0.0.1"), port(8080), jpegQuality(75), maxFps(15),
+          encoderThreads(2), maxClients(32) {}
+};
+
+
+struct LiveViewStats {
+    int clients;                    // connected now
+    int streams;                    // camera/resolution pairs with viewers
+    uint64_t connections;
+    uint64_t framesEncoded;
+    uint64_t framesSent;            // JPEG parts, counted per client
+    uint64_t framesSkipped;         // newer frames replaced ones a slow client had not taken
+    uint64_t bytesSent;
+};
+
+
+// MJPEG over HTTP for headless boxes. GET /camera/<id> streams one camera,
+// optionally scaled with ?width=<pixels>, GET /mosaic streams the
+// compositor's canvas and GET / lists the streams. frames come from the
+// MosaicCompositor the monitor threads publish to. each stream, a camera at
+// one width, is JPEG-encoded at most once per new frame however many
+// clients watch it, and not at all without viewers. one thread serves all
+// sockets with poll() and non-blocking sends, a client that has not sent
+// its request within a few seconds is dropped. a client still sending a
+// frame is not queued more, when it is done it takes the latest frame.
+// a small pool does the encoding
+class LiveViewServer {
+private:
+    struct Stream {
+        std::string key;            // camId@width, or mosaic@width
+        std::string camId;          // empty for the mosaic
+        int width;                  // 0 keeps the source size
+        int viewers;
+        bool queued;                // waiting for or held by an encoder
+        uint64_t sourceSeq;         // source frame of the last encode
+        int64_t lastEncodeMs;
+        std::shared_ptr<const std::vector<uchar>> jpeg;
+        uint64_t jpegSeq;           // bumped per encode
+    };
+
+    struct Client {
+        int fd;
+        std::string request;
+        std::string streamKey;      // empty until streaming
+        bool streaming;
+        bool closeWhenSent;
+        int64_t acceptedMs;         // the request must be complete within a few seconds
+
+        // the part being sent: head, then body, then tail
+        std::string head;
+        std::shared_ptr<const std::vector<uchar>> body;
+        std::string tail;
+        size_t sent;
+        uint64_t sentSeq;
+    };
+
+    MosaicCompositor &source;
+    LiveViewSettings settings;
+
+    int listenFd;
+    int wakeFds[2];                 // encoders wake the poll loop through this pipe
+    std::atomic<bool> running;
+    std::thread serverThread;
+    std::vector<std::thread> encoders;
+
+    // guards streams, the encode queue and stats
+    mutable std::mutex mutex;
+    std::condition_variable encodeCv;
+    std::map<std::string, std::unique_ptr<Stream>> streams;
+    std::deque<Stream *> encodeQueue;
+    LiveViewStats stats;
+
+    std::vector<std::unique_ptr<Client>> clients;   // server thread only
+
+    void serverLoop();
+    void encoderLoop();
+    void acceptClients();
+    bool readRequest(Client &client);
+    void handleRequest(Client &client);
+    void respond(Client &client, const std::string &status, const std::string &type,
+                 const std::string &body);
+    void startStream(Client &client, const std::string &camId, int width);
+    void scheduleEncodes(int64_t nowMs);
+    void takeFrames();
+    bool sendPending(Client &client);
+    void closeClient(size_t index);
+    void wake();
+
+public:
+    LiveViewServer(MosaicCompositor &source, const LiveViewSettings &settings = LiveViewSettings());
+    ~LiveViewServer();
+
+    LiveViewServer(const LiveViewServer &) = delete;
+    LiveViewServer &operator=(const LiveViewServer &) = delete;
+
+    bool start();
+    void stop();
+    bool isRunning() const;
+
+    LiveViewStats getStats() const;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MAT_IMAGE_H
+#define MAT_IMAGE_H
+
+#include <opencv2/opencv.hpp>
+
+#include "image_buffer.h"
+
+
+// zero-copy views between cv::Mat and ImageBuffer. no pixels are copied, a
+// view is only valid while the memory it looks at is alive. NV12 and I420
+// map to the single-channel height*3/2 Mat that cv::cvtColor takes
+
+// empty Mat if the image has no memory, or is I420 with padded rows, as
+// imageBufferAlloc gives for widths that are not a multiple of IMAGE_ALIGNMENT
+cv::Mat matView(const ImageBuffer &image);
+
+// false if the Mat's type or shape does not match format
+bool imageView(const cv::Mat &mat, PixelFormat format, ImageBuffer &image);
+
+PixelFormat pixelFormatFor(const cv::Mat &mat);
+
+
+// owns one ImageBuffer, from a pool or from the heap, and releases it when
+// destroyed. move-only, so a pooled buffer is returned exactly once
+class OwnedImage {
+private:
+    ImageBuffer buffer;
+
+public:
+    OwnedImage();
+    explicit OwnedImage(ImagePool *pool);
+    OwnedImage(int width, int height, PixelFormat format);
+    ~OwnedImage();
+
+    OwnedImage(OwnedImage &&other);
+    OwnedImage &operator=(OwnedImage &&other);
+    OwnedImage(const OwnedImage &) = delete;
+    OwnedImage &operator=(const OwnedImage &) = delete;
+
+    bool valid() const { return buffer.allocation != nullptr; }
+    ImageBuffer *get() { return &buffer; }
+    const ImageBuffer *get() const { return &buffer; }
+
+    // the pixels as a Mat, valid while this object holds them
+    cv::Mat mat() const { return matView(buffer); }
+
+    void reset();
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef MJPEG_AVI_WRITER_H
+#define MJPEG_AVI_WRITER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+#include "JpegEncoder.h"
+
+
+enum class SyncPolicy {
+    NONE,                           // leave it to the kernel
+    ON_CLOSE,                       // fdatasync once when the file is closed
+    PERIODIC                        // fdatasync every syncIntervalBytes, and on close
+};
+
+
+struct MjpegWriterSettings {
+    int jpegQuality;
+    size_t blockSize;               // bytes per write(), rounded up to 4 KiB
+    bool directIO;                  // O_DIRECT, bypasses the page cache
+    SyncPolicy syncPolicy;
+    size_t syncIntervalBytes;
+
+    MjpegWriterSettings()
+        : jpegQuality(85), blockSize(1024 * 1024), directIO(false),
+          syncPolicy(SyncPolicy::ON_CLOSE), syncIntervalBytes(64 * 1024 * 1024) {}
+};
+
+
+struct MjpegWriterStats {
+    uint64_t frames;
+    uint64_t bytesWritten;
+    uint64_t writeCalls;
+    uint64_t syncCalls;
+};
+
+
+// writes MJPEG in an AVI container with its own I/O: frames are compressed
+// with libjpeg into a reused buffer and collected in an aligned block buffer
+// that goes to disk in large sequential writes. the idx1 index and the final
+// header values are written when the file is closed. not thread safe, meant
+// to be driven by a single writer thread
+class MjpegAviWriter {
+private:
+    struct IndexEntry {
+        uint32_t offset;            // from the 'movi' fourcc
+        uint32_t size;
+    };
+
+    MjpegWriterSettings settings;
+    std::string path;
+    int fd;
+    bool directIO;
+    cv::Size frameSize;
+    double fps;
+
+    // aligned block buffer
+    uint8_t *block;
+    size_t blockFill;
+    uint64_t fileOffset;            // bytes handed to write() so far
+    uint64_t unsyncedBytes;
+
+    JpegEncoder encoder;
+
+    std::vector<IndexEntry> index;
+    uint64_t moviBytes;
+    uint32_t maxChunkSize;
+    uint64_t lastFrameOffset;
+
+    MjpegWriterStats stats;
+
+    bool append(const void *data, size_t size);
+    bool flushBlock(bool final);
+    bool writeFully(const uint8_t *data, size_t size);
+    void buildHeader(std::vector<uint8_t> &header) const;
+    void sync();
+    void freeBuffers();
+
+public:
+    MjpegAviWriter();
+    ~MjpegAviWriter();
+
+    MjpegAviWriter(const MjpegAviWriter &) = delete;
+    MjpegAviWriter &operator=(const MjpegAviWriter &) = delete;
+
+    void setSettings(const MjpegWriterSettings &settings);
+
+    bool open(const std::string &filename, double fps, const cv::Size &frameSize);
+    bool write(const cv::Mat &frame);
+    bool close();
+
+    bool isOpened() const;
+    uint64_t getBytesWritten() const;   // including what is still buffered
+    uint64_t getLastFrameOffset() const;    // file offset of the last frame's chunk
+    MjpegWriterStats getStats() const;
+};
+
+#endif
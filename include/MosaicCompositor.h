@@ -0,0 +1,95 @@
+#ifndef MOSAIC_COMPOSITOR_H
+#define MOSAIC_COMPOSITOR_H
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+
+struct MosaicSettings {
+    cv::Size canvasSize;
+    int columns;                    // 0 picks the squarest grid for the camera count
+    int gap;                        // pixels between tiles
+    bool drawLabels;                // camera id in the tile's corner
+    bool drawBoxes;                 // motion boxes published with the frame
+
+    MosaicSettings()
+        : canvasSize(1920, 1080), columns(0), gap(2), drawLabels(true), drawBoxes(true) {}
+};
+
+
+struct MosaicStats {
+    uint64_t renders;
+    uint64_t tilesDrawn;            // tiles downscaled, over all renders
+    uint64_t tilesSkipped;          // tiles whose frame had not changed
+    double lastMs;
+    double avgMs;
+};
+
+
+// all cameras in one preallocated canvas. capture threads publish their
+// latest frame, by reference, with the motion boxes already found for it.
+// a render downscales only the tiles that received a new frame since the
+// last render, straight into their place in the canvas, and leaves the rest
+// as they are. the camera set is fixed at construction
+class MosaicCompositor {
+private:
+    struct Tile {
+        std::string camId;
+        cv::Rect area;              // in the canvas
+        std::mutex mutex;           // guards latest, boxes and seq
+        cv::Mat latest;
+        std::vector<cv::Rect> boxes;
+        uint64_t seq;               // frames published
+        uint64_t drawnSeq;          // only touched by render()
+        cv::Rect drawnRect;         // where the last frame went, letterboxed in area
+    };
+
+    MosaicSettings settings;
+    std::vector<std::unique_ptr<Tile>> tiles;
+    std::map<std::string, Tile *> byCamera;
+
+    std::mutex renderMutex;         // one render at a time, guards canvas
+    cv::Mat canvas;
+    uint64_t canvasSeq;             // bumped whenever a tile is redrawn
+
+    mutable std::mutex statsMutex;
+    MosaicStats stats;
+
+    void layout();
+    void drawTile(Tile &tile, const cv::Mat &frame, const std::vector<cv::Rect> &boxes);
+
+public:
+    MosaicCompositor(const std::vector<std::string> &camIds,
+                     const MosaicSettings &settings = MosaicSettings());
+
+    MosaicCompositor(const MosaicCompositor &) = delete;
+    MosaicCompositor &operator=(const MosaicCompositor &) = delete;
+
+    // keeps a reference to frame, which must not be written to afterwards.
+    // boxes are in frame coordinates
+    bool publishFrame(const std::string &camId, const cv::Mat &frame,
+                      const std::vector<cv::Rect> &boxes = std::vector<cv::Rect>());
+
+    // redraws the changed tiles and shares the canvas into view, without a
+    // copy, so the next render draws into it. returns the canvas sequence,
+    // which only changes when a tile was redrawn
+    uint64_t render(cv::Mat &view);
+
+    // for a second consumer next to the display: renders, then copies the
+    // canvas into out unless the sequence is still knownSeq
+    uint64_t renderCopy(cv::Mat &out, uint64_t knownSeq);
+
+    // latest frame published by a camera, shared, false if none yet
+    bool getLatestFrame(const std::string &camId, cv::Mat &frame, uint64_t *seq = nullptr);
+
+    // the cameras in tile order
+    std::vector<std::string> getCameraIds() const;
+    MosaicStats getStats() const;
+};
+
+#endif
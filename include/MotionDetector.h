@@ -2,8 +2,15 @@
 #define MOTION_DETECTOR_H
 
 #include <opencv2/opencv.hpp>
+#include <memory>
 #include <functional>
 
+#include "RegionExtractor.h"
+#include "MotionZone.h"
+#include "ObjectTracker.h"
+#include "BlurEngine.h"
+#include "StripPipeline.h"
+
 
 class MotionDetector {
 private:
@@ -11,6 +18,25 @@ private:
     int threshold;
     double minArea;
     bool initialized;
+    RegionExtractor regionExtractor;
+    std::vector<MotionZone> zones;
+    ZoneMask zoneMask;              // rasterised lazily at the first frame size
+    BlurEngine blurEngine;          // noise pre-filter, 21x21 Gaussian equivalent
+    std::shared_ptr<StripPipeline> stripPipeline;   // full-frame path in cache-sized strips
+
+    // tracker-assisted mode
+    ObjectTracker tracker;
+    int keyframeInterval;           // 0 disables tracking
+    int trackMargin;                // dilation around tracked boxes, in pixels
+    int framesSinceKeyframe;
+    bool forceKeyframe;
+
+    bool computeMotionMask(const cv::Mat &currFrame, cv::Mat &mask);
+    void computeRoiMask(const cv::Mat &currFrame, const cv::Rect &roi, cv::Mat &mask);
+    void diffZoneSpans(const cv::Mat &gray, const cv::Rect &grayRect,
+                       const cv::Rect &area, cv::Mat &mask);
+    void findRegions(const cv::Mat &mask, std::vector<MotionRegion> &regions,
+                     const cv::Point &offset = cv::Point(0, 0));
 
 public:
     MotionDetector(int threshold = 25, double minArea = 500.0);
@@ -20,8 +46,41 @@ public:
     cv::Mat getMotionMask(const cv::Mat &currFrame);
     std::vector<cv::Rect> getMotionRegions(const cv::Mat &currFrame);
 
+    // re-checks only the given regions, the reference outside them is kept
+    std::vector<cv::Rect> getMotionRegions(const cv::Mat &currFrame,
+                                           const std::vector<cv::Rect> &rois);
+
+    // full-frame detection every keyframeInterval frames or when the tracker
+    // loses confidence, only the neighbourhood of tracked boxes in between
+    std::vector<TrackedObject> trackMotion(const cv::Mat &currFrame);
+    void enableTracking(int keyframeInterval = 5, int margin = 32);
+    void disableTracking();
+    bool isTrackingEnabled() const;
+
     void setThreshold(int threshold);
     void setMinArea(double area);
+    void setMaxRegions(int count);
+    void setRegionMergeDistance(int cells);
+
+    // recursive or stacked-box blur cost the same per pixel as the kernel
+    // grows, the default Gaussian is exact. changing it resets the reference
+    void setBlurMethod(BlurMethod method);
+    BlurMethod getBlurMethod() const;
+
+    // runs the full-frame stages strip by strip with their intermediates in
+    // cache, same mask as the plain path. zone and region passes are unchanged
+    void enableStripPipeline(int workers = 0, int stripRows = 0);
+    void disableStripPipeline();
+    bool isStripPipelineEnabled() const;
+
+    int getThreshold() const;
+    double getMinArea() const;
+
+    // include/exclude polygons, only pixels inside active zones are analysed
+    void setZones(const std::vector<MotionZone> &zones);
+    void clearZones();
+    bool hasZones() const;
+
     void reset();
 };
 
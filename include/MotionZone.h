@@ -0,0 +1,72 @@
+#ifndef MOTION_ZONE_H
+#define MOTION_ZONE_H
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+// polygon in frame pixel coordinates that includes or excludes motion
+struct MotionZone {
+    std::string name;
+    std::vector<cv::Point> polygon;
+    bool exclude;                   // ignore motion inside the polygon
+    int threshold;                  // < 0 uses the detector threshold
+    double minArea;                 // < 0 uses the detector minimum area
+
+    MotionZone()
+        : exclude(false), threshold(-1), minArea(-1.0) {}
+    MotionZone(const std::string &name, const std::vector<cv::Point> &polygon,
+               bool exclude = false, int threshold = -1, double minArea = -1.0)
+        : name(name), polygon(polygon), exclude(exclude),
+          threshold(threshold), minArea(minArea) {}
+};
+
+
+// run of active pixels [x0, x1) on one row, owned by an include zone
+struct ZoneSpan {
+    int x0;
+    int x1;
+    int zone;
+};
+
+
+// zones rasterised once into a per-row span list. rows are stored
+// back to back, the spans of row y are [rowStart[y], rowStart[y + 1])
+class ZoneMask {
+private:
+    cv::Size frameSize;
+    std::vector<MotionZone> zones;  // include zones only, in priority order
+    std::vector<ZoneSpan> spans;
+    std::vector<int> rowStart;
+    cv::Rect activeBounds;
+    size_t activePixels;
+
+    static void rasteriseRow(const std::vector<cv::Point> &polygon, int y, int width,
+                             std::vector<float> &crossings,
+                             std::vector<std::pair<int, int>> &runs);
+
+public:
+    ZoneMask();
+    ~ZoneMask();
+
+    // without include zones the whole frame is active, minus the exclude zones
+    bool build(const std::vector<MotionZone> &zones, const cv::Size &frameSize);
+    void clear();
+    bool empty() const;
+
+    const ZoneSpan *rowBegin(int y) const;
+    const ZoneSpan *rowEnd(int y) const;
+    int zoneAt(int x, int y) const;
+
+    int getZoneThreshold(int zone, int fallback) const;
+    double getZoneMinArea(int zone, double fallback) const;
+    double getSmallestMinArea(double fallback) const;
+    int getZoneCount() const;
+
+    cv::Size getFrameSize() const;
+    cv::Rect getActiveBounds() const;
+    double getActiveFraction() const;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef OBJECT_TRACKER_H
+#define OBJECT_TRACKER_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+struct TrackedObject {
+    int id;                         // persistent across frames
+    cv::Rect bbox;
+    cv::Point2f velocity;           // centroid motion in pixels per frame
+    int age;                        // frames since first seen
+    int hits;                       // frames with a matched detection
+    int misses;                     // consecutive frames without a match
+};
+
+
+// greedy IoU / centroid-distance multi-object tracker for motion regions
+class ObjectTracker {
+private:
+    std::vector<TrackedObject> tracks;
+    int nextId;
+    double minIoU;                  // overlap needed for an IoU match
+    double maxCentroidShift;        // centroid match radius, in box diagonals
+    int maxMisses;                  // frames a track may coast before it is dropped
+    double matchRatio;              // share of tracks matched by the last update
+    int newTracks;                  // tracks created by the last update
+
+    static double iou(const cv::Rect &a, const cv::Rect &b);
+    static cv::Point2f centroid(const cv::Rect &r);
+
+public:
+    ObjectTracker(double minIoU = 0.2, int maxMisses = 5, double maxCentroidShift = 1.0);
+    ~ObjectTracker();
+
+    // associates detections with tracks and returns the tracks seen this frame
+    std::vector<TrackedObject> update(const std::vector<cv::Rect> &detections);
+
+    // boxes where each live track is expected next frame, grown by margin
+    std::vector<cv::Rect> predictRegions(int margin, const cv::Size &frameSize) const;
+
+    const std::vector<TrackedObject> &getTracks() const;
+    double getMatchRatio() const;
+    int getNewTrackCount() const;
+    bool empty() const;
+    void reset();
+};
+
+#endif
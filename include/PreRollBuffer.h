@@ -0,0 +1,78 @@
+#ifndef PRE_ROLL_BUFFER_H
+#define PRE_ROLL_BUFFER_H
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+#include "VideoRecorder.h"
+
+
+// ring of JPEG-compressed frames covering the last few seconds of a camera.
+// bounded both by duration and by a byte budget, oldest frames go first.
+// push() only queues the frame, the buffer's own thread compresses it, so
+// the capture thread never waits for an encode. if the encoder falls behind,
+// the oldest frames still waiting are dropped. push, flushTo and clear are
+// meant to be called from one capture thread
+class PreRollBuffer {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct RawFrame {
+        cv::Mat frame;
+        Clock::time_point timestamp;
+    };
+
+    std::deque<EncodedFrame> frames;
+    std::deque<RawFrame> raw;       // waiting for the encoder, newer than frames
+    RawFrame encoding;              // held by the encoder, between frames and raw
+    bool busy;
+    uint64_t generation;            // bumped by flushTo and clear, older encodes are dropped
+    size_t budgetBytes;
+    size_t usedBytes;
+    int maxDurationMs;
+    std::vector<int> encodeParams;
+    std::vector<uchar> spare;       // buffer of the last evicted frame, reused
+    uint64_t evictedFrames;
+
+    mutable std::mutex mutex;       // guards everything above
+    std::condition_variable wake;
+    std::thread encoder;
+    bool stopping;
+
+    void encoderLoop();
+    void evictFront();
+    void recycle(std::vector<uchar> &data);
+
+public:
+    PreRollBuffer(size_t budgetBytes = 24 * 1024 * 1024, int maxDurationMs = 10000,
+                  int jpegQuality = 80);
+    ~PreRollBuffer();
+
+    PreRollBuffer(const PreRollBuffer &) = delete;
+    PreRollBuffer &operator=(const PreRollBuffer &) = delete;
+
+    // keeps a reference to frame, which must not be written to afterwards
+    bool push(const cv::Mat &frame);
+
+    // hands every buffered frame to the recorder and empties the buffer,
+    // frames not yet compressed are queued as they are. returns the number
+    // of frames handed over
+    size_t flushTo(VideoRecorder &recorder);
+    void clear();
+
+    void setBudget(size_t bytes);
+    void setMaxDuration(int ms);
+    void setJpegQuality(int quality);
+
+    size_t getFrameCount() const;
+    size_t getUsedBytes() const;
+    size_t getBudgetBytes() const;
+    double getDurationSeconds() const;
+    uint64_t getEvictedFrames() const;
+};
+
+#endif
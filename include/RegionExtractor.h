@@ -0,0 +1,66 @@
+#ifndef REGION_EXTRACTOR_H
+#define REGION_EXTRACTOR_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+
+// connected region found in a binary motion mask
+struct MotionRegion {
+    cv::Rect bbox;                  // tight bounding box in mask pixels
+    int area;                       // number of set mask pixels
+};
+
+
+// labels the 8-connected components of a binary mask, the regions
+// findContours would outline, with union-find over runs of set pixels. one
+// pass over the mask, no contour tracing, so masks full of small blobs
+// cost no more than empty ones. components within mergeDistance grid cells
+// of each other can be merged into one region
+class RegionExtractor {
+private:
+    int cellSize;                   // grid cell edge in pixels, for merging
+    int minCellFill;                // set pixels a cell needs to bridge to its neighbours
+    int mergeDistance;              // cells bridged between components, 0 keeps them apart
+    int maxRegions;                 // deterministic cap on reported regions
+    int lastRegionCount;            // regions found before the cap was applied
+
+    // per-run and per-cell scratch buffers, reused across frames
+    std::vector<int> runStart;
+    std::vector<int> runEnd;        // inclusive
+    std::vector<int> runRow;
+    std::vector<int> parent;
+    std::vector<int> regionIndex;
+    std::vector<int> cellRun;       // a run in each cell, -1 for empty cells
+    std::vector<int> cellCount;
+    std::vector<MotionRegion> regionScratch;
+    std::vector<MotionRegion> rectScratch;  // regions behind the cv::Rect overload
+
+    int findRoot(int idx);
+    void unite(int a, int b);
+    void findRuns(const cv::Mat &mask);
+    void bridgeCells(const cv::Mat &mask);
+    int label(const cv::Mat &mask);
+
+public:
+    RegionExtractor(int cellSize = 8, int maxRegions = 64, int mergeDistance = 0);
+    ~RegionExtractor();
+
+    // fills regions with at most maxRegions entries of area >= minArea,
+    // largest first. returns the number of regions reported. both reuse the
+    // capacity regions already has, pass the same vector every frame
+    int extract(const cv::Mat &mask, double minArea, std::vector<MotionRegion> &regions);
+    int extract(const cv::Mat &mask, double minArea, std::vector<cv::Rect> &regions);
+    bool hasRegion(const cv::Mat &mask, double minArea);
+
+    void setCellSize(int size);
+    void setMinCellFill(int pixels);
+    void setMergeDistance(int cells);
+    void setMaxRegions(int count);
+
+    int getCellSize() const;
+    int getMaxRegions() const;
+    int getLastRegionCount() const;
+};
+
+#endif
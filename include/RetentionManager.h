@@ -0,0 +1,90 @@
+#ifndef RETENTION_MANAGER_H
+#define RETENTION_MANAGER_H
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+
+
+struct RetentionStats {
+    uint64_t totalBytes;
+    size_t segmentCount;
+    uint64_t deletedSegments;
+    uint64_t deletedBytes;
+    uint64_t passes;
+};
+
+
+// keeps recorded segments under a global and/or per-camera disk budget by
+// deleting the oldest ones. runs on its own thread and deletes at most a
+// batch of files per pass, so a large cleanup is spread over several passes
+// instead of hitting the disk all at once
+class RetentionManager {
+private:
+    struct Segment {
+        std::string camId;
+        std::string path;
+        uint64_t bytes;
+        int64_t timeMs;             // from the name's timestamp, else the file's mtime
+    };
+
+    // keyed by segment time, so the oldest file of any camera comes first
+    std::multimap<int64_t, Segment> segments;
+    std::set<std::string> tracked;  // paths in segments, a file is counted once
+    std::vector<std::pair<std::string, std::string>> pending;  // closed, not yet sized
+    std::map<std::string, uint64_t> cameraBudgets;
+    std::map<std::string, uint64_t> cameraBytes;
+    uint64_t globalBudget;          // 0 means no global limit
+    int intervalMs;
+    size_t batchSize;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool running;
+
+    RetentionStats stats;
+
+    void workerLoop();
+    void track(const std::vector<Segment> &found);
+    void collectPending();
+    bool overBudget(const Segment &segment) const;
+    void enforceBudgets();
+
+public:
+    RetentionManager(uint64_t globalBudgetBytes = 0, int intervalMs = 5000, size_t batchSize = 8);
+    ~RetentionManager();
+
+    void setGlobalBudget(uint64_t bytes);
+    void setCameraBudget(const std::string &camId, uint64_t bytes);
+    void setBatchSize(size_t files);
+
+    // registers a finished segment. cheap, safe to call from writer threads
+    void addSegment(const std::string &camId, const std::string &path);
+
+    // picks up segments left over from earlier runs. only files named like
+    // VideoRecorder::timestampedPath(directory, prefix, extension) count, so
+    // snapshots and timelapse frames next to them are left alone. files
+    // already tracked are skipped, rescanning on every start is safe
+    size_t scanDirectory(const std::string &camId, const std::string &directory,
+                         const std::string &prefix, const std::string &extension = ".avi");
+
+    // <prefix>_YYYYMMDD_HHMMSS_mmm<extension>
+    static bool isSegmentName(const std::string &name, const std::string &prefix,
+                              const std::string &extension);
+
+    // ms since the epoch from a segment path's timestamp, -1 if it has none
+    static int64_t segmentTimeMs(const std::string &path);
+
+    bool start();
+    void stop();
+
+    RetentionStats getStats() const;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef SNAPSHOT_DEDUPLICATOR_H
+#define SNAPSHOT_DEDUPLICATOR_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+
+struct DedupDecision {
+    bool duplicate;
+    uint64_t hash;
+    int distance;                   // to the last stored snapshot, -1 if there is none
+    std::string reference;          // path of the last stored snapshot
+};
+
+
+// skips snapshots of a scene that has not changed. each frame gets a 64-bit
+// difference hash (dHash) of its luma, compared against the hash of the last
+// snapshot that was actually stored. the hash samples a sparse grid of the
+// frame, so it costs a few thousand pixel reads however large the frame is.
+// one instance per snapshot stream, not thread safe
+class SnapshotDeduplicator {
+private:
+    int maxDistance;
+    bool hasReference;
+    uint64_t referenceHash;
+    std::string referencePath;
+
+public:
+    // frames within maxDistance bits of the reference are duplicates,
+    // a negative distance turns deduplication off
+    explicit SnapshotDeduplicator(int maxDistance = 4);
+
+    DedupDecision check(const cv::Mat &frame) const;
+
+    // makes a stored snapshot the new reference, call once it is queued
+    void accept(const DedupDecision &decision, const std::string &path);
+
+    void reset();
+
+    // 9x8 cells of mean luma, one bit per horizontal neighbour pair
+    static uint64_t dHash(const cv::Mat &frame);
+    static int distance(uint64_t a, uint64_t b);
+
+    // one CSV line for the snapshot index: time, file, stored/skipped, hash,
+    // distance and, for skipped captures, the file that stands in for them
+    static std::string indexLine(int64_t timestampMs, const std::string &path,
+                                 const DedupDecision &decision);
+    static bool appendIndex(const std::string &indexPath, const std::vector<std::string> &lines);
+};
+
+#endif
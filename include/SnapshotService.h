@@ -0,0 +1,105 @@
+#ifndef SNAPSHOT_SERVICE_H
+#define SNAPSHOT_SERVICE_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+#include "MatImage.h"
+
+
+struct SnapshotSettings {
+    int workers;                    // 0 picks half the cores
+    size_t queueCapacity;           // jobs waiting for a worker, more are dropped
+    int jpegQuality;
+    cv::Size maxSize;               // snapshots are scaled down to fit, 0x0 keeps full size
+
+    SnapshotSettings()
+        : workers(0), queueCapacity(16), jpegQuality(85), maxSize(0, 0) {}
+};
+
+
+struct SnapshotStats {
+    uint64_t submitted;
+    uint64_t written;
+    uint64_t dropped;               // queue was full
+    uint64_t failed;                // encode or write error
+    uint64_t bytesWritten;
+    size_t queueDepth;
+    size_t peakQueueDepth;
+};
+
+
+// called on a worker thread once the snapshot is on disk, or has failed
+typedef std::function<void(const std::string &path, bool ok)> SnapshotCallback;
+
+
+// encodes and writes JPEG snapshots on a pool of worker threads. submit()
+// copies the frame into a buffer from an ImagePool kept per frame size and
+// format, and returns, it never waits for a
+// worker: when the queue is full the snapshot is dropped. each worker keeps
+// its own libjpeg compressor and scaling buffer for its whole lifetime.
+// files are written under a temporary name and renamed into place, so
+// readers never see a partial image
+class SnapshotService {
+private:
+    struct Job {
+        OwnedImage image;           // pooled copy of the frame
+        cv::Mat frame;              // image's pixels, or a heap copy of an unpooled frame
+        std::string path;
+        int quality;
+        cv::Size maxSize;
+        SnapshotCallback done;
+    };
+
+    SnapshotSettings settings;
+
+    std::deque<Job> queue;
+    // one pool per frame size and format, each capped at what the queue and
+    // the workers can hold. created on first use, destroyed with the service
+    struct FramePool {
+        cv::Size size;
+        PixelFormat format;
+        ImagePool *pool;
+    };
+    std::vector<FramePool> pools;
+    mutable std::mutex mutex;
+    std::condition_variable jobReady;
+    std::vector<std::thread> workers;
+    bool running;
+
+    SnapshotStats stats;
+
+    void workerLoop();
+    ImagePool *poolFor(const cv::Mat &frame);
+    bool writeFile(const std::string &path, const unsigned char *data, unsigned long size);
+
+public:
+    explicit SnapshotService(const SnapshotSettings &settings = SnapshotSettings());
+    ~SnapshotService();
+
+    SnapshotService(const SnapshotService &) = delete;
+    SnapshotService &operator=(const SnapshotService &) = delete;
+
+    bool start();
+    void stop();                    // writes out what is queued, then joins
+    bool isRunning() const;
+
+    // false if the snapshot was dropped. quality -1 and an empty size use
+    // the service defaults
+    bool submit(const cv::Mat &frame, const std::string &path);
+    bool submit(const cv::Mat &frame, const std::string &path, int quality,
+                const cv::Size &maxSize, SnapshotCallback done = nullptr);
+
+    SnapshotStats getStats() const;
+
+    // largest size with the frame's aspect ratio that fits within maxSize
+    static cv::Size fitWithin(const cv::Size &frameSize, const cv::Size &maxSize);
+};
+
+#endif
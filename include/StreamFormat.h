@@ -0,0 +1,21 @@
+#ifndef STREAM_FORMAT_H
+#define STREAM_FORMAT_H
+
+#include <opencv2/opencv.hpp>
+
+
+// what a source actually delivers. an empty size means not known yet, the
+// consumer then takes the format from the first frame it sees
+struct StreamFormat {
+    cv::Size size;
+    double fps;
+    int type;                       // cv::Mat type of the frames, e.g. CV_8UC3
+
+    StreamFormat() : size(0, 0), fps(30.0), type(CV_8UC3) {}
+    StreamFormat(const cv::Size &size, double fps, int type = CV_8UC3)
+        : size(size), fps(fps), type(type) {}
+
+    bool known() const { return size.area() > 0; }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef STREAM_REMUXER_H
+#define STREAM_REMUXER_H
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <functional>
+
+#include "VideoRecorder.h"
+
+
+struct RemuxStats {
+    uint64_t packetsWritten;
+    uint64_t bytesWritten;
+    uint64_t keyframes;
+    int segments;
+    int reconnects;
+};
+
+
+// records a compressed stream (RTSP, HTTP or a local file) straight into
+// MP4/MKV segments without decoding. packets are only re-timestamped, so the
+// cost per camera is close to a file copy. needs FFmpeg (HAVE_FFMPEG), without
+// it start() fails and callers fall back to VideoRecorder
+class StreamRemuxer {
+private:
+    std::string sourceUrl;
+    std::string directory;
+    std::string prefix;
+    std::string container;          // "mp4" or "mkv"
+    SegmentSettings segmentSettings;
+
+    std::atomic<bool> running;
+    std::thread worker;
+    std::function<void(const std::string &)> fileClosedCallback;
+
+    mutable std::mutex statsMutex;
+    RemuxStats stats;
+    std::string outputPath;
+
+    void remuxLoop();
+    bool remuxSession();
+
+public:
+    StreamRemuxer(const std::string &sourceUrl);
+    ~StreamRemuxer();
+
+    StreamRemuxer(const StreamRemuxer &) = delete;
+    StreamRemuxer &operator=(const StreamRemuxer &) = delete;
+
+    bool start(const std::string &directory, const std::string &prefix,
+               const SegmentSettings &settings = SegmentSettings(),
+               const std::string &container = "mp4");
+    void stop();
+
+    // called with every completed segment, from the remux thread
+    void setFileClosedCallback(const std::function<void(const std::string &)> &callback);
+
+    bool isRunning() const;
+    std::string getOutputPath() const;
+    RemuxStats getStats() const;
+
+    static bool isSupported();
+};
+
+#endif
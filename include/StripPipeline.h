@@ -0,0 +1,109 @@
+#ifndef STRIP_PIPELINE_H
+#define STRIP_PIPELINE_H
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+#include "BlurEngine.h"
+
+
+struct StripPipelineSettings {
+    int blurSize;                   // Gaussian kernel, as MotionDetector uses it
+    int dilateSize;                 // rectangular structuring element
+    int dilateIterations;
+    int stripRows;                  // output rows per strip, 0 sizes strips to the L2 cache
+    int workers;                    // threads including the caller, 0 for two. every camera's
+                                    // detector owns a pipeline, one per core each would oversubscribe
+
+    StripPipelineSettings()
+        : blurSize(21), dilateSize(5), dilateIterations(2), stripRows(0), workers(0) {}
+};
+
+
+struct StripPipelineStats {
+    uint64_t frames;
+    int strips;                     // per frame
+    int stripRows;
+    double haloOverhead;            // extra rows converted and blurred, relative to the frame
+    double lastMs;
+    double avgMs;
+};
+
+
+// the motion mask stages, gray -> blur -> absdiff -> threshold -> dilate,
+// run one horizontal strip at a time instead of one full-frame Mat per stage.
+// a strip carries enough halo rows that its output rows match a full-frame
+// pass, and its intermediates are small enough to stay in L2, so only the
+// frame, the reference and the mask go to memory. strips are shared out over
+// a worker pool, the calling thread takes strips too. process() calls are
+// serialised
+class StripPipeline {
+private:
+    struct Scratch {
+        BlurEngine blur;
+        cv::Mat gray;
+        cv::Mat blurred;
+        cv::Mat delta;
+        cv::Mat dilated;
+    };
+
+    StripPipelineSettings settings;
+    BlurMethod blurMethod;
+    cv::Mat dilateKernel;
+    int workerCount;
+
+    // the frame being processed, read by every strip
+    const cv::Mat *frame;
+    const cv::Mat *reference;
+    cv::Mat next;                   // new reference, written strip by strip
+    cv::Mat *mask;
+    int threshold;
+    int stripRows;
+    int strips;
+
+    std::mutex runMutex;            // one frame at a time
+    std::vector<std::thread> workers;
+    std::vector<Scratch> scratch;   // [0] is the calling thread's
+    std::mutex poolMutex;
+    std::condition_variable workCv;
+    std::condition_variable doneCv;
+    int nextStrip;
+    int stripsRemaining;
+    uint64_t generation;
+    bool stopping;
+
+    mutable std::mutex statsMutex;
+    StripPipelineStats stats;
+
+    void startWorkers();
+    void workerLoop(int index);
+    void runStrips(Scratch &local);
+    void processStrip(int strip, Scratch &local);
+    int blurHalo() const;
+    int dilateHalo() const;
+
+public:
+    StripPipeline(const StripPipelineSettings &settings = StripPipelineSettings());
+    ~StripPipeline();
+
+    StripPipeline(const StripPipeline &) = delete;
+    StripPipeline &operator=(const StripPipeline &) = delete;
+
+    // mask of the pixels of frame that differ from reference by more than
+    // threshold after blurring, then reference becomes the blurred frame.
+    // reference must be an earlier blurred frame of the same size
+    void process(const cv::Mat &frame, cv::Mat &reference, cv::Mat &mask, int threshold);
+
+    void setBlurMethod(BlurMethod method);
+    StripPipelineStats getStats() const;
+
+    // output rows per strip so a strip's intermediates fit in cacheBytes
+    static int stripRowsFor(int width, int halo, size_t cacheBytes);
+    static size_t l2CacheBytes();
+};
+
+#endif
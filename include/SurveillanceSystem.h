@@ -4,17 +4,58 @@
 #include <map>
 #include <thread>
 #include <atomic>
+#include <memory>
 
 #include "CameraManager.h"
 #include "MotionDetector.h"
 #include "VideoRecorder.h"
+#include "BatchMotionEngine.h"
+#include "ActivityGovernor.h"
+#include "EventRecorder.h"
+#include "RetentionManager.h"
+#include "StreamRemuxer.h"
+#include "SnapshotService.h"
+#include "TimelapseScheduler.h"
+#include "TemporalDenoiser.h"
+#include "MosaicCompositor.h"
+#include "LiveViewServer.h"
+
+
+struct MotionSnapshotSettings {
+    cv::Size thumbnailSize;         // scaled down to fit, 0x0 keeps full size
+    int minIntervalMs;              // at most one thumbnail per interval while motion lasts
+    int jpegQuality;
+
+    MotionSnapshotSettings()
+        : thumbnailSize(320, 240), minIntervalMs(2000), jpegQuality(75) {}
+};
 
 
 class SurveillanceSystem {
 private:
     CameraManager camManager;
     std::map<std::string, MotionDetector> motionDetectors;
+    std::unique_ptr<RetentionManager> retention;    // outlives the recorders feeding it
     std::map<std::string, VideoRecorder> videoRecorders;
+    std::map<std::string, std::unique_ptr<StreamRemuxer>> remuxers;
+    std::unique_ptr<BatchMotionEngine> batchEngine;
+    std::map<std::string, std::unique_ptr<ActivityGovernor>> activityGovernors;
+    std::map<std::string, std::unique_ptr<EventRecorder>> eventRecorders;
+    std::map<std::string, std::unique_ptr<TemporalDenoiser>> denoisers;
+
+    struct MotionSnapshotTarget {
+        std::string directory;
+        MotionSnapshotSettings settings;
+    };
+    std::unique_ptr<SnapshotService> snapshots;
+    std::map<std::string, MotionSnapshotTarget> motionSnapshots;
+    std::unique_ptr<TimelapseScheduler> timelapse;     // uses snapshots, declared after it
+
+    MosaicSettings mosaicSettings;
+    std::unique_ptr<MosaicCompositor> mosaic;       // built by start(), fed by the monitor threads
+    bool liveViewEnabled;
+    LiveViewSettings liveViewSettings;
+    std::unique_ptr<LiveViewServer> liveView;       // reads the mosaic, declared after it
 
     std::atomic<bool> running;
     std::map<std::string, std::thread> monitorThreads;
@@ -33,16 +74,83 @@ public:
     bool enableMotionDetection(const std::string &camId, int threshold=25);
     bool disableMotionDetection(const std::string &camId);
 
+    // zones, blur, strips and tracking reconfigure the detector its monitor
+    // thread uses, they must be set before start()
+    bool setMotionZones(const std::string &camId, const std::vector<MotionZone> &zones);
+    bool setMotionBlur(const std::string &camId, BlurMethod method);
+    bool enableStripPipeline(const std::string &camId, int workers = 0);
+    bool enableObjectTracking(const std::string &camId, int keyframeInterval = 5);
+
+    // temporal noise filter ahead of motion detection and recording, static
+    // areas are averaged over frames, the last motion boxes are left alone.
+    // must be enabled before start()
+    bool enableTemporalDenoise(const std::string &camId,
+                               const TemporalDenoiseSettings &settings = TemporalDenoiseSettings());
+    bool disableTemporalDenoise(const std::string &camId);
+    bool getDenoiseStats(const std::string &camId, TemporalDenoiseStats &stats) const;
+
+    // batched motion analysis, must be enabled before start()
+    bool enableBatchMotion(const cv::Size &analysisSize = cv::Size(320, 240), int workers = 0);
+    BatchMotionStats getBatchMotionStats() const;
+
+    // activity-adaptive processing rate, set before start()
+    bool enableActivityGovernor(const std::string &camId,
+                                const ActivitySettings &settings = ActivitySettings());
+    bool disableActivityGovernor(const std::string &camId);
+    bool getActivityStats(const std::string &camId, ActivityStats &stats) const;
+
     // recording
     bool startRecording(const std::string &camId, const std::string &filename);
+    bool setRecorderBackend(const std::string &camId, RecorderBackend backend,
+                            const MjpegWriterSettings &settings = MjpegWriterSettings());
+    bool startSegmentedRecording(const std::string &camId, const std::string &directory,
+                                 const SegmentSettings &settings = SegmentSettings());
+    // IP cameras only: stores the compressed stream as is, no decode or encode
+    bool startRemuxRecording(const std::string &camId, const std::string &directory,
+                             const SegmentSettings &settings = SegmentSettings(),
+                             const std::string &container = "mp4");
     bool stopRecording(const std::string &camId);
+    bool getRecorderStats(const std::string &camId, RecorderStats &stats) const;
+
+    // disk budget for segmented recordings, enable before recording starts.
+    // a budget of 0 means unlimited
+    bool enableRetention(uint64_t globalBudgetBytes);
+    bool setCameraDiskBudget(const std::string &camId, uint64_t bytes);
+    bool getRetentionStats(RetentionStats &stats) const;
+
+    // motion-triggered recording with pre-roll, must be enabled before start()
+    bool enableEventRecording(const std::string &camId, const std::string &outputDir,
+                              const EventRecordingSettings &settings = EventRecordingSettings());
+    bool disableEventRecording(const std::string &camId);
+
+    // JPEG thumbnails of motion, encoded and written off the capture thread.
+    // must be enabled before start()
+    bool enableMotionSnapshots(const std::string &camId, const std::string &outputDir,
+                               const MotionSnapshotSettings &settings = MotionSnapshotSettings());
+    bool disableMotionSnapshots(const std::string &camId);
+    bool getSnapshotStats(SnapshotStats &stats) const;
+
+    // periodic snapshots, one scheduler thread for all cameras. must be
+    // enabled before start()
+    bool enableTimelapse(const std::string &camId, const std::string &outputDir,
+                         const TimelapseSettings &settings = TimelapseSettings());
+    bool disableTimelapse(const std::string &camId);
+    bool getTimelapseStats(const std::string &camId, TimelapseStats &stats) const;
 
     // system control
     bool start();
     bool stop();
     bool isRunning() const;
 
-    // display
+    // MJPEG over HTTP from the mosaic's frames, for boxes without a screen.
+    // must be enabled before start()
+    bool enableLiveView(const LiveViewSettings &settings = LiveViewSettings());
+    bool getLiveViewStats(LiveViewStats &stats) const;
+
+    // display. frames are shown as the monitor threads left them, motion is
+    // not analysed again. displayAllCameras draws every camera into one window
+    bool setMosaicSettings(const MosaicSettings &settings);
+    bool getMosaicStats(MosaicStats &stats) const;
     void displayCamera(const std::string &camId);
     void displayAllCameras();
 };
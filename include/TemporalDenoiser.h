@@ -0,0 +1,58 @@
+#ifndef TEMPORAL_DENOISER_H
+#define TEMPORAL_DENOISER_H
+
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+
+struct TemporalDenoiseSettings {
+    int strength;                   // new frame weight 1/2, 1/4 or 1/8 for 1, 2 or 3
+    int noiseThreshold;             // larger per-channel changes are taken as real
+    int motionMargin;               // pixels kept around motion boxes
+
+    TemporalDenoiseSettings()
+        : strength(2), noiseThreshold(12), motionMargin(8) {}
+};
+
+
+struct TemporalDenoiseStats {
+    uint64_t frames;
+    uint64_t resets;                // first frame, size or format changes
+    double motionCoverage;          // fraction of the last frame left unfiltered by boxes
+    double lastMs;
+    double avgMs;
+};
+
+
+// recursive temporal filter for static parts of the scene. each channel
+// moves a fixed fraction of the way from its running average to the new
+// frame, so sensor noise averages out over a few frames. pixels inside the
+// motion boxes, and channels that changed by more than the noise threshold,
+// pass through untouched and restart their average there, so moving objects
+// do not smear. works in place on 8-bit frames with byte-wide SIMD averages,
+// rounding alternates between frames so the average does not creep. one per
+// camera, used from the camera's thread
+class TemporalDenoiser {
+private:
+    TemporalDenoiseSettings settings;
+    cv::Mat average;                // output of the last frame
+    bool roundDown;
+
+    mutable std::mutex statsMutex;
+    TemporalDenoiseStats stats;
+
+public:
+    TemporalDenoiser(const TemporalDenoiseSettings &settings = TemporalDenoiseSettings());
+
+    // filters frame in place. motion holds the boxes of the last motion
+    // analysis, in frame coordinates
+    void process(cv::Mat &frame, const std::vector<cv::Rect> &motion = std::vector<cv::Rect>());
+    void reset();
+
+    TemporalDenoiseSettings getSettings() const;
+    TemporalDenoiseStats getStats() const;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef TIMELAPSE_SCHEDULER_H
+#define TIMELAPSE_SCHEDULER_H
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <condition_variable>
+#include <opencv2/opencv.hpp>
+
+#include "SnapshotService.h"
+#include "SnapshotDeduplicator.h"
+
+
+struct TimelapseSettings {
+    int intervalMs;
+    bool alignToWallClock;          // fire on multiples of the interval in local time, e.g. :00 :10 :20
+    std::string prefix;             // file name prefix, empty uses <camId>_timelapse
+    int jpegQuality;
+    cv::Size maxSize;               // 0x0 keeps full size
+    int dedupMaxDistance;           // skip captures this close to the last stored one, -1 keeps all
+    bool writeIndex;                // log stored and skipped captures to <prefix>_index.csv
+
+    TimelapseSettings()
+        : intervalMs(10000), alignToWallClock(true), jpegQuality(85), maxSize(0, 0),
+          dedupMaxDistance(4), writeIndex(true) {}
+};
+
+
+struct TimelapseStats {
+    uint64_t scheduled;             // times the timer fired
+    uint64_t captured;              // frames handed to the snapshot service
+    uint64_t missed;                // no frame arrived before the next firing
+    uint64_t dropped;               // snapshot queue was full
+    uint64_t skipped;               // scene unchanged since the last stored capture
+};
+
+
+// one timer wheel thread for the timelapse of every camera. when a camera is
+// due the wheel only raises a flag, the camera's capture loop sees it on its
+// next frame and hands that frame to the snapshot service, whose pool does the
+// encoding. the thread count stays the same however many cameras there are.
+// captures of an unchanged scene are skipped before they are copied or
+// encoded, the index records which stored file stands in for them
+class TimelapseScheduler {
+private:
+    struct Entry {
+        std::string camId;
+        std::string directory;
+        TimelapseSettings settings;
+        int64_t nextDueMs;          // wall clock of the next firing
+        uint64_t rounds;            // full turns of the wheel still to wait
+        std::atomic<int64_t> pending;   // raised firing, 0 when none
+        SnapshotDeduplicator dedup;     // only touched by the camera's capture thread
+        std::string indexPath;
+        std::vector<std::string> indexLines;    // written out by the scheduler thread
+        TimelapseStats stats;
+    };
+
+    SnapshotService &snapshots;
+    int tickMs;
+    std::vector<std::vector<Entry *>> wheel;
+    uint64_t currentTick;
+
+    std::map<std::string, std::unique_ptr<Entry>> entries;  // fixed while running
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool running;
+
+    void schedule(Entry *entry, int64_t nowMs);
+    void advance(int64_t nowMs);
+    void workerLoop();
+    void flushIndexes(std::unique_lock<std::mutex> &lock);
+    int64_t firstDue(const TimelapseSettings &settings, int64_t nowMs) const;
+    static std::string pathFor(const Entry &entry, int64_t wallMs);
+
+public:
+    // tickMs is the wheel resolution, firings are at most one tick late
+    TimelapseScheduler(SnapshotService &snapshots, int tickMs = 100, size_t slots = 600);
+    ~TimelapseScheduler();
+
+    TimelapseScheduler(const TimelapseScheduler &) = delete;
+    TimelapseScheduler &operator=(const TimelapseScheduler &) = delete;
+
+    // cameras are added and removed before start()
+    bool addCamera(const std::string &camId, const std::string &directory,
+                   const TimelapseSettings &settings);
+    bool removeCamera(const std::string &camId);
+
+    bool start();
+    void stop();
+
+    // called by the capture loop with every frame, cheap unless the camera
+    // is due. true if the frame was taken for the timelapse
+    bool offerFrame(const std::string &camId, const cv::Mat &frame);
+
+    bool getStats(const std::string &camId, TimelapseStats &stats) const;
+};
+
+#endif
@@ -18,6 +18,8 @@ public:
     bool captureFrame() override;
     bool isAvailable() const override;
 
+    void setFPS(int fps) override;
+    bool setCaptureRate(int fps) override;
     void setDeviceIndex(int index);
 };
 
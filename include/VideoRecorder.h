@@ -1,31 +1,209 @@
 #ifndef VIDEO_RECORDER_H
 #define VIDEO_RECORDER_H
 
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <string>
+#include <vector>
+#include <functional>
+#include <condition_variable>
 #include <opencv2/opencv.hpp>
 
+#include "StreamFormat.h"
+#include "MjpegAviWriter.h"
+#include "FrameIndex.h"
 
+
+enum class RecorderBackend {
+    OPENCV,                         // cv::VideoWriter, codec picked by fourcc
+    MJPEG_AVI                       // built-in MJPEG writer with tunable I/O
+};
+
+
+// what writeFrame does when the queue is full
+enum class OverflowPolicy {
+    BLOCK,                          // wait for the writer thread to make room
+    DROP_OLDEST,                    // discard the oldest queued frame
+    DROP_NON_KEYFRAME               // discard non-keyframes, keep keyframes
+};
+
+
+// a frame kept in compressed form, decoded on the writer thread
+struct EncodedFrame {
+    std::vector<uchar> data;
+    std::chrono::steady_clock::time_point timestamp;
+};
+
+
+struct RecorderStats {
+    size_t queueDepth;
+    size_t backlogDepth;            // compressed frames waiting to be decoded
+    size_t queueCapacity;
+    size_t peakQueueDepth;
+    uint64_t framesQueued;
+    uint64_t framesWritten;
+    uint64_t framesDropped;
+    uint64_t framesFailed;          // dequeued but rejected by the encoder or writer
+    uint64_t framesConverted;       // frames that needed a resize or colour conversion
+};
+
+
+// when a segmented recording rolls over to a new file. rotation happens at
+// the first keyframe after either limit is reached
+struct SegmentSettings {
+    int segmentSeconds;             // 0 disables time-based rotation
+    uint64_t segmentBytes;          // 0 disables size-based rotation
+
+    SegmentSettings() : segmentSeconds(300), segmentBytes(0) {}
+};
+
+
+// encodes and writes on a dedicated writer thread, so a slow encode or disk
+// flush never stalls the capture loop that feeds it
 class VideoRecorder {
 private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct QueuedFrame {
+        cv::Mat frame;
+        bool keyframe;
+        bool motion;
+        Clock::time_point timestamp;
+    };
+
+    // how incoming frames get to the writer's format, worked out once per
+    // source format. the buffers are reused from frame to frame
+    struct ConversionPlan {
+        cv::Size sourceSize;
+        int sourceType;
+        bool resize;
+        int colorCode;              // -1 when no colour conversion is needed
+        bool resizeFirst;           // shrink before converting, convert before enlarging
+        cv::Mat stage1;
+        cv::Mat stage2;
+    };
+
+    RecorderBackend backend;
     cv::VideoWriter writer;
-    std::string outputPath;
-    bool isRecording;
+    MjpegAviWriter mjpegWriter;
+    FrameIndexWriter frameIndex;    // <file>.idx next to every recording
+    bool indexEnabled;
+    uint32_t fileFrames;            // frames in the current file
+    std::string outputPath;         // current file, changes on every rotation
+    std::atomic<bool> isRecording;
     int codec;
     double fps;
     cv::Size frameSize;
+    bool isColor;
+
+    // writer thread only
+    ConversionPlan plan;
+    bool awaitingFormat;            // the writer opens on the first frame
+    std::string pendingPath;
+    Clock::time_point openRetryAt;  // after a failed first open
+    int openBackoffMs;
+
+    // bounded frame queue between the capture thread and the writer thread
+    std::deque<QueuedFrame> queue;
+    std::deque<EncodedFrame> backlog;   // older than anything in queue, written first
+    size_t queueCapacity;
+    OverflowPolicy overflowPolicy;
+    int keyframeInterval;           // every Nth frame is treated as a keyframe
+    uint64_t submittedFrames;
+    mutable std::mutex queueMutex;
+    std::condition_variable frameReady;
+    std::condition_variable spaceReady;
+    std::thread writerThread;
+    bool stopWriter;
+
+    // segmented recording, only touched by the writer thread once started
+    bool segmented;
+    std::string segmentDir;
+    std::string segmentPrefix;
+    SegmentSettings segmentSettings;
+    Clock::time_point segmentStart;
+    int segmentCount;
+    std::function<void(const std::string &)> fileClosedCallback;
+
+    RecorderStats stats;
+
+    bool openWriter(const std::string &filename);
+    bool writerOpened() const;
+    void releaseWriter();
+    bool writeToBackend(const cv::Mat &frame);
+    bool negotiate(const StreamFormat &source, const std::string &filename);
+    bool negotiateFromFrame(const cv::Mat &frame);
+    void buildPlan(const cv::Size &size, int type);
+    bool startWriter();
+    void closeFile();
+    bool segmentDue() const;
+    void rotateSegment();
+    void writerLoop();
+    bool encodeFrame(const cv::Mat &frame, bool &converted);
+    void indexFrame(Clock::time_point captured, bool motion);
+    bool makeRoom(std::unique_lock<std::mutex> &lock, bool keyframe);
 
 public:
     VideoRecorder();
     ~VideoRecorder();
 
-    bool startRecording(const std::string &filename, int fps, 
+    VideoRecorder(const VideoRecorder &) = delete;
+    VideoRecorder &operator=(const VideoRecorder &) = delete;
+
+    // fixed output format, frames are converted to it when they differ
+    bool startRecording(const std::string &filename, int fps,
                         const cv::Size &frameSize,
                         int codec = cv::VideoWriter::fourcc('X', 'V', 'I', 'D'));
+
+    // output format negotiated from the source, so matching frames are
+    // written untouched. an unknown source format is taken from the first frame
+    bool startRecording(const std::string &filename, const StreamFormat &source,
+                        int codec = cv::VideoWriter::fourcc('X', 'V', 'I', 'D'));
+    // writes a series of timestamped files <directory>/<prefix>_<time>.avi,
+    // rotating on the writer thread so the capture path never waits for it
+    bool startSegmentedRecording(const std::string &directory, const std::string &prefix,
+                                 int fps, const cv::Size &frameSize,
+                                 const SegmentSettings &settings = SegmentSettings(),
+                                 int codec = cv::VideoWriter::fourcc('X', 'V', 'I', 'D'));
+    bool startSegmentedRecording(const std::string &directory, const std::string &prefix,
+                                 const StreamFormat &source,
+                                 const SegmentSettings &settings = SegmentSettings(),
+                                 int codec = cv::VideoWriter::fourcc('X', 'V', 'I', 'D'));
     bool stopRecording();
-    bool writeFrame(const cv::Mat &frame);
+
+    // called with the path of every file once it is complete. runs on the
+    // writer thread, so it must be quick. set before recording starts
+    void setFileClosedCallback(const std::function<void(const std::string &)> &callback);
+
+    // queues the frame by reference, the caller must not write into it afterwards.
+    // motion is recorded in the frame index. returns false if the frame was dropped
+    bool writeFrame(const cv::Mat &frame, bool keyframe = false, bool motion = false);
+
+    // takes over a run of compressed frames. they are not subject to the queue
+    // capacity, their memory is already bounded by whoever produced them
+    bool writeEncodedFrames(std::deque<EncodedFrame> &frames);
+
+    // set before recording starts. the MJPEG backend ignores the codec
+    void setBackend(RecorderBackend backend,
+                    const MjpegWriterSettings &settings = MjpegWriterSettings());
+
+    void setFrameIndexEnabled(bool enable);
+    void setQueueCapacity(size_t frames);
+    void setOverflowPolicy(OverflowPolicy policy);
+    void setKeyframeInterval(int frames);
 
     bool getRecordingStatus() const;
     std::string getOutputPath() const;
+    size_t getQueueDepth() const;
+    uint64_t getDroppedFrames() const;
+    int getSegmentCount() const;
+    RecorderStats getStats() const;
+
+    static std::string timestampedPath(const std::string &directory, const std::string &prefix,
+                                       const std::string &extension = ".avi");
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,56 @@
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <stdint.h>
+
+#include "image_buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef enum {
+    FILTER_BORDER_REPLICATE,        // aaa|abcd|ddd
+    FILTER_BORDER_REFLECT_101       // cb|abcd|cb, what cv::GaussianBlur uses by default
+} FilterBorder;
+
+
+// 1D Gaussian kernel in 16-bit fixed point, applied along rows and then
+// along columns. each set of weights sums exactly to its scale
+typedef struct {
+    int size;                       // odd
+    float sigma;
+    uint16_t *horizontal;           // 8 fractional bits, sums to 256
+    uint16_t *vertical;             // 15 fractional bits, sums to 32768
+} GaussianKernel;
+
+
+// size <= 0 derives the size from sigma, sigma <= 0 derives sigma from the
+// size, the same way cv::GaussianBlur does
+GaussianKernel *createGaussianKernel(int size, float sigma);
+void freeKernel(GaussianKernel *kernel);
+
+// separable blur of input into output, which must have the same size and
+// interleaved pixel format (GRAY8, BGR24, RGB24 or BGRA32) and must not share
+// its memory. rows are split into blocks over up to `threads` threads, 0 uses
+// every online core. returns 0 or -1
+int applyGaussianFilter(const ImageBuffer *input, ImageBuffer *output,
+                        const GaussianKernel *kernel, FilterBorder border, int threads);
+
+// the SIMD path compiled in: "avx2", "sse2", "neon" or "scalar"
+const char *filterSimdPath(void);
+
+// any pixel format, YUV goes through yuv_jpeg without an RGB conversion.
+// returns 0 or -1
+int save_jpeg(const char *filename, const ImageBuffer *img, int quality);
+#ifdef HAVE_LIBPNG
+// the interleaved formats only. returns 0 or -1
+int save_png(const char *filename, const ImageBuffer *img);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef IMAGE_BUFFER_H
+#define IMAGE_BUFFER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// image memory shared by the C filters, the encoders and the C++ pipeline.
+// rows carry a stride, so a buffer can also describe a cv::Mat or a V4L2
+// mmap buffer in place. allocated rows start on IMAGE_ALIGNMENT bytes
+
+#define IMAGE_ALIGNMENT 64
+#define IMAGE_MAX_PLANES 3
+
+typedef enum {
+    PIXEL_FORMAT_GRAY8,
+    PIXEL_FORMAT_BGR24,         // cv::Mat CV_8UC3 order
+    PIXEL_FORMAT_RGB24,
+    PIXEL_FORMAT_BGRA32,
+    PIXEL_FORMAT_YUYV,          // packed 4:2:2, Y0 U Y1 V
+    PIXEL_FORMAT_NV12,          // Y plane, then interleaved UV at half resolution
+    PIXEL_FORMAT_I420           // Y plane, then U and V planes at half resolution
+} PixelFormat;
+
+typedef struct ImagePool ImagePool;
+
+typedef struct {
+    int width;
+    int height;
+    PixelFormat format;
+    int planes;
+    unsigned char *data[IMAGE_MAX_PLANES];
+    size_t stride[IMAGE_MAX_PLANES];    // bytes from one row of the plane to the next
+    ImagePool *pool;                    // set when the memory goes back to a pool
+    void *allocation;                   // owned memory, NULL for a wrapped view
+} ImageBuffer;
+
+// bytes per pixel of the first plane: 3 for BGR24, 2 for YUYV, 1 for NV12
+int pixelFormatBytes(PixelFormat format);
+int pixelFormatIsPlanar(PixelFormat format);
+
+// allocates aligned memory for the image. planar formats keep their planes
+// in one block, chroma right after luma, with half the luma stride for I420.
+// returns 0 or -1
+int imageBufferAlloc(ImageBuffer *image, int width, int height, PixelFormat format);
+
+// describes memory owned by someone else (a cv::Mat, an mmap buffer) without
+// copying it. stride 0 means tightly packed rows, planar chroma is expected
+// to follow luma as imageBufferAlloc lays it out. returns 0 or -1
+int imageBufferWrap(ImageBuffer *image, unsigned char *data, int width, int height,
+                    PixelFormat format, size_t stride);
+
+// frees or returns the memory to its pool, a wrapped view is only cleared
+void imageBufferRelease(ImageBuffer *image);
+
+static inline unsigned char *imageBufferRow(const ImageBuffer *image, int plane, int y) {
+    return image->data[plane] + (size_t)y * image->stride[plane];
+}
+
+
+// buffers of one size and format carved out of slabs, each slab a single
+// allocation of slabBuffers images. the pool grows a slab at a time up to
+// maxBuffers (0 for no limit) and never shrinks until destroyed. acquire and
+// release are thread safe
+ImagePool *imagePoolCreate(int width, int height, PixelFormat format, int slabBuffers,
+                           int maxBuffers);
+
+// every buffer must have been released first
+void imagePoolDestroy(ImagePool *pool);
+
+// returns 0, or -1 when the pool is at maxBuffers or out of memory
+int imagePoolAcquire(ImagePool *pool, ImageBuffer *image);
+
+void imagePoolStats(ImagePool *pool, int *total, int *available);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
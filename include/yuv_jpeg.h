@@ -0,0 +1,40 @@
+#ifndef YUV_JPEG_H
+#define YUV_JPEG_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// JPEG encoding straight from camera YUV. the planes are handed to libjpeg
+// through its raw-data interface, so there is no RGB conversion on our side
+// and none inside libjpeg. frames are copied a strip (one MCU row) at a time
+// into small padded buffers, never as a whole
+
+typedef enum {
+    YUV_FORMAT_YUYV,        // packed 4:2:2, Y0 U Y1 V
+    YUV_FORMAT_NV12,        // Y plane, then interleaved UV at half resolution
+    YUV_FORMAT_I420         // Y plane, then U and V planes at half resolution
+} yuv_format;
+
+// holds a libjpeg compressor, its output buffer and the strip buffers, all
+// reused across frames. not thread safe, one per thread
+typedef struct yuv_jpeg_encoder yuv_jpeg_encoder;
+
+yuv_jpeg_encoder *yuv_jpeg_create(void);
+void yuv_jpeg_destroy(yuv_jpeg_encoder *enc);
+
+// stride is the byte length of a row of the Y plane (of the packed frame for
+// YUYV), 0 for tightly packed rows. chroma planes follow the Y plane, with
+// half the stride for I420 and the same stride for NV12. on success out and
+// out_size describe the JPEG, valid until the next call. returns 0 or -1
+int yuv_jpeg_encode(yuv_jpeg_encoder *enc, const unsigned char *data, int width, int height,
+                    size_t stride, yuv_format format, int quality,
+                    const unsigned char **out, unsigned long *out_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
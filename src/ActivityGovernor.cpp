@@ -0,0 +1,143 @@
+#include <iostream>
+#include <algorithm>
+
+#include "ActivityGovernor.h"
+
+
+ActivityGovernor::ActivityGovernor(const ActivitySettings &settings)
+    : settings(settings), state(ActivityState::ACTIVE), analysedOnce(false), analysedInState(0) {
+
+    this->settings.activeFps = std::max(1, settings.activeFps);
+    this->settings.idleFps = std::max(1, std::min(this->settings.activeFps, settings.idleFps));
+    this->settings.idleAfterMs = std::max(0, settings.idleAfterMs);
+    this->settings.active3AInterval = std::max(1, settings.active3AInterval);
+    this->settings.idle3AInterval = std::max(1, settings.idle3AInterval);
+
+    Clock::time_point now = Clock::now();
+    stateSince = now;
+    lastMotion = now;
+    lastAnalysis = now;
+
+    stats.state = state;
+    stats.activeSeconds = 0.0;
+    stats.idleSeconds = 0.0;
+    stats.activeFrames = 0;
+    stats.idleFrames = 0;
+    stats.transitions = 0;
+}
+
+
+ActivityGovernor::~ActivityGovernor() {}
+
+
+void ActivityGovernor::enterState(ActivityState next, Clock::time_point now) {
+    double seconds = std::chrono::duration<double>(now - stateSince).count();
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (state == ActivityState::ACTIVE) {
+        stats.activeSeconds += seconds;
+    }
+    else {
+        stats.idleSeconds += seconds;
+    }
+
+    state = next;
+    stateSince = now;
+    analysedInState = 0;
+    stats.state = next;
+    stats.transitions++;
+}
+
+
+bool ActivityGovernor::shouldAnalyse() {
+    Clock::time_point now = Clock::now();
+
+    // allow a little jitter so a capture loop running at the target rate
+    // is not pushed to every other frame
+    int periodMs = getFramePeriodMs();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastAnalysis);
+    if (analysedOnce && elapsed.count() < periodMs - periodMs / 8) {
+        return false;
+    }
+
+    analysedOnce = true;
+    lastAnalysis = now;
+    analysedInState++;
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (state == ActivityState::ACTIVE) {
+        stats.activeFrames++;
+    }
+    else {
+        stats.idleFrames++;
+    }
+
+    return true;
+}
+
+
+bool ActivityGovernor::shouldRun3A() const {
+    int interval = state == ActivityState::ACTIVE ? settings.active3AInterval
+                                                  : settings.idle3AInterval;
+    // analysedInState counts from 1, so the first frame of a state always tunes
+    return (analysedInState - 1) % interval == 0;
+}
+
+
+bool ActivityGovernor::reportMotion(bool motion) {
+    Clock::time_point now = Clock::now();
+
+    if (motion) {
+        lastMotion = now;
+        if (state == ActivityState::IDLE) {
+            enterState(ActivityState::ACTIVE, now);
+            return true;
+        }
+        return false;
+    }
+
+    auto quiet = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastMotion);
+    if (state == ActivityState::ACTIVE && quiet.count() >= settings.idleAfterMs) {
+        enterState(ActivityState::IDLE, now);
+        return true;
+    }
+
+    return false;
+}
+
+
+ActivityState ActivityGovernor::getState() const {
+    return state;
+}
+
+
+int ActivityGovernor::getTargetFps() const {
+    return state == ActivityState::ACTIVE ? settings.activeFps : settings.idleFps;
+}
+
+
+int ActivityGovernor::getFramePeriodMs() const {
+    return 1000 / getTargetFps();
+}
+
+
+ActivitySettings ActivityGovernor::getSettings() const {
+    return settings;
+}
+
+
+ActivityStats ActivityGovernor::getStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+
+    // include the time spent in the current state so far
+    ActivityStats current = stats;
+    double seconds = std::chrono::duration<double>(Clock::now() - stateSince).count();
+    if (current.state == ActivityState::ACTIVE) {
+        current.activeSeconds += seconds;
+    }
+    else {
+        current.idleSeconds += seconds;
+    }
+
+    return current;
+}
@@ -0,0 +1,357 @@
+#include <iostream>
+
+#include "BatchMotionEngine.h"
+
+
+BatchMotionEngine::BatchMotionEngine(const cv::Size &analysisSize, int workerCount)
+    : analysisSize(analysisSize), nextJob(0), jobsRemaining(0), generation(0),
+      stopping(false), running(false), tickMs(33) {
+
+    if (workerCount <= 0) {
+        workerCount = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    this->workerCount = workerCount;
+
+    // keep the 21x21 blur of MotionDetector at 640 wide, scaled to analysis size
+    int k = std::max(3, (21 * analysisSize.width / 640) | 1);
+    blurSize = cv::Size(k, k);
+
+    dilateKernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+
+    stats.batches = 0;
+    stats.framesProcessed = 0;
+    stats.lastBatchFrames = 0;
+    stats.lastBatchMs = 0.0;
+    stats.avgBatchMs = 0.0;
+    stats.peakBatchMs = 0.0;
+    stats.framesPerSecond = 0.0;
+}
+
+
+BatchMotionEngine::~BatchMotionEngine() {
+    stop();
+}
+
+
+bool BatchMotionEngine::addCamera(const std::string &camId, int threshold, double minArea) {
+    if (running) {
+        std::cerr << "Batch motion engine running, cannot add camera: " << camId << std::endl;
+        return false;
+    }
+
+    if (slotIndex.find(camId) != slotIndex.end()) {
+        return false;
+    }
+
+    std::unique_ptr<Slot> slot(new Slot());
+    slot->camId = camId;
+    slot->index = (int)slots.size();
+    slot->hasNew = false;
+    slot->threshold = std::max(0, std::min(255, threshold));
+    slot->minArea = std::max(0.0, minArea);
+    slot->result.motionDetected = false;
+    slot->result.frameSeq = 0;
+    slot->initialized = false;
+
+    slotIndex[camId] = slot->index;
+    slots.push_back(std::move(slot));
+
+    return true;
+}
+
+
+bool BatchMotionEngine::hasCamera(const std::string &camId) const {
+    return slotIndex.find(camId) != slotIndex.end();
+}
+
+
+bool BatchMotionEngine::setThreshold(const std::string &camId, int threshold) {
+    auto it = slotIndex.find(camId);
+    if (it == slotIndex.end()) {
+        return false;
+    }
+
+    Slot &slot = *slots[it->second];
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    slot.threshold = std::max(0, std::min(255, threshold));
+
+    return true;
+}
+
+
+bool BatchMotionEngine::setMinArea(const std::string &camId, double minArea) {
+    auto it = slotIndex.find(camId);
+    if (it == slotIndex.end()) {
+        return false;
+    }
+
+    Slot &slot = *slots[it->second];
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    slot.minArea = std::max(0.0, minArea);
+
+    return true;
+}
+
+
+bool BatchMotionEngine::submitFrame(const std::string &camId, const cv::Mat &frame) {
+    auto it = slotIndex.find(camId);
+    if (it == slotIndex.end() || frame.empty()) {
+        return false;
+    }
+
+    Slot &slot = *slots[it->second];
+
+    // downscale first so the colour conversion touches as few pixels as possible.
+    // incoming is private to this camera thread, the lock only covers the swap
+    cv::Mat small;
+    if (frame.size() != analysisSize) {
+        cv::resize(frame, small, analysisSize, 0, 0, cv::INTER_AREA);
+    }
+    else {
+        small = frame;
+    }
+
+    if (small.channels() == 3) {
+        cv::cvtColor(small, slot.incoming, cv::COLOR_BGR2GRAY);
+    }
+    else if (small.channels() == 4) {
+        cv::cvtColor(small, slot.incoming, cv::COLOR_BGRA2GRAY);
+    }
+    else {
+        small.copyTo(slot.incoming);
+    }
+
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    std::swap(slot.incoming, slot.staged);
+    slot.sourceSize = frame.size();
+    slot.hasNew = true;
+
+    return true;
+}
+
+
+bool BatchMotionEngine::getResult(const std::string &camId, BatchMotionResult &result) {
+    auto it = slotIndex.find(camId);
+    if (it == slotIndex.end()) {
+        return false;
+    }
+
+    Slot &slot = *slots[it->second];
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    result = slot.result;
+
+    return true;
+}
+
+
+bool BatchMotionEngine::start(int tickMs) {
+    if (running) {
+        return false;
+    }
+
+    if (slots.empty()) {
+        std::cerr << "Batch motion engine has no cameras" << std::endl;
+        return false;
+    }
+
+    // one 64-byte aligned row per camera, allocated once
+    int rowBytes = (analysisSize.width * analysisSize.height + 63) & ~63;
+    arena.create((int)slots.size(), rowBytes, CV_8UC1);
+    for (auto &slot : slots) {
+        slot->initialized = false;
+    }
+
+    this->tickMs = std::max(1, tickMs);
+    stopping = false;
+    running = true;
+    startTime = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < workerCount; i++) {
+        workers.push_back(std::thread(&BatchMotionEngine::workerLoop, this));
+    }
+    tickThread = std::thread(&BatchMotionEngine::tickLoop, this);
+
+    std::cout << "Batch motion engine started: " << slots.size() << " cameras, "
+              << workerCount << " workers" << std::endl;
+
+    return true;
+}
+
+
+bool BatchMotionEngine::stop() {
+    if (!running) {
+        return true;
+    }
+
+    running = false;
+    if (tickThread.joinable()) {
+        tickThread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        stopping = true;
+    }
+    workCv.notify_all();
+
+    for (auto &worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+
+    std::cout << "Batch motion engine stopped" << std::endl;
+
+    return true;
+}
+
+
+bool BatchMotionEngine::isRunning() const {
+    return running;
+}
+
+
+void BatchMotionEngine::tickLoop() {
+    while (running) {
+        auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(tickMs);
+        runBatch();
+        std::this_thread::sleep_until(next);
+    }
+}
+
+
+void BatchMotionEngine::workerLoop() {
+    WorkerScratch scratch;
+    uint64_t seenGeneration = 0;
+
+    std::unique_lock<std::mutex> lock(poolMutex);
+    while (true) {
+        workCv.wait(lock, [&] { return stopping || generation != seenGeneration; });
+        if (stopping) {
+            return;
+        }
+        seenGeneration = generation;
+
+        while (nextJob < jobs.size()) {
+            int idx = jobs[nextJob++];
+
+            lock.unlock();
+            processSlot(*slots[idx], scratch);
+            lock.lock();
+
+            if (--jobsRemaining == 0) {
+                doneCv.notify_all();
+            }
+        }
+    }
+}
+
+
+int BatchMotionEngine::runBatch() {
+    if (!running || workers.empty()) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> batchLock(batchMutex);
+    auto t0 = std::chrono::steady_clock::now();
+
+    // take the latest frame of every camera that produced one since last tick
+    std::vector<int> batch;
+    for (auto &slot : slots) {
+        std::lock_guard<std::mutex> lock(slot->mutex);
+        if (!slot->hasNew) {
+            continue;
+        }
+
+        std::swap(slot->staged, slot->work);
+        slot->hasNew = false;
+        slot->workSourceSize = slot->sourceSize;
+        slot->workThreshold = slot->threshold;
+        slot->workMinArea = slot->minArea;
+        batch.push_back(slot->index);
+    }
+
+    if (batch.empty()) {
+        return 0;
+    }
+
+    size_t batchFrames = batch.size();
+    {
+        std::unique_lock<std::mutex> lock(poolMutex);
+        jobs.swap(batch);
+        nextJob = 0;
+        jobsRemaining = jobs.size();
+        generation++;
+        workCv.notify_all();
+
+        doneCv.wait(lock, [this] { return jobsRemaining == 0; });
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    double elapsed = std::chrono::duration<double>(t1 - startTime).count();
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.batches++;
+    stats.framesProcessed += batchFrames;
+    stats.lastBatchFrames = (int)batchFrames;
+    stats.lastBatchMs = ms;
+    stats.avgBatchMs = stats.batches == 1 ? ms : 0.9 * stats.avgBatchMs + 0.1 * ms;
+    stats.peakBatchMs = std::max(stats.peakBatchMs, ms);
+    stats.framesPerSecond = elapsed > 0.0 ? stats.framesProcessed / elapsed : 0.0;
+
+    return (int)batchFrames;
+}
+
+
+void BatchMotionEngine::processSlot(Slot &slot, WorkerScratch &scratch) {
+    cv::GaussianBlur(slot.work, scratch.blurred, blurSize, 0);
+
+    // reference frame lives in this camera's row of the arena
+    cv::Mat reference(analysisSize, CV_8UC1, arena.ptr(slot.index));
+
+    if (!slot.initialized) {
+        scratch.blurred.copyTo(reference);
+        slot.initialized = true;
+
+        // no motion on first frame
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.result.motionDetected = false;
+        slot.result.regions.clear();
+        slot.result.frameSeq++;
+        return;
+    }
+
+    cv::absdiff(reference, scratch.blurred, scratch.delta);
+    cv::threshold(scratch.delta, scratch.thresh, slot.workThreshold, 255, cv::THRESH_BINARY);
+    cv::dilate(scratch.thresh, scratch.thresh, dilateKernel, cv::Point(-1, -1), 2);
+
+    scratch.blurred.copyTo(reference);
+
+    // minArea is given in source pixels, the mask is at analysis size
+    double sx = (double)slot.workSourceSize.width / analysisSize.width;
+    double sy = (double)slot.workSourceSize.height / analysisSize.height;
+    slot.extractor.extract(scratch.thresh, slot.workMinArea / (sx * sy), scratch.regions);
+
+    for (auto &rect : scratch.regions) {
+        rect = cv::Rect(cvRound(rect.x * sx), cvRound(rect.y * sy),
+                        cvRound(rect.width * sx), cvRound(rect.height * sy));
+    }
+
+    std::lock_guard<std::mutex> lock(slot.mutex);
+    slot.result.motionDetected = !scratch.regions.empty();
+    slot.result.regions = scratch.regions;
+    slot.result.frameSeq++;
+}
+
+
+BatchMotionStats BatchMotionEngine::getStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
+
+
+int BatchMotionEngine::getWorkerCount() const {
+    return workerCount;
+}
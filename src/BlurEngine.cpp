@@ -0,0 +1,251 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "BlurEngine.h"
+
+
+namespace {
+
+const int kBoxPasses = 3;
+
+// below this the exact kernel is small anyway, and both approximations
+// lose accuracy: the recursive coefficients fit worse and three boxes
+// cannot get narrower than width 3
+const double kMinSigma = 2.5;
+
+
+// out = c[0] * x + c[1] * p1 + c[2] * p2 + c[3] * p3 over a row, out may be x
+void recursiveRow(float *out, const float *x, const float *p1, const float *p2, const float *p3,
+                  int n, const float *c) {
+    int i = 0;
+
+#if defined(__AVX__)
+    const __m256 c0 = _mm256_set1_ps(c[0]), c1 = _mm256_set1_ps(c[1]);
+    const __m256 c2 = _mm256_set1_ps(c[2]), c3 = _mm256_set1_ps(c[3]);
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_mul_ps(c0, _mm256_loadu_ps(x + i));
+        v = _mm256_add_ps(v, _mm256_mul_ps(c1, _mm256_loadu_ps(p1 + i)));
+        v = _mm256_add_ps(v, _mm256_mul_ps(c2, _mm256_loadu_ps(p2 + i)));
+        v = _mm256_add_ps(v, _mm256_mul_ps(c3, _mm256_loadu_ps(p3 + i)));
+        _mm256_storeu_ps(out + i, v);
+    }
+#elif defined(__SSE2__)
+    const __m128 c0 = _mm_set1_ps(c[0]), c1 = _mm_set1_ps(c[1]);
+    const __m128 c2 = _mm_set1_ps(c[2]), c3 = _mm_set1_ps(c[3]);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_mul_ps(c0, _mm_loadu_ps(x + i));
+        v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_loadu_ps(p1 + i)));
+        v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_loadu_ps(p2 + i)));
+        v = _mm_add_ps(v, _mm_mul_ps(c3, _mm_loadu_ps(p3 + i)));
+        _mm_storeu_ps(out + i, v);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vmulq_n_f32(vld1q_f32(x + i), c[0]);
+        v = vmlaq_n_f32(v, vld1q_f32(p1 + i), c[1]);
+        v = vmlaq_n_f32(v, vld1q_f32(p2 + i), c[2]);
+        v = vmlaq_n_f32(v, vld1q_f32(p3 + i), c[3]);
+        vst1q_f32(out + i, v);
+    }
+#endif
+
+    for (; i < n; ++i) {
+        out[i] = c[0] * x[i] + c[1] * p1[i] + c[2] * p2[i] + c[3] * p3[i];
+    }
+}
+
+
+// out = sums * scale, then slides the window one row: sums += add - sub
+void boxRow(float *sums, float *out, const float *add, const float *sub, int n, float scale) {
+    int i = 0;
+
+#if defined(__AVX__)
+    const __m256 s = _mm256_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m256 acc = _mm256_loadu_ps(sums + i);
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(acc, s));
+        acc = _mm256_add_ps(acc, _mm256_sub_ps(_mm256_loadu_ps(add + i), _mm256_loadu_ps(sub + i)));
+        _mm256_storeu_ps(sums + i, acc);
+    }
+#elif defined(__SSE2__)
+    const __m128 s = _mm_set1_ps(scale);
+    for (; i + 4 <= n; i += 4) {
+        __m128 acc = _mm_loadu_ps(sums + i);
+        _mm_storeu_ps(out + i, _mm_mul_ps(acc, s));
+        acc = _mm_add_ps(acc, _mm_sub_ps(_mm_loadu_ps(add + i), _mm_loadu_ps(sub + i)));
+        _mm_storeu_ps(sums + i, acc);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t acc = vld1q_f32(sums + i);
+        vst1q_f32(out + i, vmulq_n_f32(acc, scale));
+        acc = vaddq_f32(acc, vsubq_f32(vld1q_f32(add + i), vld1q_f32(sub + i)));
+        vst1q_f32(sums + i, acc);
+    }
+#endif
+
+    for (; i < n; ++i) {
+        out[i] = sums[i] * scale;
+        sums[i] += add[i] - sub[i];
+    }
+}
+
+
+// widths of kBoxPasses odd boxes whose stacked variance is closest to sigma^2
+void boxRadii(double sigma, int *radii) {
+    const int n = kBoxPasses;
+    double ideal = std::sqrt(12.0 * sigma * sigma / n + 1.0);
+    int lower = (int)std::floor(ideal);
+    if (lower % 2 == 0) {
+        lower--;
+    }
+    int upper = lower + 2;
+
+    // how many of the passes use the narrower box
+    int narrow = (int)std::lround((12.0 * sigma * sigma - n * lower * lower - 4.0 * n * lower - 3.0 * n) /
+                                  (-4.0 * lower - 4.0));
+
+    for (int i = 0; i < n; ++i) {
+        radii[i] = ((i < narrow ? lower : upper) - 1) / 2;
+    }
+}
+
+}   // namespace
+
+
+BlurEngine::BlurEngine(BlurMethod method) : method(method) {}
+
+
+void BlurEngine::setMethod(BlurMethod method) {
+    this->method = method;
+}
+
+
+BlurMethod BlurEngine::getMethod() const {
+    return method;
+}
+
+
+void BlurEngine::recursiveColumns(cv::Mat &image, double sigma) {
+    // Young & van Vliet, "Recursive implementation of the Gaussian filter", 1995
+    double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330
+                            : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+    double q2 = q * q;
+    double q3 = q2 * q;
+    double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+    double b2 = -(1.4281 * q2 + 1.26661 * q3);
+    double b3 = 0.422205 * q3;
+    const float c[4] = {(float)(1.0 - (b1 + b2 + b3) / b0), (float)(b1 / b0),
+                        (float)(b2 / b0), (float)(b3 / b0)};
+
+    int rows = image.rows;
+    int n = image.cols * image.channels();
+
+    // causal pass top to bottom, rows above the image repeat the first row
+    edge.assign(image.ptr<float>(0), image.ptr<float>(0) + n);
+    for (int y = 0; y < rows; ++y) {
+        float *row = image.ptr<float>(y);
+        const float *p1 = y >= 1 ? image.ptr<float>(y - 1) : edge.data();
+        const float *p2 = y >= 2 ? image.ptr<float>(y - 2) : edge.data();
+        const float *p3 = y >= 3 ? image.ptr<float>(y - 3) : edge.data();
+        recursiveRow(row, row, p1, p2, p3, n, c);
+    }
+
+    // anti-causal pass bottom to top over the causal result
+    edge.assign(image.ptr<float>(rows - 1), image.ptr<float>(rows - 1) + n);
+    for (int y = rows - 1; y >= 0; --y) {
+        float *row = image.ptr<float>(y);
+        const float *p1 = y + 1 < rows ? image.ptr<float>(y + 1) : edge.data();
+        const float *p2 = y + 2 < rows ? image.ptr<float>(y + 2) : edge.data();
+        const float *p3 = y + 3 < rows ? image.ptr<float>(y + 3) : edge.data();
+        recursiveRow(row, row, p1, p2, p3, n, c);
+    }
+}
+
+
+// each pass writes into spare and swaps it with image, so the two must
+// have the same shape for the buffers to be reused on the next call
+void BlurEngine::boxColumns(cv::Mat &image, cv::Mat &spare, const int *radii, int passes) {
+    int rows = image.rows;
+    int n = image.cols * image.channels();
+    spare.create(image.size(), image.type());
+    sums.resize(n);
+
+    for (int p = 0; p < passes; ++p) {
+        int r = radii[p];
+        if (r == 0) {
+            continue;
+        }
+
+        // the window of the first row, edge rows repeated past the border
+        std::fill(sums.begin(), sums.end(), 0.0f);
+        for (int k = -r; k <= r; ++k) {
+            const float *src = image.ptr<float>(std::max(0, std::min(rows - 1, k)));
+            for (int i = 0; i < n; ++i) {
+                sums[i] += src[i];
+            }
+        }
+
+        // each further row adds one row and drops one, whatever the width
+        float scale = 1.0f / (2 * r + 1);
+        for (int y = 0; y < rows; ++y) {
+            const float *add = image.ptr<float>(std::min(rows - 1, y + r + 1));
+            const float *sub = image.ptr<float>(std::max(0, y - r));
+            boxRow(sums.data(), spare.ptr<float>(y), add, sub, n, scale);
+        }
+
+        std::swap(image, spare);
+    }
+}
+
+
+void BlurEngine::blur(const cv::Mat &src, cv::Mat &dst, int ksize, double sigma) {
+    double s = sigma > 0 ? sigma : 0.3 * ((ksize - 1) * 0.5 - 1) + 0.8;
+
+    if (method == BlurMethod::GAUSSIAN || src.empty() || src.depth() != CV_8U || s < kMinSigma) {
+        cv::GaussianBlur(src, dst, cv::Size(ksize, ksize), sigma);
+        return;
+    }
+
+    src.convertTo(work, CV_MAKETYPE(CV_32F, src.channels()));
+
+    // vertical pass, then the horizontal one as a vertical pass over the
+    // transpose, so both walk rows of contiguous floats
+    if (method == BlurMethod::RECURSIVE) {
+        recursiveColumns(work, s);
+        cv::transpose(work, transposed);
+        recursiveColumns(transposed, s);
+    }
+    else {
+        int radii[kBoxPasses];
+        boxRadii(s, radii);
+        boxColumns(work, scratch, radii, kBoxPasses);
+        cv::transpose(work, transposed);
+        boxColumns(transposed, transposedScratch, radii, kBoxPasses);
+    }
+    cv::transpose(transposed, work);
+
+    work.convertTo(dst, src.type());
+}
+
+
+const char *BlurEngine::methodName(BlurMethod method) {
+    switch (method) {
+    case BlurMethod::RECURSIVE:
+        return "recursive";
+    case BlurMethod::STACKED_BOX:
+        return "stacked box";
+    default:
+        return "gaussian";
+    }
+}
@@ -50,11 +50,51 @@ void Camera:: setResolution(int width, int height) {
 }
 
 
+int Camera::getWidth() const {
+    return width;
+}
+
+
+int Camera::getHeight() const {
+    return height;
+}
+
+
 void Camera::setFPS(int fps) {
     this->fps = fps;
 }
 
 
+int Camera::getFPS() const {
+    return fps;
+}
+
+
+bool Camera::setCaptureRate(int) {
+    return false;
+}
+
+
+StreamFormat Camera::getStreamFormat() const {
+    StreamFormat format;
+    format.fps = fps;
+
+    if (!isConnected) {
+        return format;
+    }
+
+    // width/height hold the values read back from the driver on connect,
+    // a captured frame is the final word on both size and pixel format
+    format.size = cv::Size(width, height);
+    if (!currFrame.empty()) {
+        format.size = currFrame.size();
+        format.type = currFrame.type();
+    }
+
+    return format;
+}
+
+
 // auto exposure implementations //
 void Camera::enableAutoExposure(bool enable) {
     aeSettings.autoExposure = enable;
@@ -393,6 +433,18 @@ bool Camera::run3ATuning() {
 }
 
 
+void Camera::apply3ASettings() {
+    if (currFrame.empty()) {
+        return;
+    }
+
+    // keep colour consistent on frames that skip tuning
+    if (awbSettings.autoWhiteBalance) {
+        applyWhiteBalance(currFrame);
+    }
+}
+
+
 void Camera::reset3ASettings() {
     // Reset to defaults
     aeSettings.autoExposure = true;
@@ -458,3 +510,19 @@ cv::Mat Camera::convertToGray(const cv::Mat &frame) {
 
     return gray;
 }
+
+
+void Camera::readStreamFormat(cv::VideoCapture &capture) {
+    int actualWidth = (int)capture.get(cv::CAP_PROP_FRAME_WIDTH);
+    int actualHeight = (int)capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+    int actualFps = cvRound(capture.get(cv::CAP_PROP_FPS));
+
+    // backends report 0 for properties they do not know
+    if (actualWidth > 0 && actualHeight > 0) {
+        width = actualWidth;
+        height = actualHeight;
+    }
+    if (actualFps > 0) {
+        fps = actualFps;
+    }
+}
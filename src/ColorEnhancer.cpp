@@ -0,0 +1,101 @@
+#include <iostream>
+
+#include "ColorEnhancer.h"
+
+
+namespace {
+
+// BT.601 luma weights in BGR order, as cv::COLOR_BGR2GRAY
+const float kLumaWeights[3] = {0.114f, 0.587f, 0.299f};
+
+// rows per parallel stripe, below this the hand-off costs more than the rows
+const int kMinStripeRows = 16;
+
+}   // namespace
+
+
+ColorEnhancer::ColorEnhancer(double alpha, int beta, double saturation)
+    : alpha(alpha), beta(beta), saturation(std::max(0.0, saturation)), dirty(true) {}
+
+
+void ColorEnhancer::setParams(double alpha, int beta, double saturation) {
+    saturation = std::max(0.0, saturation);
+    if (alpha != this->alpha || beta != this->beta || saturation != this->saturation) {
+        this->alpha = alpha;
+        this->beta = beta;
+        this->saturation = saturation;
+        dirty = true;
+    }
+}
+
+
+bool ColorEnhancer::isIdentity() const {
+    return alpha == 1.0 && beta == 0 && saturation == 1.0;
+}
+
+
+void ColorEnhancer::rebuild() {
+    // each output channel is alpha * ((1 - s) * Y + s * in) + beta, Y being
+    // a weighted sum of all three inputs
+    colorMatrix.create(3, 4, CV_32F);
+    alphaMatrix = cv::Mat::zeros(4, 5, CV_32F);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            float m = (float)(alpha * ((1.0 - saturation) * kLumaWeights[j] + (i == j ? saturation : 0.0)));
+            colorMatrix.at<float>(i, j) = m;
+            alphaMatrix.at<float>(i, j) = m;
+        }
+        colorMatrix.at<float>(i, 3) = (float)beta;
+        alphaMatrix.at<float>(i, 4) = (float)beta;
+    }
+    alphaMatrix.at<float>(3, 3) = 1.0f;
+
+    // gray has no chroma, only contrast and brightness apply
+    grayLut.create(1, 256, CV_8U);
+    for (int v = 0; v < 256; v++) {
+        grayLut.at<uchar>(0, v) = cv::saturate_cast<uchar>(alpha * v + beta);
+    }
+
+    dirty = false;
+}
+
+
+bool ColorEnhancer::apply(const cv::Mat &src, cv::Mat &dst) {
+    if (src.empty() || src.depth() != CV_8U || src.channels() == 2 || src.channels() > 4) {
+        std::cerr << "Color enhancer needs an 8-bit gray, BGR or BGRA image" << std::endl;
+        return false;
+    }
+
+    if (isIdentity()) {
+        if (dst.data != src.data) {
+            src.copyTo(dst);
+        }
+        return true;
+    }
+
+    if (dirty) {
+        rebuild();
+    }
+
+    // a no-op when dst is src, the transform reads each pixel before writing it
+    dst.create(src.size(), src.type());
+
+    const cv::Mat &m = src.channels() == 3 ? colorMatrix : alphaMatrix;
+    int channels = src.channels();
+    cv::Mat &out = dst;
+
+    // cv::transform runs fixed-point SIMD for 8-bit 3x3 matrices, the rows
+    // are shared over OpenCV's thread pool
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range) {
+        cv::Rect rows(0, range.start, src.cols, range.end - range.start);
+        cv::Mat outRows = out(rows);
+        if (channels == 1) {
+            cv::LUT(src(rows), grayLut, outRows);
+        }
+        else {
+            cv::transform(src(rows), outRows, m);
+        }
+    }, std::max(1, src.rows / kMinStripeRows));
+
+    return true;
+}
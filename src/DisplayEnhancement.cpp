@@ -13,10 +13,15 @@ g++ display_enhancement.cpp -o display_enhancement $(pkg-config --cflags --libs
 #include "DisplayEnhancement.h"
 
 
-DisplayEnhancement::DisplayEnhancement() {}
+DisplayEnhancement::DisplayEnhancement(BlurMethod blurMethod) : blurEngine(blurMethod) {}
 
 DisplayEnhancement::~DisplayEnhancement() {}
 
+
+void DisplayEnhancement::setBlurMethod(BlurMethod method) {
+    blurEngine.setMethod(method);
+}
+
 /**
  * @brief 1. Enhances contrast using alpha (contrast) and beta (brightness).
  * This is the simplest "contrast/brightness" slider.
@@ -42,7 +47,8 @@ cv::Mat DisplayEnhancement::enhanceSharpness(const cv::Mat &src, double amount)
     cv::Mat enhanced_img;
     cv::Mat blurred;
 
-    cv::GaussianBlur(src, blurred, cv::Size(0, 0), 3);
+    // sigma 3, the recursive and box methods cost the same for any sigma
+    blurEngine.blur(src, blurred, 0, 3);
 
     // Add the "detail" (Original - Blurred) back to the original
     // This is the C++ equivalent of the formula
@@ -87,6 +93,25 @@ cv::Mat DisplayEnhancement::enhanceSaturation(const cv::Mat &src, double factor)
     return enhanced_img;
 }
 
+
+/**
+ * @brief Steps 1 and 2 fused into one pass.
+ * The saturation scales chroma around luma rather than the HSV 'S'
+ * channel, so the colours are close to enhanceSaturation but not equal.
+ */
+
+cv::Mat DisplayEnhancement::enhanceColor(const cv::Mat &src, double alpha, int beta, double saturation) {
+    cv::Mat enhanced_img;
+
+    // the matrix is only rebuilt when the parameters change
+    colorEnhancer.setParams(alpha, beta, saturation);
+    if (!colorEnhancer.apply(src, enhanced_img)) {
+        src.convertTo(enhanced_img, -1, alpha, beta);
+    }
+
+    return enhanced_img;
+}
+
 // test section //
 #if 0
     int main(int argc, char** argv) {
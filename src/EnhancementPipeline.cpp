@@ -0,0 +1,103 @@
+#include <iostream>
+#include <cmath>
+
+#include "EnhancementPipeline.h"
+
+
+namespace {
+
+// fixed-point bits of the sharpening amount
+const int kAmountShift = 8;
+
+// rows per parallel stripe, as in ColorEnhancer
+const int kMinStripeRows = 16;
+
+
+// image += amount * (luma - blurred) on every colour channel of a row,
+// alpha is left alone
+void addDetailRow(uchar *image, const uchar *luma, const uchar *blurred, int cols, int channels,
+                  int amount) {
+    const int colourChannels = std::min(channels, 3);
+    const int round = 1 << (kAmountShift - 1);
+
+    for (int x = 0; x < cols; x++) {
+        int detail = (amount * (luma[x] - blurred[x]) + round) >> kAmountShift;
+        uchar *pixel = image + x * channels;
+        for (int c = 0; c < colourChannels; c++) {
+            int v = pixel[c] + detail;
+            pixel[c] = (uchar)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+}
+
+}   // namespace
+
+
+EnhancementPipeline::EnhancementPipeline(const EnhancementSettings &settings) {
+    setSettings(settings);
+}
+
+
+void EnhancementPipeline::setSettings(const EnhancementSettings &settings) {
+    this->settings = settings;
+    this->settings.sharpness = std::max(0.0, settings.sharpness);
+    this->settings.sharpenSigma = std::max(0.5, settings.sharpenSigma);
+
+    // the colour matrix is only rebuilt if these changed
+    color.setParams(settings.contrast, settings.brightness, settings.saturation);
+}
+
+
+EnhancementSettings EnhancementPipeline::getSettings() const {
+    return settings;
+}
+
+
+void EnhancementPipeline::setBlurMethod(BlurMethod method) {
+    blur.setMethod(method);
+}
+
+
+bool EnhancementPipeline::process(cv::Mat &frame) {
+    return process(frame, frame);
+}
+
+
+bool EnhancementPipeline::process(const cv::Mat &src, cv::Mat &dst) {
+    // contrast, brightness and saturation in one pass into dst
+    if (!color.apply(src, dst)) {
+        return false;
+    }
+
+    if (settings.sharpness > 0) {
+        sharpen(dst);
+    }
+
+    return true;
+}
+
+
+void EnhancementPipeline::sharpen(cv::Mat &image) {
+    if (image.channels() == 1) {
+        image.copyTo(luma);
+    }
+    else {
+        cv::cvtColor(image, luma, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+    }
+
+    // a quarter of the pixels for the blur, the detail it removes is low
+    // frequency anyway
+    cv::Size half((luma.cols + 1) / 2, (luma.rows + 1) / 2);
+    cv::resize(luma, halfLuma, half, 0, 0, cv::INTER_AREA);
+    blur.blur(halfLuma, halfBlurred, 0, settings.sharpenSigma / 2);
+    cv::resize(halfBlurred, blurredLuma, luma.size(), 0, 0, cv::INTER_LINEAR);
+
+    int amount = (int)std::lround(settings.sharpness * (1 << kAmountShift));
+    int channels = image.channels();
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++) {
+            addDetailRow(image.ptr<uchar>(y), luma.ptr<uchar>(y), blurredLuma.ptr<uchar>(y),
+                         image.cols, channels, amount);
+        }
+    }, std::max(1, image.rows / kMinStripeRows));
+}
@@ -0,0 +1,155 @@
+#include <iostream>
+
+#include "EventRecorder.h"
+
+
+EventRecorder::EventRecorder(const std::string &camId, const std::string &outputDir,
+                             const EventRecordingSettings &settings)
+    : camId(camId), outputDir(outputDir), settings(settings),
+      preRoll(settings.preRollBudgetBytes, settings.preRollMs, settings.jpegQuality),
+      eventCount(0), lastStats(), stopping(false) {}
+
+
+EventRecorder::~EventRecorder() {
+    stop();
+}
+
+
+bool EventRecorder::startEvent(const cv::Mat &frame) {
+    // named apart from rotating segments, retention only counts those
+    std::string filename = VideoRecorder::timestampedPath(outputDir, camId + "_event");
+    StreamFormat format(frame.size(), settings.fps, frame.type());
+    std::unique_ptr<VideoRecorder> next(new VideoRecorder());
+    if (!next->startRecording(filename, format)) {
+        return false;
+    }
+
+    if (!closer.joinable()) {
+        stopping = false;
+        closer = std::thread(&EventRecorder::closerLoop, this);
+    }
+
+    double seconds = preRoll.getDurationSeconds();
+    size_t frames = preRoll.flushTo(*next);
+    recorder = std::move(next);
+    eventCount++;
+
+    std::cout << "Motion event on camera " << camId << ": " << frames
+              << " pre-roll frames (" << seconds << " s)" << std::endl;
+
+    return true;
+}
+
+
+void EventRecorder::endEvent() {
+    if (!recorder) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(closeMutex);
+        closing.push_back(std::move(recorder));
+    }
+    closeCv.notify_one();
+}
+
+
+void EventRecorder::closerLoop() {
+    std::unique_lock<std::mutex> lock(closeMutex);
+
+    // drains the queue before it honours stopping
+    while (true) {
+        closeCv.wait(lock, [this] { return stopping || !closing.empty(); });
+        if (closing.empty()) {
+            return;
+        }
+
+        std::unique_ptr<VideoRecorder> done = std::move(closing.front());
+        closing.pop_front();
+
+        lock.unlock();
+        done->stopRecording();
+        RecorderStats stats = done->getStats();
+        done.reset();
+        lock.lock();
+
+        lastStats = stats;
+    }
+}
+
+
+bool EventRecorder::processFrame(const cv::Mat &frame, bool motion) {
+    if (frame.empty()) {
+        return recorder != nullptr;
+    }
+
+    Clock::time_point now = Clock::now();
+    if (motion) {
+        lastMotion = now;
+    }
+
+    if (!recorder) {
+        if (!motion || !startEvent(frame)) {
+            preRoll.push(frame);
+            return false;
+        }
+    }
+
+    recorder->writeFrame(frame, motion, motion);
+
+    // hand the file over to be closed once the post-roll has run out
+    auto quiet = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastMotion);
+    if (quiet.count() >= settings.postRollMs) {
+        endEvent();
+        return false;
+    }
+
+    return true;
+}
+
+
+void EventRecorder::stop() {
+    endEvent();
+    preRoll.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(closeMutex);
+        stopping = true;
+    }
+    closeCv.notify_all();
+
+    if (closer.joinable()) {
+        closer.join();
+    }
+}
+
+
+bool EventRecorder::isRecording() const {
+    return recorder != nullptr;
+}
+
+
+int EventRecorder::getEventCount() const {
+    return eventCount;
+}
+
+
+size_t EventRecorder::getPreRollBytes() const {
+    return preRoll.getUsedBytes();
+}
+
+
+double EventRecorder::getPreRollSeconds() const {
+    return preRoll.getDurationSeconds();
+}
+
+
+// the current event's, or the last closed one's while idle
+RecorderStats EventRecorder::getRecorderStats() const {
+    if (recorder) {
+        return recorder->getStats();
+    }
+
+    std::lock_guard<std::mutex> lock(closeMutex);
+    return lastStats;
+}
@@ -0,0 +1,340 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "FrameIndex.h"
+
+
+namespace {
+
+const char kMagic[4] = {'S', 'V', 'I', 'X'};
+const uint32_t kVersion = 2;     // 2: entry times are steady clock offsets
+const size_t kBatchEntries = 256;
+
+// pending entries are written once they span this much, even short of a batch
+const int64_t kFlushIntervalMs = 1000;
+
+}   // namespace
+
+
+static_assert(sizeof(FrameIndexEntry) == 24, "index entry layout is part of the file format");
+static_assert(sizeof(FrameIndexHeader) == 32, "index header layout is part of the file format");
+
+
+FrameIndexWriter::FrameIndexWriter() : file(nullptr) {}
+
+
+FrameIndexWriter::~FrameIndexWriter() {
+    close();
+}
+
+
+bool FrameIndexWriter::open(const std::string &filename, double fps, const cv::Size &frameSize,
+                            uint32_t contents) {
+    close();
+
+    file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open frame index: " << filename << std::endl;
+        return false;
+    }
+
+    path = filename;
+    pending.clear();
+    pending.reserve(kBatchEntries);
+
+    // written straight away, an index is readable as soon as it exists
+    FrameIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.fpsMilli = (uint32_t)(fps * 1000.0 + 0.5);
+    header.width = frameSize.width;
+    header.height = frameSize.height;
+    header.contents = contents;
+    header.startTimeMs = FrameIndexReader::nowMs();
+    startedAt = std::chrono::steady_clock::now();
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0) {
+        std::cerr << "Failed to write frame index: " << filename << std::endl;
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+
+bool FrameIndexWriter::flush() {
+    if (!file) {
+        return false;
+    }
+
+    if (!pending.empty() &&
+        fwrite(pending.data(), sizeof(FrameIndexEntry), pending.size(), file) != pending.size()) {
+        std::cerr << "Failed to write frame index: " << path << std::endl;
+        return false;
+    }
+    pending.clear();
+
+    return fflush(file) == 0;
+}
+
+
+bool FrameIndexWriter::append(const FrameIndexEntry &entry) {
+    if (!file) {
+        return false;
+    }
+
+    // a full batch, or a second of frames at a low frame rate
+    pending.push_back(entry);
+    if (pending.size() >= kBatchEntries ||
+        entry.elapsedMs - pending.front().elapsedMs >= kFlushIntervalMs) {
+        return flush();
+    }
+
+    return true;
+}
+
+
+bool FrameIndexWriter::close() {
+    if (!file) {
+        return true;
+    }
+
+    bool ok = flush();
+    fclose(file);
+    file = nullptr;
+
+    return ok;
+}
+
+
+bool FrameIndexWriter::isOpen() const {
+    return file != nullptr;
+}
+
+
+int64_t FrameIndexWriter::elapsedMs(std::chrono::steady_clock::time_point when) const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(when - startedAt).count();
+}
+
+
+FrameIndexReader::FrameIndexReader()
+    : fd(-1), mapping(nullptr), mappingSize(0), header(nullptr), entries(nullptr), count(0) {}
+
+
+FrameIndexReader::~FrameIndexReader() {
+    close();
+}
+
+
+bool FrameIndexReader::open(const std::string &filename) {
+    close();
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open frame index: " << filename << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(FrameIndexHeader)) {
+        std::cerr << "Frame index is empty or unreadable: " << filename << std::endl;
+        close();
+        return false;
+    }
+
+    mappingSize = info.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        std::cerr << "Failed to map frame index: " << filename << std::endl;
+        close();
+        return false;
+    }
+
+    header = static_cast<const FrameIndexHeader *>(mapping);
+    if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion) {
+        std::cerr << "Not a frame index: " << filename << std::endl;
+        close();
+        return false;
+    }
+
+    // a partial trailing entry from an interrupted write is ignored
+    entries = reinterpret_cast<const FrameIndexEntry *>(
+        static_cast<const char *>(mapping) + sizeof(FrameIndexHeader));
+    count = (mappingSize - sizeof(FrameIndexHeader)) / sizeof(FrameIndexEntry);
+
+    // one pass collects the motion runs nextMotion searches
+    motionRuns.clear();
+    for (size_t i = 0; i < count; i++) {
+        if (!(entries[i].flags & FRAME_MOTION)) {
+            continue;
+        }
+        if (!motionRuns.empty() && motionRuns.back().last + 1 == i) {
+            motionRuns.back().last = i;
+        }
+        else {
+            MotionRun run;
+            run.first = i;
+            run.last = i;
+            motionRuns.push_back(run);
+        }
+    }
+
+    return true;
+}
+
+
+void FrameIndexReader::close() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+        mapping = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+
+    mappingSize = 0;
+    header = nullptr;
+    entries = nullptr;
+    count = 0;
+    motionRuns.clear();
+}
+
+
+size_t FrameIndexReader::lowerBound(int64_t timestampMs) const {
+    int64_t elapsed = timestampMs - getStartTime();
+    size_t lo = 0;
+    size_t hi = count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].elapsedMs < elapsed) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+
+bool FrameIndexReader::seekToTime(int64_t timestampMs, FrameIndexEntry &entry) const {
+    if (count == 0) {
+        return false;
+    }
+
+    // last frame at or before the time
+    size_t i = lowerBound(timestampMs);
+    if (i == count || timeOf(entries[i]) > timestampMs) {
+        if (i == 0) {
+            return false;
+        }
+        i--;
+    }
+
+    // back up to a keyframe when the index knows about them
+    if (hasKeyframes()) {
+        size_t k = i;
+        while (k > 0 && !(entries[k].flags & FRAME_KEYFRAME)) {
+            k--;
+        }
+        if (entries[k].flags & FRAME_KEYFRAME) {
+            i = k;
+        }
+    }
+
+    entry = entries[i];
+    return true;
+}
+
+
+bool FrameIndexReader::nextMotion(int64_t timestampMs, FrameIndexEntry &entry) const {
+    size_t i = lowerBound(timestampMs);
+
+    // first run that ends at or after i, i may fall inside it
+    size_t lo = 0;
+    size_t hi = motionRuns.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (motionRuns[mid].last < i) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    if (lo == motionRuns.size()) {
+        return false;
+    }
+
+    entry = entries[std::max(i, motionRuns[lo].first)];
+    return true;
+}
+
+
+size_t FrameIndexReader::size() const {
+    return count;
+}
+
+
+const FrameIndexEntry &FrameIndexReader::at(size_t i) const {
+    return entries[i];
+}
+
+
+int64_t FrameIndexReader::timeOf(const FrameIndexEntry &entry) const {
+    return getStartTime() + entry.elapsedMs;
+}
+
+
+int64_t FrameIndexReader::getStartTime() const {
+    return header ? header->startTimeMs : 0;
+}
+
+
+int64_t FrameIndexReader::getEndTime() const {
+    return count > 0 ? timeOf(entries[count - 1]) : getStartTime();
+}
+
+
+double FrameIndexReader::getFps() const {
+    return header ? header->fpsMilli / 1000.0 : 0.0;
+}
+
+
+cv::Size FrameIndexReader::getFrameSize() const {
+    return header ? cv::Size(header->width, header->height) : cv::Size(0, 0);
+}
+
+
+bool FrameIndexReader::hasOffsets() const {
+    return header && (header->contents & INDEX_HAS_OFFSETS);
+}
+
+
+bool FrameIndexReader::hasKeyframes() const {
+    return header && (header->contents & INDEX_HAS_KEYFRAMES);
+}
+
+
+std::string FrameIndexReader::indexPathFor(const std::string &recording) {
+    return recording + ".idx";
+}
+
+
+int64_t FrameIndexReader::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -13,7 +13,7 @@ IPCamera::~IPCamera() {
 }
 
 
-std::string IPCamera::buildStreamUrl() {
+std::string IPCamera::buildStreamUrl() const {
     if (!streamUrl.empty()) {
         return streamUrl;
     }
@@ -45,6 +45,9 @@ bool IPCamera::connect() {
     capture.set(cv::CAP_PROP_FRAME_WIDTH, width);
     capture.set(cv::CAP_PROP_FRAME_HEIGHT, height);
 
+    // the stream's own resolution and rate win over the configured ones
+    readStreamFormat(capture);
+
     isConnected = true;
     std::cout << "IP cam " << name << " connected" << std::endl;
 
@@ -90,6 +93,11 @@ void IPCamera::setStreamUrl(const std::string &url) {
 }
 
 
+std::string IPCamera::getStreamUrl() const {
+    return buildStreamUrl();
+}
+
+
 std::string IPCamera::getIPAddress() const {
     return ipAddress;
 }
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include <iostream>
+#include <cstdio>
+#include <csetjmp>
+#include <new>
+#include <jpeglib.h>
+#include <jerror.h>
+
+#include "JpegEncoder.h"
+
+
+namespace {
+
+// libjpeg reports fatal errors through error_exit, which would exit() by default
+struct JpegErrorManager {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+
+void jpegErrorExit(j_common_ptr cinfo) {
+    JpegErrorManager *err = reinterpret_cast<JpegErrorManager *>(cinfo->err);
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    std::cerr << "JPEG encode failed: " << message << std::endl;
+    longjmp(err->jump, 1);
+}
+
+
+// smallest output buffer, a thumbnail fits without growing it
+const size_t kMinOutputBytes = 64 * 1024;
+
+
+// compresses into a vector we own instead of jpeg_mem_dest's buffer, whose
+// allocated size libjpeg never reports. the vector keeps its real size, so
+// reusing it never writes past what was allocated
+struct VectorDestination {
+    struct jpeg_destination_mgr pub;
+    std::vector<unsigned char> *output;
+};
+
+
+void initDestination(j_compress_ptr cinfo) {
+    VectorDestination *dest = reinterpret_cast<VectorDestination *>(cinfo->dest);
+    if (dest->output->size() < kMinOutputBytes) {
+        dest->output->resize(kMinOutputBytes);
+    }
+    dest->pub.next_output_byte = dest->output->data();
+    dest->pub.free_in_buffer = dest->output->size();
+}
+
+
+// called with the whole buffer full, doubles it
+boolean emptyOutputBuffer(j_compress_ptr cinfo) {
+    VectorDestination *dest = reinterpret_cast<VectorDestination *>(cinfo->dest);
+    size_t used = dest->output->size();
+    bool grown = true;
+    try {
+        dest->output->resize(used * 2);
+    }
+    catch (const std::bad_alloc &) {
+        grown = false;
+    }
+    // longjmps, so not from inside the handler
+    if (!grown) {
+        ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+    }
+    dest->pub.next_output_byte = dest->output->data() + used;
+    dest->pub.free_in_buffer = dest->output->size() - used;
+    return TRUE;
+}
+
+
+void termDestination(j_compress_ptr) {}
+
+}   // namespace
+
+
+struct JpegEncoder::Handle {
+    struct jpeg_compress_struct cinfo;
+    JpegErrorManager jerr;
+    VectorDestination dest;
+
+    explicit Handle(std::vector<unsigned char> *output) {
+        cinfo.err = jpeg_std_error(&jerr.pub);
+        jerr.pub.error_exit = jpegErrorExit;
+        jpeg_create_compress(&cinfo);
+
+        dest.pub.init_destination = initDestination;
+        dest.pub.empty_output_buffer = emptyOutputBuffer;
+        dest.pub.term_destination = termDestination;
+        dest.output = output;
+        cinfo.dest = &dest.pub;
+    }
+
+    ~Handle() {
+        jpeg_destroy_compress(&cinfo);
+    }
+};
+
+
+JpegEncoder::JpegEncoder()
+    : handle(new Handle(&output)), encodedSize(0) {}
+
+
+JpegEncoder::~JpegEncoder() {}
+
+
+bool JpegEncoder::encode(const cv::Mat &frame, int quality) {
+    encodedSize = 0;
+
+    if (frame.empty() || frame.depth() != CV_8U ||
+        (frame.channels() != 1 && frame.channels() != 3 && frame.channels() != 4)) {
+        std::cerr << "JPEG encoder takes 8-bit gray, BGR or BGRA frames" << std::endl;
+        return false;
+    }
+
+    struct jpeg_compress_struct &cinfo = handle->cinfo;
+
+    if (setjmp(handle->jerr.jump)) {
+        // resets the compressor so the next frame can use it again
+        jpeg_abort_compress(&cinfo);
+        return false;
+    }
+
+    cinfo.image_width = frame.cols;
+    cinfo.image_height = frame.rows;
+    cinfo.input_components = frame.channels();
+
+    const cv::Mat *source = &frame;
+    if (frame.channels() == 1) {
+        cinfo.in_color_space = JCS_GRAYSCALE;
+    }
+    else {
+#ifdef JCS_EXTENSIONS
+        cinfo.in_color_space = frame.channels() == 4 ? JCS_EXT_BGRX : JCS_EXT_BGR;
+#else
+        // plain libjpeg only takes RGB
+        cv::cvtColor(frame, rgbScratch, frame.channels() == 4 ? cv::COLOR_BGRA2RGB : cv::COLOR_BGR2RGB);
+        source = &rgbScratch;
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_RGB;
+#endif
+    }
+
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, std::max(1, std::min(100, quality)), TRUE);
+    cinfo.dct_method = JDCT_IFAST;
+
+    rows.resize(frame.rows);
+    for (int y = 0; y < frame.rows; y++) {
+        rows[y] = const_cast<unsigned char *>(source->ptr<unsigned char>(y));
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        jpeg_write_scanlines(&cinfo, &rows[cinfo.next_scanline],
+                             cinfo.image_height - cinfo.next_scanline);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    // the output keeps whatever size the largest frame needed
+    encodedSize = output.size() - handle->dest.pub.free_in_buffer;
+
+    return true;
+}
+
+
+const unsigned char *JpegEncoder::data() const {
+    return output.data();
+}
+
+
+unsigned long JpegEncoder::size() const {
+    return encodedSize;
+}
@@ -0,0 +1,644 @@
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "LiveViewServer.h"
+#include "JpegEncoder.h"
+
+
+namespace {
+
+const char *kBoundary = "frame";
+
+// longest request header accepted, live view clients send a few lines
+const size_t kMaxRequestBytes = 8192;
+
+// a client that has not sent its whole request by then is dropped, so idle
+// connections cannot hold the client slots
+const int64_t kRequestTimeoutMs = 5000;
+
+
+int64_t steadyMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+
+// width=<pixels> from the query string, 0 when absent
+int queryWidth(const std::string &query) {
+    size_t pos = query.find("width=");
+    if (pos == std::string::npos || (pos > 0 && query[pos - 1] != '&')) {
+        return 0;
+    }
+
+    int width = atoi(query.c_str() + pos + 6);
+    return width > 0 ? std::max(16, std::min(7680, width)) : 0;
+}
+
+
+// camera ids are free text, the index page must not take them as markup
+std::string htmlEscape(const std::string &text) {
+    std::string escaped;
+    for (char c : text) {
+        switch (c) {
+        case '&':  escaped += "&amp;"; break;
+        case '<':  escaped += "&lt;"; break;
+        case '>':  escaped += "&gt;"; break;
+        case '"':  escaped += "&quot;"; break;
+        case '\'': escaped += "&#39;"; break;
+        default:   escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+
+// for the links to camera streams, everything but unreserved characters as %XX
+std::string urlEncode(const std::string &text) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string encoded;
+    for (unsigned char c : text) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += (char)c;
+        }
+        else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 15];
+        }
+    }
+    return encoded;
+}
+
+
+// %XX sequences in a request path, malformed ones are kept as they are
+std::string urlDecode(const std::string &text) {
+    std::string decoded;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '%' && i + 2 < text.size() && isxdigit((unsigned char)text[i + 1]) &&
+            isxdigit((unsigned char)text[i + 2])) {
+            decoded += (char)strtol(text.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        }
+        else {
+            decoded += text[i];
+        }
+    }
+    return decoded;
+}
+
+}   // namespace
+
+
+LiveViewServer::LiveViewServer(MosaicCompositor &source, const LiveViewSettings &settings)
+    : source(source), settings(settings), listenFd(-1), running(false) {
+
+    this->settings.jpegQuality = std::max(1, std::min(100, settings.jpegQuality));
+    this->settings.maxFps = std::max(1, settings.maxFps);
+    this->settings.encoderThreads = std::max(1, settings.encoderThreads);
+    this->settings.maxClients = std::max(1, settings.maxClients);
+
+    wakeFds[0] = -1;
+    wakeFds[1] = -1;
+
+    stats.clients = 0;
+    stats.streams = 0;
+    stats.connections = 0;
+    stats.framesEncoded = 0;
+    stats.framesSent = 0;
+    stats.framesSkipped = 0;
+    stats.bytesSent = 0;
+}
+
+
+LiveViewServer::~LiveViewServer() {
+    stop();
+}
+
+
+bool LiveViewServer::start() {
+    if (running) {
+        return true;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)settings.port);
+    if (inet_pton(AF_INET, settings.bindAddress.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "Live view: bad bind address " << settings.bindAddress << std::endl;
+        return false;
+    }
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "Live view: socket failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd, 16) != 0 ||
+        !setNonBlocking(listenFd) || pipe(wakeFds) != 0) {
+        std::cerr << "Live view: cannot listen on " << settings.bindAddress << ":" << settings.port
+                  << ": " << strerror(errno) << std::endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    setNonBlocking(wakeFds[0]);
+    setNonBlocking(wakeFds[1]);
+
+    running = true;
+    serverThread = std::thread(&LiveViewServer::serverLoop, this);
+    for (int i = 0; i < settings.encoderThreads; i++) {
+        encoders.push_back(std::thread(&LiveViewServer::encoderLoop, this));
+    }
+
+    std::cout << "Live view on http://" << settings.bindAddress << ":" << settings.port << "/" << std::endl;
+
+    return true;
+}
+
+
+void LiveViewServer::stop() {
+    if (!running) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    encodeCv.notify_all();
+    wake();
+
+    serverThread.join();
+    for (auto &encoder : encoders) {
+        encoder.join();
+    }
+    encoders.clear();
+
+    while (!clients.empty()) {
+        closeClient(clients.size() - 1);
+    }
+    streams.clear();
+    encodeQueue.clear();
+
+    close(listenFd);
+    close(wakeFds[0]);
+    close(wakeFds[1]);
+    listenFd = -1;
+    wakeFds[0] = -1;
+    wakeFds[1] = -1;
+}
+
+
+bool LiveViewServer::isRunning() const {
+    return running;
+}
+
+
+void LiveViewServer::wake() {
+    if (wakeFds[1] >= 0) {
+        char byte = 1;
+        // a full pipe already has a wake-up pending
+        ssize_t ignored = write(wakeFds[1], &byte, 1);
+        (void)ignored;
+    }
+}
+
+
+void LiveViewServer::serverLoop() {
+    // half a frame period, so new encodes are picked up promptly
+    int tickMs = std::max(1, 1000 / settings.maxFps / 2);
+    std::vector<pollfd> fds;
+
+    while (running) {
+        fds.clear();
+        fds.push_back(pollfd{listenFd, POLLIN, 0});
+        fds.push_back(pollfd{wakeFds[0], POLLIN, 0});
+        for (const auto &client : clients) {
+            bool pending = client->sent < client->head.size() + (client->body ? client->body->size() : 0) +
+                                          client->tail.size();
+            fds.push_back(pollfd{client->fd, (short)(POLLIN | (pending ? POLLOUT : 0)), 0});
+        }
+
+        if (poll(fds.data(), fds.size(), tickMs) < 0 && errno != EINTR) {
+            std::cerr << "Live view: poll failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(wakeFds[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+
+        // backwards, closing a client removes it from the vector
+        for (size_t i = fds.size() - 1; i >= 2; i--) {
+            size_t index = i - 2;
+            Client &client = *clients[index];
+            short revents = fds[i].revents;
+
+            bool keep = true;
+            if (revents & (POLLERR | POLLNVAL)) {
+                keep = false;
+            }
+            else if (revents & (POLLIN | POLLHUP)) {
+                if (!client.streaming && !client.closeWhenSent) {
+                    keep = readRequest(client);
+                }
+                else {
+                    // an answered client has nothing more to say, data is dropped, EOF means it is gone
+                    char discard[256];
+                    ssize_t n = recv(client.fd, discard, sizeof(discard), MSG_DONTWAIT);
+                    keep = n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+                }
+            }
+
+            if (keep && (revents & POLLOUT)) {
+                keep = sendPending(client);
+            }
+
+            if (!keep) {
+                closeClient(index);
+            }
+        }
+
+        // clients still sending their request once it is overdue
+        int64_t nowMs = steadyMs();
+        for (size_t i = clients.size(); i-- > 0;) {
+            const Client &client = *clients[i];
+            if (!client.streaming && !client.closeWhenSent && nowMs - client.acceptedMs > kRequestTimeoutMs) {
+                closeClient(i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            acceptClients();
+        }
+
+        scheduleEncodes(nowMs);
+        takeFrames();
+    }
+}
+
+
+void LiveViewServer::acceptClients() {
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+
+        if ((int)clients.size() >= settings.maxClients || !setNonBlocking(fd)) {
+            const char busy[] = "HTTP/1.0 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+            ssize_t ignored = send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+            (void)ignored;
+            close(fd);
+            continue;
+        }
+
+        std::unique_ptr<Client> client(new Client());
+        client->fd = fd;
+        client->streaming = false;
+        client->closeWhenSent = false;
+        client->sent = 0;
+        client->sentSeq = 0;
+        client->acceptedMs = steadyMs();
+        clients.push_back(std::move(client));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.connections++;
+        stats.clients = (int)clients.size();
+    }
+}
+
+
+bool LiveViewServer::readRequest(Client &client) {
+    char buffer[2048];
+    bool closed = false;
+    while (true) {
+        ssize_t n = recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0) {
+            client.request.append(buffer, n);
+            if (client.request.size() > kMaxRequestBytes) {
+                return false;
+            }
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // a client may shut down its side right after the request
+        closed = true;
+        break;
+    }
+
+    // wait for the whole header, the request has no body
+    if (client.request.find("\r\n\r\n") == std::string::npos) {
+        return !closed;
+    }
+
+    handleRequest(client);
+    return sendPending(client);
+}
+
+
+void LiveViewServer::handleRequest(Client &client) {
+    std::string line = client.request.substr(0, client.request.find("\r\n"));
+    client.request.clear();
+
+    size_t space1 = line.find(' ');
+    size_t space2 = line.find(' ', space1 + 1);
+    if (space1 == std::string::npos || space2 == std::string::npos || line.compare(0, space1, "GET") != 0) {
+        respond(client, "405 Method Not Allowed", "text/plain", "only GET is supported\n");
+        return;
+    }
+
+    std::string target = line.substr(space1 + 1, space2 - space1 - 1);
+    size_t mark = target.find('?');
+    std::string path = urlDecode(target.substr(0, mark));
+    std::string query = mark == std::string::npos ? "" : target.substr(mark + 1);
+
+    std::vector<std::string> cameras = source.getCameraIds();
+
+    if (path == "/") {
+        std::string body = "<html><body><h3>Live view</h3><ul><li><a href=\"/mosaic\">all cameras</a></li>";
+        for (const auto &id : cameras) {
+            body += "<li><a href=\"/camera/" + urlEncode(id) + "\">" + htmlEscape(id) + "</a></li>";
+        }
+        body += "</ul></body></html>\n";
+        respond(client, "200 OK", "text/html", body);
+    }
+    else if (path == "/mosaic") {
+        startStream(client, "", queryWidth(query));
+    }
+    else if (path.compare(0, 8, "/camera/") == 0 &&
+             std::find(cameras.begin(), cameras.end(), path.substr(8)) != cameras.end()) {
+        startStream(client, path.substr(8), queryWidth(query));
+    }
+    else {
+        respond(client, "404 Not Found", "text/plain", "no such stream\n");
+    }
+}
+
+
+void LiveViewServer::respond(Client &client, const std::string &status, const std::string &type,
+                             const std::string &body) {
+    client.head = "HTTP/1.0 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " +
+                  std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    client.body.reset();
+    client.tail.clear();
+    client.sent = 0;
+    client.closeWhenSent = true;
+}
+
+
+void LiveViewServer::startStream(Client &client, const std::string &camId, int width) {
+    std::string key = (camId.empty() ? std::string("/mosaic") : "/camera/" + camId) + "@" + std::to_string(width);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<Stream> &stream = streams[key];
+        if (!stream) {
+            stream.reset(new Stream());
+            stream->key = key;
+            stream->camId = camId;
+            stream->width = width;
+            stream->viewers = 0;
+            stream->queued = false;
+            stream->sourceSeq = 0;
+            stream->lastEncodeMs = 0;
+            stream->jpegSeq = 0;
+        }
+        stream->viewers++;
+        stats.streams = (int)streams.size();
+    }
+
+    client.streamKey = key;
+    client.streaming = true;
+    client.head = std::string("HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=") +
+                  kBoundary + "\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n";
+    client.body.reset();
+    client.tail.clear();
+    client.sent = 0;
+    client.sentSeq = 0;
+}
+
+
+void LiveViewServer::scheduleEncodes(int64_t nowMs) {
+    int periodMs = 1000 / settings.maxFps;
+
+    // only streams someone is watching, the encoder skips frames it has seen
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &item : streams) {
+        Stream &stream = *item.second;
+        if (stream.viewers > 0 && !stream.queued && nowMs - stream.lastEncodeMs >= periodMs) {
+            stream.queued = true;
+            stream.lastEncodeMs = nowMs;
+            encodeQueue.push_back(&stream);
+            encodeCv.notify_one();
+        }
+    }
+}
+
+
+void LiveViewServer::encoderLoop() {
+    JpegEncoder encoder;
+    cv::Mat mosaicCopy;
+    cv::Mat scaled;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        encodeCv.wait(lock, [this] { return !running || !encodeQueue.empty(); });
+        if (!running) {
+            return;
+        }
+
+        // the stream is not erased while queued is set
+        Stream *stream = encodeQueue.front();
+        encodeQueue.pop_front();
+        std::string camId = stream->camId;
+        int width = stream->width;
+        uint64_t knownSeq = stream->sourceSeq;
+        lock.unlock();
+
+        cv::Mat frame;
+        uint64_t seq = knownSeq;
+        if (camId.empty()) {
+            seq = source.renderCopy(mosaicCopy, knownSeq);
+            frame = mosaicCopy;
+        }
+        else {
+            source.getLatestFrame(camId, frame, &seq);
+        }
+
+        std::shared_ptr<std::vector<uchar>> jpeg;
+        if (!frame.empty() && seq != knownSeq) {
+            if (width > 0 && width < frame.cols) {
+                int height = std::max(1, (int)((int64_t)frame.rows * width / frame.cols));
+                cv::resize(frame, scaled, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+                frame = scaled;
+            }
+
+            if (encoder.encode(frame, settings.jpegQuality)) {
+                jpeg = std::make_shared<std::vector<uchar>>(encoder.data(), encoder.data() + encoder.size());
+            }
+        }
+
+        lock.lock();
+        stream->queued = false;
+        if (jpeg) {
+            stream->jpeg = jpeg;
+            stream->jpegSeq++;
+            stream->sourceSeq = seq;
+            stats.framesEncoded++;
+        }
+
+        if (stream->viewers == 0) {
+            streams.erase(stream->key);
+            stats.streams = (int)streams.size();
+        }
+        else if (jpeg) {
+            wake();
+        }
+    }
+}
+
+
+void LiveViewServer::takeFrames() {
+    for (size_t i = clients.size(); i-- > 0;) {
+        Client &client = *clients[i];
+        size_t total = client.head.size() + (client.body ? client.body->size() : 0) + client.tail.size();
+        if (!client.streaming || client.sent < total) {
+            continue;
+        }
+
+        // a client that is still busy with a frame never gets a queue, once
+        // it is free it takes the newest encode and skips the ones between
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = streams.find(client.streamKey);
+            if (it == streams.end() || !it->second->jpeg || it->second->jpegSeq == client.sentSeq) {
+                continue;
+            }
+
+            const Stream &stream = *it->second;
+            if (client.sentSeq > 0 && stream.jpegSeq > client.sentSeq + 1) {
+                stats.framesSkipped += stream.jpegSeq - client.sentSeq - 1;
+            }
+            client.body = stream.jpeg;
+            client.sentSeq = stream.jpegSeq;
+        }
+
+        client.head = std::string("--") + kBoundary + "\r\nContent-Type: image/jpeg\r\nContent-Length: " +
+                      std::to_string(client.body->size()) + "\r\n\r\n";
+        client.tail = "\r\n";
+        client.sent = 0;
+
+        if (!sendPending(client)) {
+            closeClient(i);
+        }
+    }
+}
+
+
+bool LiveViewServer::sendPending(Client &client) {
+    size_t bodySize = client.body ? client.body->size() : 0;
+    size_t total = client.head.size() + bodySize + client.tail.size();
+
+    while (client.sent < total) {
+        // what is left of head, body and tail, in one call
+        iovec parts[3];
+        int count = 0;
+        size_t offset = client.sent;
+        const char *bases[3] = {client.head.data(), client.body ? (const char *)client.body->data() : nullptr,
+                                client.tail.data()};
+        size_t sizes[3] = {client.head.size(), bodySize, client.tail.size()};
+        for (int p = 0; p < 3; p++) {
+            if (offset >= sizes[p]) {
+                offset -= sizes[p];
+                continue;
+            }
+            parts[count].iov_base = (void *)(bases[p] + offset);
+            parts[count].iov_len = sizes[p] - offset;
+            count++;
+            offset = 0;
+        }
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = parts;
+        message.msg_iovlen = count;
+
+        ssize_t n = sendmsg(client.fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // the socket buffer is full, poll says when it drains
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        client.sent += n;
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.bytesSent += n;
+    }
+
+    if (client.body) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.framesSent++;
+    }
+
+    return !client.closeWhenSent;
+}
+
+
+void LiveViewServer::closeClient(size_t index) {
+    Client &client = *clients[index];
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (client.streaming) {
+            auto it = streams.find(client.streamKey);
+            if (it != streams.end() && --it->second->viewers == 0 && !it->second->queued) {
+                streams.erase(it);
+            }
+            stats.streams = (int)streams.size();
+        }
+        stats.clients = (int)clients.size() - 1;
+    }
+
+    close(client.fd);
+    clients.erase(clients.begin() + index);
+}
+
+
+LiveViewStats LiveViewServer::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
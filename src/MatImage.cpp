@@ -0,0 +1,108 @@
+#include <iostream>
+#include <cstring>
+
+#include "MatImage.h"
+
+
+cv::Mat matView(const ImageBuffer &image) {
+    if (!image.data[0]) {
+        return cv::Mat();
+    }
+
+    // planar chroma follows luma, as rows of the same width for NV12 and
+    // as half-width rows, two per Mat row, for I420. padded I420 rows would
+    // put the second chroma row at stride/2 instead of width/2
+    if (image.format == PIXEL_FORMAT_I420 && image.stride[0] != (size_t)image.width) {
+        std::cerr << "I420 image view needs unpadded rows" << std::endl;
+        return cv::Mat();
+    }
+    if (pixelFormatIsPlanar(image.format)) {
+        return cv::Mat(image.height * 3 / 2, image.width, CV_8UC1, image.data[0], image.stride[0]);
+    }
+
+    return cv::Mat(image.height, image.width, CV_8UC(pixelFormatBytes(image.format)),
+                   image.data[0], image.stride[0]);
+}
+
+
+bool imageView(const cv::Mat &mat, PixelFormat format, ImageBuffer &image) {
+    if (mat.empty() || mat.depth() != CV_8U) {
+        std::cerr << "Image view needs an 8-bit Mat" << std::endl;
+        return false;
+    }
+
+    int width = mat.cols;
+    int height = mat.rows;
+    if (pixelFormatIsPlanar(format)) {
+        // the chroma rows have to follow on in the same allocation
+        if (mat.channels() != 1 || mat.rows % 3 != 0 || !mat.isContinuous()) {
+            std::cerr << "Planar image view needs a continuous height*3/2 Mat" << std::endl;
+            return false;
+        }
+        height = mat.rows * 2 / 3;
+    }
+    else if (mat.channels() != pixelFormatBytes(format)) {
+        std::cerr << "Mat channels do not match the pixel format" << std::endl;
+        return false;
+    }
+
+    return imageBufferWrap(&image, mat.data, width, height, format, mat.step) == 0;
+}
+
+
+PixelFormat pixelFormatFor(const cv::Mat &mat) {
+    switch (mat.channels()) {
+    case 2:
+        return PIXEL_FORMAT_YUYV;
+    case 3:
+        return PIXEL_FORMAT_BGR24;
+    case 4:
+        return PIXEL_FORMAT_BGRA32;
+    default:
+        return PIXEL_FORMAT_GRAY8;
+    }
+}
+
+
+OwnedImage::OwnedImage() {
+    std::memset(&buffer, 0, sizeof(buffer));
+}
+
+
+OwnedImage::OwnedImage(ImagePool *pool) : OwnedImage() {
+    if (imagePoolAcquire(pool, &buffer) != 0) {
+        std::memset(&buffer, 0, sizeof(buffer));
+    }
+}
+
+
+OwnedImage::OwnedImage(int width, int height, PixelFormat format) : OwnedImage() {
+    if (imageBufferAlloc(&buffer, width, height, format) != 0) {
+        std::memset(&buffer, 0, sizeof(buffer));
+    }
+}
+
+
+OwnedImage::~OwnedImage() {
+    reset();
+}
+
+
+OwnedImage::OwnedImage(OwnedImage &&other) : buffer(other.buffer) {
+    std::memset(&other.buffer, 0, sizeof(other.buffer));
+}
+
+
+OwnedImage &OwnedImage::operator=(OwnedImage &&other) {
+    if (this != &other) {
+        reset();
+        buffer = other.buffer;
+        std::memset(&other.buffer, 0, sizeof(other.buffer));
+    }
+    return *this;
+}
+
+
+void OwnedImage::reset() {
+    imageBufferRelease(&buffer);
+}
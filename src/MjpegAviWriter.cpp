@@ -0,0 +1,402 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "MjpegAviWriter.h"
+
+
+namespace {
+
+const size_t kAlignment = 4096;             // O_DIRECT needs sector/page aligned I/O
+const size_t kHeaderSize = 224;             // RIFF + hdrl + LIST movi, fixed layout
+const uint64_t kMaxFileBytes = 0x7FFFFFFF;  // AVI 1.0 offsets, stay below 2 GiB
+const uint32_t kKeyframeFlag = 0x10;        // AVIIF_KEYFRAME, every MJPEG frame is one
+const uint32_t kHasIndexFlag = 0x10;        // AVIF_HASINDEX
+
+
+void put32(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(value & 0xff);
+    out.push_back((value >> 8) & 0xff);
+    out.push_back((value >> 16) & 0xff);
+    out.push_back((value >> 24) & 0xff);
+}
+
+
+void put16(std::vector<uint8_t> &out, uint16_t value) {
+    out.push_back(value & 0xff);
+    out.push_back((value >> 8) & 0xff);
+}
+
+
+void putFourcc(std::vector<uint8_t> &out, const char *fourcc) {
+    out.insert(out.end(), fourcc, fourcc + 4);
+}
+
+}   // namespace
+
+
+MjpegAviWriter::MjpegAviWriter()
+    : fd(-1), directIO(false), frameSize(0, 0), fps(30.0), block(nullptr), blockFill(0),
+      fileOffset(0), unsyncedBytes(0), moviBytes(0), maxChunkSize(0), lastFrameOffset(0) {
+
+    stats.frames = 0;
+    stats.bytesWritten = 0;
+    stats.writeCalls = 0;
+    stats.syncCalls = 0;
+}
+
+
+MjpegAviWriter::~MjpegAviWriter() {
+    close();
+    freeBuffers();
+}
+
+
+void MjpegAviWriter::freeBuffers() {
+    free(block);
+    block = nullptr;
+}
+
+
+void MjpegAviWriter::setSettings(const MjpegWriterSettings &settings) {
+    if (isOpened()) {
+        std::cerr << "MJPEG writer settings must be set before open()" << std::endl;
+        return;
+    }
+
+    this->settings = settings;
+    this->settings.jpegQuality = std::max(1, std::min(100, settings.jpegQuality));
+    this->settings.blockSize = std::max(kAlignment,
+                                        (settings.blockSize + kAlignment - 1) / kAlignment * kAlignment);
+
+    // the block buffer is sized on the next open
+    free(block);
+    block = nullptr;
+}
+
+
+bool MjpegAviWriter::open(const std::string &filename, double fps, const cv::Size &frameSize) {
+    if (isOpened()) {
+        close();
+    }
+
+    if (frameSize.width <= 0 || frameSize.height <= 0) {
+        std::cerr << "Invalid MJPEG frame size" << std::endl;
+        return false;
+    }
+
+    if (!block && posix_memalign(reinterpret_cast<void **>(&block), kAlignment, settings.blockSize) != 0) {
+        block = nullptr;
+        std::cerr << "Failed to allocate MJPEG write buffer" << std::endl;
+        return false;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    directIO = false;
+#ifdef O_DIRECT
+    if (settings.directIO) {
+        fd = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+        directIO = fd >= 0;
+    }
+#endif
+    if (fd < 0) {
+        // not every filesystem takes O_DIRECT (tmpfs, some FUSE), fall back
+        fd = ::open(filename.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        std::cerr << "Failed to open MJPEG file: " << filename << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+
+    path = filename;
+    this->fps = fps > 0 ? fps : 30.0;
+    this->frameSize = frameSize;
+    blockFill = 0;
+    fileOffset = 0;
+    unsyncedBytes = 0;
+    index.clear();
+    moviBytes = 0;
+    maxChunkSize = 0;
+
+    // placeholder header, rewritten with the final counts on close
+    std::vector<uint8_t> header;
+    buildHeader(header);
+    return append(header.data(), header.size());
+}
+
+
+void MjpegAviWriter::buildHeader(std::vector<uint8_t> &out) const {
+    uint32_t frames = index.size();
+    uint32_t indexBytes = 8 + frames * 16;
+    uint32_t fileBytes = kHeaderSize + moviBytes + (frames > 0 ? indexBytes : 0);
+    uint32_t microSecPerFrame = (uint32_t)(1000000.0 / fps + 0.5);
+    uint32_t rateScale = 1000;
+    uint32_t rate = (uint32_t)(fps * rateScale + 0.5);
+    uint32_t maxBytesPerSec = (uint32_t)(maxChunkSize * fps);
+
+    out.clear();
+    out.reserve(kHeaderSize);
+
+    putFourcc(out, "RIFF");
+    put32(out, fileBytes - 8);
+    putFourcc(out, "AVI ");
+
+    putFourcc(out, "LIST");
+    put32(out, 192);
+    putFourcc(out, "hdrl");
+
+    // main header
+    putFourcc(out, "avih");
+    put32(out, 56);
+    put32(out, microSecPerFrame);
+    put32(out, maxBytesPerSec);
+    put32(out, 0);                          // padding granularity
+    put32(out, kHasIndexFlag);
+    put32(out, frames);
+    put32(out, 0);                          // initial frames
+    put32(out, 1);                          // streams
+    put32(out, maxChunkSize);
+    put32(out, frameSize.width);
+    put32(out, frameSize.height);
+    for (int i = 0; i < 4; i++) {
+        put32(out, 0);
+    }
+
+    putFourcc(out, "LIST");
+    put32(out, 116);
+    putFourcc(out, "strl");
+
+    // video stream header
+    putFourcc(out, "strh");
+    put32(out, 56);
+    putFourcc(out, "vids");
+    putFourcc(out, "MJPG");
+    put32(out, 0);                          // flags
+    put16(out, 0);                          // priority
+    put16(out, 0);                          // language
+    put32(out, 0);                          // initial frames
+    put32(out, rateScale);
+    put32(out, rate);
+    put32(out, 0);                          // start
+    put32(out, frames);
+    put32(out, maxChunkSize);
+    put32(out, 0xFFFFFFFF);                 // quality, default
+    put32(out, 0);                          // sample size, varies per frame
+    put16(out, 0);
+    put16(out, 0);
+    put16(out, frameSize.width);
+    put16(out, frameSize.height);
+
+    // stream format, BITMAPINFOHEADER
+    putFourcc(out, "strf");
+    put32(out, 40);
+    put32(out, 40);
+    put32(out, frameSize.width);
+    put32(out, frameSize.height);
+    put16(out, 1);                          // planes
+    put16(out, 24);                         // bit count
+    putFourcc(out, "MJPG");
+    put32(out, frameSize.width * frameSize.height * 3);
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, 0);
+
+    putFourcc(out, "LIST");
+    put32(out, 4 + moviBytes);
+    putFourcc(out, "movi");
+}
+
+
+bool MjpegAviWriter::writeFully(const uint8_t *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "MJPEG write failed: " << path << " (" << strerror(errno) << ")" << std::endl;
+            return false;
+        }
+
+        data += written;
+        size -= written;
+        fileOffset += written;
+        unsyncedBytes += written;
+        stats.bytesWritten += written;
+        stats.writeCalls++;
+    }
+
+    return true;
+}
+
+
+bool MjpegAviWriter::flushBlock(bool final) {
+    if (blockFill == 0) {
+        return true;
+    }
+
+    // O_DIRECT only takes whole aligned blocks. the short tail at close goes
+    // through the page cache instead
+    if (final && directIO && blockFill % kAlignment != 0) {
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+        directIO = false;
+    }
+
+    bool ok = writeFully(block, blockFill);
+    blockFill = 0;
+
+    if (settings.syncPolicy == SyncPolicy::PERIODIC && unsyncedBytes >= settings.syncIntervalBytes) {
+        sync();
+    }
+
+    return ok;
+}
+
+
+bool MjpegAviWriter::append(const void *data, size_t size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+    while (size > 0) {
+        size_t chunk = std::min(size, settings.blockSize - blockFill);
+        memcpy(block + blockFill, bytes, chunk);
+        blockFill += chunk;
+        bytes += chunk;
+        size -= chunk;
+
+        if (blockFill == settings.blockSize && !flushBlock(false)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool MjpegAviWriter::write(const cv::Mat &frame) {
+    if (!isOpened() || frame.empty() || frame.depth() != CV_8U) {
+        return false;
+    }
+
+    if (frame.size() != frameSize) {
+        std::cerr << "MJPEG frame size does not match the stream" << std::endl;
+        return false;
+    }
+
+    if (!encoder.encode(frame, settings.jpegQuality)) {
+        return false;
+    }
+    unsigned long jpegSize = encoder.size();
+
+    uint32_t padded = (jpegSize + 1) & ~1UL;
+    uint64_t closedSize = kHeaderSize + moviBytes + 8 + padded + 8 + (index.size() + 1) * 16;
+    if (closedSize > kMaxFileBytes) {
+        std::cerr << "MJPEG file is full, rotate segments sooner: " << path << std::endl;
+        return false;
+    }
+
+    uint8_t chunkHeader[8] = {'0', '0', 'd', 'c',
+                              (uint8_t)(jpegSize & 0xff), (uint8_t)((jpegSize >> 8) & 0xff),
+                              (uint8_t)((jpegSize >> 16) & 0xff), (uint8_t)((jpegSize >> 24) & 0xff)};
+
+    IndexEntry entry;
+    entry.offset = 4 + moviBytes;
+    entry.size = jpegSize;
+
+    static const uint8_t pad = 0;
+    if (!append(chunkHeader, sizeof(chunkHeader)) || !append(encoder.data(), jpegSize) ||
+        (padded != jpegSize && !append(&pad, 1))) {
+        return false;
+    }
+
+    index.push_back(entry);
+    lastFrameOffset = kHeaderSize + moviBytes;
+    moviBytes += 8 + padded;
+    maxChunkSize = std::max(maxChunkSize, (uint32_t)jpegSize);
+    stats.frames++;
+
+    return true;
+}
+
+
+void MjpegAviWriter::sync() {
+    if (fd >= 0 && unsyncedBytes > 0) {
+        fdatasync(fd);
+        unsyncedBytes = 0;
+        stats.syncCalls++;
+    }
+}
+
+
+bool MjpegAviWriter::close() {
+    if (!isOpened()) {
+        return true;
+    }
+
+    bool ok = true;
+
+    // idx1 goes after the movi list
+    if (!index.empty()) {
+        std::vector<uint8_t> idx;
+        idx.reserve(8 + index.size() * 16);
+        putFourcc(idx, "idx1");
+        put32(idx, index.size() * 16);
+        for (const auto &entry : index) {
+            putFourcc(idx, "00dc");
+            put32(idx, kKeyframeFlag);
+            put32(idx, entry.offset);
+            put32(idx, entry.size);
+        }
+        ok = append(idx.data(), idx.size());
+    }
+
+    ok = flushBlock(true) && ok;
+
+    // patch the header with the final counts and sizes
+    std::vector<uint8_t> header;
+    buildHeader(header);
+    if (directIO) {
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+        directIO = false;
+    }
+    if (pwrite(fd, header.data(), header.size(), 0) != (ssize_t)header.size()) {
+        std::cerr << "Failed to finalise MJPEG header: " << path << std::endl;
+        ok = false;
+    }
+
+    if (settings.syncPolicy != SyncPolicy::NONE) {
+        unsyncedBytes = std::max(unsyncedBytes, (uint64_t)header.size());
+        sync();
+    }
+
+    ::close(fd);
+    fd = -1;
+
+    return ok;
+}
+
+
+bool MjpegAviWriter::isOpened() const {
+    return fd >= 0;
+}
+
+
+uint64_t MjpegAviWriter::getBytesWritten() const {
+    return fileOffset + blockFill;
+}
+
+
+uint64_t MjpegAviWriter::getLastFrameOffset() const {
+    return lastFrameOffset;
+}
+
+
+MjpegWriterStats MjpegAviWriter::getStats() const {
+    return stats;
+}
@@ -0,0 +1,212 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+
+#include "MosaicCompositor.h"
+
+
+MosaicCompositor::MosaicCompositor(const std::vector<std::string> &camIds,
+                                   const MosaicSettings &settings)
+    : settings(settings), canvasSeq(0) {
+
+    for (const auto &id : camIds) {
+        if (byCamera.count(id)) {
+            continue;
+        }
+
+        std::unique_ptr<Tile> tile(new Tile());
+        tile->camId = id;
+        tile->seq = 0;
+        tile->drawnSeq = 0;
+        byCamera[id] = tile.get();
+        tiles.push_back(std::move(tile));
+    }
+
+    layout();
+
+    stats.renders = 0;
+    stats.tilesDrawn = 0;
+    stats.tilesSkipped = 0;
+    stats.lastMs = 0.0;
+    stats.avgMs = 0.0;
+}
+
+
+void MosaicCompositor::layout() {
+    cv::Size size(std::max(1, settings.canvasSize.width), std::max(1, settings.canvasSize.height));
+    canvas = cv::Mat::zeros(size, CV_8UC3);
+
+    int count = std::max(1, (int)tiles.size());
+    int columns = settings.columns > 0 ? std::min(settings.columns, count)
+                                       : (int)std::ceil(std::sqrt((double)count));
+    int rows = (count + columns - 1) / columns;
+    int gap = std::max(0, settings.gap);
+
+    int tileWidth = std::max(1, (size.width - gap * (columns - 1)) / columns);
+    int tileHeight = std::max(1, (size.height - gap * (rows - 1)) / rows);
+
+    for (size_t i = 0; i < tiles.size(); i++) {
+        int column = (int)i % columns;
+        int row = (int)i / columns;
+        tiles[i]->area = cv::Rect(column * (tileWidth + gap), row * (tileHeight + gap),
+                                  tileWidth, tileHeight) & cv::Rect(0, 0, size.width, size.height);
+    }
+}
+
+
+void MosaicCompositor::drawTile(Tile &tile, const cv::Mat &frame, const std::vector<cv::Rect> &boxes) {
+    cv::Mat area = canvas(tile.area);
+
+    // fit the frame inside the tile, keeping its aspect ratio
+    double scale = std::min((double)tile.area.width / frame.cols, (double)tile.area.height / frame.rows);
+    int width = std::max(1, std::min(tile.area.width, (int)std::lround(frame.cols * scale)));
+    int height = std::max(1, std::min(tile.area.height, (int)std::lround(frame.rows * scale)));
+    cv::Rect fit((tile.area.width - width) / 2, (tile.area.height - height) / 2, width, height);
+
+    // the letterbox bars only need clearing when the frame size changes
+    if (fit != tile.drawnRect) {
+        area.setTo(cv::Scalar::all(0));
+        tile.drawnRect = fit;
+    }
+
+    // resized straight into the canvas, the ROI already has the right size
+    cv::Mat dst = area(fit);
+    if (frame.channels() == 3) {
+        cv::resize(frame, dst, fit.size(), 0, 0, cv::INTER_AREA);
+    }
+    else {
+        cv::Mat small;
+        cv::resize(frame, small, fit.size(), 0, 0, cv::INTER_AREA);
+        cv::cvtColor(small, dst, frame.channels() == 4 ? cv::COLOR_BGRA2BGR : cv::COLOR_GRAY2BGR);
+    }
+
+    if (settings.drawBoxes) {
+        for (const auto &box : boxes) {
+            cv::Rect scaled = cv::Rect((int)(box.x * scale) + fit.x, (int)(box.y * scale) + fit.y,
+                                       std::max(1, (int)(box.width * scale)),
+                                       std::max(1, (int)(box.height * scale))) & fit;
+            if (scaled.area() > 0) {
+                cv::rectangle(area, scaled, cv::Scalar(0, 255, 0), 1);
+            }
+        }
+    }
+
+    // drawn into the tile's own ROI so a long id cannot spill into a neighbour
+    if (settings.drawLabels) {
+        cv::putText(area, tile.camId, cv::Point(4, 14), cv::FONT_HERSHEY_SIMPLEX, 0.4,
+                    cv::Scalar(255, 255, 255), 1);
+    }
+}
+
+
+bool MosaicCompositor::publishFrame(const std::string &camId, const cv::Mat &frame,
+                                    const std::vector<cv::Rect> &boxes) {
+    auto it = byCamera.find(camId);
+    if (it == byCamera.end() || frame.empty()) {
+        return false;
+    }
+
+    Tile &tile = *it->second;
+    std::lock_guard<std::mutex> lock(tile.mutex);
+    tile.latest = frame;
+    tile.boxes = boxes;
+    tile.seq++;
+
+    return true;
+}
+
+
+uint64_t MosaicCompositor::render(cv::Mat &view) {
+    std::lock_guard<std::mutex> renderLock(renderMutex);
+    auto t0 = std::chrono::steady_clock::now();
+
+    // take the new frames under their tile locks, draw them outside
+    struct Pending {
+        Tile *tile;
+        cv::Mat frame;
+        std::vector<cv::Rect> boxes;
+    };
+    std::vector<Pending> pending;
+    for (auto &tile : tiles) {
+        std::lock_guard<std::mutex> lock(tile->mutex);
+        if (tile->seq != tile->drawnSeq && !tile->latest.empty()) {
+            pending.push_back(Pending{tile.get(), tile->latest, tile->boxes});
+            tile->drawnSeq = tile->seq;
+        }
+    }
+
+    // tiles are disjoint ROIs of the canvas, they can be drawn in parallel
+    if (!pending.empty()) {
+        cv::parallel_for_(cv::Range(0, (int)pending.size()), [&](const cv::Range &range) {
+            for (int i = range.start; i < range.end; i++) {
+                drawTile(*pending[i].tile, pending[i].frame, pending[i].boxes);
+            }
+        });
+        canvasSeq++;
+    }
+
+    view = canvas;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.renders++;
+    stats.tilesDrawn += pending.size();
+    stats.tilesSkipped += tiles.size() - pending.size();
+    stats.lastMs = ms;
+    stats.avgMs = stats.renders == 1 ? ms : 0.9 * stats.avgMs + 0.1 * ms;
+
+    return canvasSeq;
+}
+
+
+uint64_t MosaicCompositor::renderCopy(cv::Mat &out, uint64_t knownSeq) {
+    cv::Mat view;
+    render(view);
+
+    // a render from another thread may already be drawing into view, so the
+    // copy is taken under the render lock
+    std::lock_guard<std::mutex> renderLock(renderMutex);
+    if (canvasSeq != knownSeq || out.empty()) {
+        canvas.copyTo(out);
+    }
+
+    return canvasSeq;
+}
+
+
+bool MosaicCompositor::getLatestFrame(const std::string &camId, cv::Mat &frame, uint64_t *seq) {
+    auto it = byCamera.find(camId);
+    if (it == byCamera.end()) {
+        return false;
+    }
+
+    Tile &tile = *it->second;
+    std::lock_guard<std::mutex> lock(tile.mutex);
+    if (tile.latest.empty()) {
+        return false;
+    }
+
+    frame = tile.latest;
+    if (seq) {
+        *seq = tile.seq;
+    }
+
+    return true;
+}
+
+
+std::vector<std::string> MosaicCompositor::getCameraIds() const {
+    std::vector<std::string> ids;
+    for (const auto &tile : tiles) {
+        ids.push_back(tile->camId);
+    }
+
+    return ids;
+}
+
+
+MosaicStats MosaicCompositor::getStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
@@ -1,116 +1,196 @@
 #include <iostream>
+#include <cstdlib>
 
 #include "MotionDetector.h"
 
 
 MotionDetector::MotionDetector(int threshold, double minArea)
-    : threshold(threshold), minArea(minArea), initialized(false) {}
+    : threshold(threshold), minArea(minArea), initialized(false),
+      keyframeInterval(0), trackMargin(32), framesSinceKeyframe(0), forceKeyframe(true) {}
 
 
 MotionDetector::~MotionDetector() {}
 
 
-bool MotionDetector::detectMotion(const cv::Mat &currFrame) {
-    if (currFrame.empty()) {
+bool MotionDetector::computeMotionMask(const cv::Mat &currFrame, cv::Mat &mask) {
+    cv::Rect frameRect(0, 0, currFrame.cols, currFrame.rows);
+
+    // rasterise zones once for this frame size
+    if (!zones.empty() && zoneMask.getFrameSize() != currFrame.size()) {
+        zoneMask.build(zones, currFrame.size());
+        initialized = false;
+    }
+
+    // with zones only the active bounds plus the blur halo are converted and blurred
+    cv::Rect roi = frameRect;
+    if (!zones.empty()) {
+        const int halo = 10;
+        cv::Rect active = zoneMask.getActiveBounds();
+        roi = cv::Rect(active.x - halo, active.y - halo,
+                       active.width + 2 * halo, active.height + 2 * halo) & frameRect;
+    }
+
+    if (roi.area() == 0) {
+        mask = cv::Mat::zeros(currFrame.size(), CV_8UC1);
         return false;
     }
 
+    // once there is a reference the whole chain can run strip by strip
+    if (stripPipeline && zones.empty() && initialized && prevFrame.size() == currFrame.size()) {
+        stripPipeline->process(currFrame, prevFrame, mask, threshold);
+        return true;
+    }
+
     // convert to gray scale
     cv::Mat grayFrame;
     if (currFrame.channels() == 3) {
-        cv::cvtColor(currFrame, grayFrame, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(currFrame(roi), grayFrame, cv::COLOR_BGR2GRAY);
     }
     else {
-        grayFrame = currFrame.clone();
+        grayFrame = currFrame(roi).clone();
     }
 
     // apply Gaussian blur to reduce noise
-    cv::GaussianBlur(grayFrame, grayFrame, cv::Size(21, 21), 0);
+    blurEngine.blur(grayFrame, grayFrame, 21);
 
     // initialize previous frame on first run
-    if (!initialized || prevFrame.empty()) {
-        prevFrame = grayFrame.clone();
+    if (!initialized || prevFrame.size() != currFrame.size()) {
+        prevFrame = cv::Mat::zeros(currFrame.size(), CV_8UC1);
+        cv::Mat prevRoi = prevFrame(roi);
+        grayFrame.copyTo(prevRoi);
         initialized = true;
 
+        mask = cv::Mat::zeros(currFrame.size(), CV_8UC1);
         return false;   // no motion on first frame
     }
 
-    // compute absolute difference between curr and prev frame
-    cv::Mat frameDelta;
-    cv::absdiff(prevFrame, grayFrame, frameDelta);
+    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
 
-    // apply threshold to get binary image
-    cv::Mat thresh;
-    cv::threshold(frameDelta, thresh, threshold, 255, cv::THRESH_BINARY);
+    if (zones.empty()) {
+        // compute absolute difference between curr and prev frame
+        cv::Mat frameDelta;
+        cv::absdiff(prevFrame, grayFrame, frameDelta);
 
-    // dilate to fill in holes
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
-    cv::dilate(thresh, thresh, kernel, cv::Point(-1, -1), 2);
-
-    // find contours
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(thresh, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-
-    // check if any contour is larger than  minium area
-    bool motionDetected = false;
-    for (const auto &c : contours) {
-        double area = cv::contourArea(c);
-        if (area >= minArea) {
-            motionDetected = true;
-            break;
-        }
+        // apply threshold to get binary image
+        cv::threshold(frameDelta, mask, threshold, 255, cv::THRESH_BINARY);
+
+        // dilate to fill in holes
+        cv::dilate(mask, mask, kernel, cv::Point(-1, -1), 2);
+    }
+    else {
+        // difference and threshold only inside active spans
+        cv::Rect active = zoneMask.getActiveBounds();
+        mask = cv::Mat::zeros(currFrame.size(), CV_8UC1);
+        cv::Mat activeMask = mask(active);
+        diffZoneSpans(grayFrame, roi, active, activeMask);
+
+        // dilate to fill in holes, two 5x5 passes reach 4 pixels out
+        cv::Rect dilateRect = cv::Rect(active.x - 4, active.y - 4,
+                                       active.width + 8, active.height + 8) & frameRect;
+        cv::Mat maskRoi = mask(dilateRect);
+        cv::dilate(maskRoi, maskRoi, kernel, cv::Point(-1, -1), 2);
     }
 
     // update previous frame
-    prevFrame = grayFrame.clone();
+    cv::Mat prevRoi = prevFrame(roi);
+    grayFrame.copyTo(prevRoi);
 
-    return motionDetected;
+    return true;
 }
 
 
-cv::Mat MotionDetector::getMotionMask(const cv::Mat &currFrame) {
-    if (currFrame.empty()) {
-        return cv::Mat();
+void MotionDetector::diffZoneSpans(const cv::Mat &gray, const cv::Rect &grayRect,
+                                   const cv::Rect &area, cv::Mat &mask) {
+    // resolve per-zone thresholds once per call
+    std::vector<int> zoneThreshold(zoneMask.getZoneCount());
+    for (size_t z = 0; z < zoneThreshold.size(); z++) {
+        zoneThreshold[z] = zoneMask.getZoneThreshold((int)z, threshold);
     }
 
-    // convert to gray scale
-    cv::Mat grayFrame;
-    if (currFrame.channels() == 3) {
-        cv::cvtColor(currFrame, grayFrame, cv::COLOR_BGR2GRAY);
+    // gray covers grayRect, mask covers area, both in frame coordinates
+    for (int y = area.y; y < area.y + area.height; y++) {
+        const uchar *ref = prevFrame.ptr<uchar>(y);
+        const uchar *cur = gray.ptr<uchar>(y - grayRect.y);
+        uchar *out = mask.ptr<uchar>(y - area.y);
+
+        for (const ZoneSpan *s = zoneMask.rowBegin(y); s != zoneMask.rowEnd(y); s++) {
+            int x0 = std::max(s->x0, area.x);
+            int x1 = std::min(s->x1, area.x + area.width);
+            int thresh = zoneThreshold[s->zone];
+
+            for (int x = x0; x < x1; x++) {
+                int delta = std::abs((int)cur[x - grayRect.x] - (int)ref[x]);
+                out[x - area.x] = delta > thresh ? 255 : 0;
+            }
+        }
+    }
+}
+
+
+void MotionDetector::findRegions(const cv::Mat &mask, std::vector<MotionRegion> &regions,
+                                 const cv::Point &offset) {
+    if (zones.empty()) {
+        regionExtractor.extract(mask, minArea, regions);
     }
     else {
-        grayFrame = currFrame.clone();
+        // extract with the most permissive area, then apply the minimum area
+        // of the zone that owns each region centre
+        regionExtractor.extract(mask, zoneMask.getSmallestMinArea(minArea), regions);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < regions.size(); i++) {
+            const cv::Rect &box = regions[i].bbox;
+            int zone = zoneMask.zoneAt(offset.x + box.x + box.width / 2,
+                                       offset.y + box.y + box.height / 2);
+
+            if (regions[i].area >= zoneMask.getZoneMinArea(zone, minArea)) {
+                regions[kept++] = regions[i];
+            }
+        }
+        regions.resize(kept);
     }
 
-    // apply Gaussian blur to reduce noise
-    cv::GaussianBlur(grayFrame, grayFrame, cv::Size(21, 21), 0);
+    for (auto &r : regions) {
+        r.bbox.x += offset.x;
+        r.bbox.y += offset.y;
+    }
+}
 
-    // initialize if needed
-    if (!initialized || prevFrame.empty()) {
-        prevFrame = grayFrame.clone();
-        initialized = true;
 
-        return cv::Mat::zeros(currFrame.size(), CV_8UC1);
+bool MotionDetector::detectMotion(const cv::Mat &currFrame) {
+    if (currFrame.empty()) {
+        return false;
     }
 
-    // compute absolute difference between curr and prev frame
-    cv::Mat frameDelta;
-    cv::absdiff(prevFrame, grayFrame, frameDelta);
+    cv::Mat mask;
+    if (!computeMotionMask(currFrame, mask)) {
+        return false;
+    }
 
-    // apply threshold
-    cv::Mat thresh;
-    cv::threshold(frameDelta, thresh, threshold, 255, cv::THRESH_BINARY);
+    // label connected regions and check if any is larger than minimum area
+    if (zones.empty()) {
+        return regionExtractor.hasRegion(mask, minArea);
+    }
 
-    // dilate to fill in holes
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
-    cv::dilate(thresh, thresh, kernel, cv::Point(-1, -1), 2);    
+    std::vector<MotionRegion> regions;
+    findRegions(mask, regions);
 
-    // update previous frame
-    prevFrame = grayFrame.clone();
+    return !regions.empty();
+}
+
+
+cv::Mat MotionDetector::getMotionMask(const cv::Mat &currFrame) {
+    if (currFrame.empty()) {
+        return cv::Mat();
+    }
 
-    return thresh;
+    cv::Mat mask;
+    computeMotionMask(currFrame, mask);
+
+    return mask;
 }
 
+
 std::vector<cv::Rect> MotionDetector::getMotionRegions(const cv::Mat &currFrame) {
     std::vector<cv::Rect> motionRegions;
 
@@ -125,16 +205,98 @@ std::vector<cv::Rect> MotionDetector::getMotionRegions(const cv::Mat &currFrame)
         return motionRegions;
     }
 
-    // find contours in motion mask
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(motionMask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    // label connected regions, keeping the largest ones above minimum area
+    std::vector<MotionRegion> regions;
+    findRegions(motionMask, regions);
+
+    for (const auto &r : regions) {
+        motionRegions.push_back(r.bbox);
+    }
+
+    return motionRegions;
+}
+
+
+void MotionDetector::computeRoiMask(const cv::Mat &currFrame, const cv::Rect &roi, cv::Mat &mask) {
+    cv::Rect frameRect(0, 0, currFrame.cols, currFrame.rows);
+
+    // blur a halo around the region so its border pixels match a full-frame pass
+    const int halo = 10;
+    cv::Rect outer = cv::Rect(roi.x - halo, roi.y - halo,
+                              roi.width + 2 * halo, roi.height + 2 * halo) & frameRect;
+
+    cv::Mat grayFrame;
+    if (currFrame.channels() == 3) {
+        cv::cvtColor(currFrame(outer), grayFrame, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        grayFrame = currFrame(outer).clone();
+    }
+    blurEngine.blur(grayFrame, grayFrame, 21);
+
+    cv::Mat inner = grayFrame(cv::Rect(roi.x - outer.x, roi.y - outer.y, roi.width, roi.height));
+    cv::Mat prevRoi = prevFrame(roi);
+
+    if (zones.empty()) {
+        cv::Mat frameDelta;
+        cv::absdiff(prevRoi, inner, frameDelta);
+        cv::threshold(frameDelta, mask, threshold, 255, cv::THRESH_BINARY);
+    }
+    else {
+        mask = cv::Mat::zeros(roi.size(), CV_8UC1);
+        diffZoneSpans(grayFrame, outer, roi, mask);
+    }
+
+    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+    cv::dilate(mask, mask, kernel, cv::Point(-1, -1), 2);
 
-    // get bounding rectangles fpr contours larger than minium area
-    for (const auto &c : contours) {
-        double area = cv::contourArea(c);
-        if (area >= minArea) {
-            cv::Rect boundingRect = cv::boundingRect(c);
-            motionRegions.push_back(boundingRect);
+    inner.copyTo(prevRoi);
+}
+
+
+std::vector<cv::Rect> MotionDetector::getMotionRegions(const cv::Mat &currFrame,
+                                                       const std::vector<cv::Rect> &rois) {
+    // a region pass needs a full-size reference to compare against
+    bool zonesStale = !zones.empty() && zoneMask.getFrameSize() != currFrame.size();
+    if (currFrame.empty() || !initialized || prevFrame.size() != currFrame.size() || zonesStale) {
+        return getMotionRegions(currFrame);
+    }
+
+    // clip, then merge overlapping regions so no pixel is processed twice
+    cv::Rect frameRect(0, 0, currFrame.cols, currFrame.rows);
+    std::vector<cv::Rect> merged;
+    for (const auto &roi : rois) {
+        cv::Rect r = roi & frameRect;
+        if (r.area() > 0) {
+            merged.push_back(r);
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < merged.size() && !changed; i++) {
+            for (size_t j = i + 1; j < merged.size(); j++) {
+                if ((merged[i] & merged[j]).area() > 0) {
+                    merged[i] |= merged[j];
+                    merged.erase(merged.begin() + j);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::vector<cv::Rect> motionRegions;
+    std::vector<MotionRegion> regions;
+    cv::Mat mask;
+
+    for (const auto &roi : merged) {
+        computeRoiMask(currFrame, roi, mask);
+        findRegions(mask, regions, roi.tl());
+
+        for (const auto &r : regions) {
+            motionRegions.push_back(r.bbox);
         }
     }
 
@@ -142,6 +304,56 @@ std::vector<cv::Rect> MotionDetector::getMotionRegions(const cv::Mat &currFrame)
 }
 
 
+std::vector<TrackedObject> MotionDetector::trackMotion(const cv::Mat &currFrame) {
+    if (currFrame.empty()) {
+        return std::vector<TrackedObject>();
+    }
+
+    bool keyframe = keyframeInterval <= 0 || forceKeyframe ||
+                    framesSinceKeyframe + 1 >= keyframeInterval;
+
+    std::vector<cv::Rect> detections;
+    if (keyframe) {
+        detections = getMotionRegions(currFrame);
+        framesSinceKeyframe = 0;
+    }
+    else {
+        detections = getMotionRegions(currFrame,
+                                      tracker.predictRegions(trackMargin, currFrame.size()));
+        framesSinceKeyframe++;
+    }
+
+    std::vector<TrackedObject> visible = tracker.update(detections);
+
+    // a lost track or an unexpected new one between keyframes means the
+    // local search can no longer be trusted
+    forceKeyframe = tracker.getMatchRatio() < 0.5 ||
+                    (!keyframe && tracker.getNewTrackCount() > 0);
+
+    return visible;
+}
+
+
+void MotionDetector::enableTracking(int keyframeInterval, int margin) {
+    this->keyframeInterval = std::max(1, keyframeInterval);
+    trackMargin = std::max(0, margin);
+    framesSinceKeyframe = 0;
+    forceKeyframe = true;
+    tracker.reset();
+}
+
+
+void MotionDetector::disableTracking() {
+    keyframeInterval = 0;
+    tracker.reset();
+}
+
+
+bool MotionDetector::isTrackingEnabled() const {
+    return keyframeInterval > 0;
+}
+
+
 void MotionDetector::setThreshold(int thresh) {
     this->threshold = std::max(0, std::min(255, thresh));
 }
@@ -151,7 +363,89 @@ void MotionDetector::setMinArea(double area) {
     this->minArea = std::max(0.0, area);
 }
 
+
+void MotionDetector::setMaxRegions(int count) {
+    regionExtractor.setMaxRegions(count);
+}
+
+
+void MotionDetector::setRegionMergeDistance(int cells) {
+    regionExtractor.setMergeDistance(cells);
+}
+
+
+void MotionDetector::setBlurMethod(BlurMethod method) {
+    if (method != blurEngine.getMethod()) {
+        blurEngine.setMethod(method);
+        if (stripPipeline) {
+            stripPipeline->setBlurMethod(method);
+        }
+        reset();
+    }
+}
+
+
+BlurMethod MotionDetector::getBlurMethod() const {
+    return blurEngine.getMethod();
+}
+
+
+void MotionDetector::enableStripPipeline(int workers, int stripRows) {
+    // same kernels as computeMotionMask
+    StripPipelineSettings settings;
+    settings.blurSize = 21;
+    settings.dilateSize = 5;
+    settings.dilateIterations = 2;
+    settings.workers = workers;
+    settings.stripRows = stripRows;
+
+    stripPipeline = std::make_shared<StripPipeline>(settings);
+    stripPipeline->setBlurMethod(blurEngine.getMethod());
+}
+
+
+void MotionDetector::disableStripPipeline() {
+    stripPipeline.reset();
+}
+
+
+bool MotionDetector::isStripPipelineEnabled() const {
+    return stripPipeline != nullptr;
+}
+
+
+int MotionDetector::getThreshold() const {
+    return threshold;
+}
+
+
+double MotionDetector::getMinArea() const {
+    return minArea;
+}
+
+
+void MotionDetector::setZones(const std::vector<MotionZone> &zones) {
+    this->zones = zones;
+    zoneMask.clear();
+    reset();
+}
+
+
+void MotionDetector::clearZones() {
+    zones.clear();
+    zoneMask.clear();
+    reset();
+}
+
+
+bool MotionDetector::hasZones() const {
+    return !zones.empty();
+}
+
+
 void MotionDetector::reset() {
     prevFrame.release();
     initialized = false;
+    tracker.reset();
+    forceKeyframe = true;
 }
@@ -0,0 +1,222 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "MotionZone.h"
+
+
+ZoneMask::ZoneMask() : activePixels(0) {}
+
+
+ZoneMask::~ZoneMask() {}
+
+
+void ZoneMask::rasteriseRow(const std::vector<cv::Point> &polygon, int y, int width,
+                            std::vector<float> &crossings,
+                            std::vector<std::pair<int, int>> &runs) {
+    runs.clear();
+    crossings.clear();
+
+    // sample at the pixel centre, even-odd rule
+    float yc = y + 0.5f;
+    size_t n = polygon.size();
+    for (size_t i = 0; i < n; i++) {
+        const cv::Point &a = polygon[i];
+        const cv::Point &b = polygon[(i + 1) % n];
+
+        if ((a.y <= yc && b.y > yc) || (b.y <= yc && a.y > yc)) {
+            float t = (yc - a.y) / (float)(b.y - a.y);
+            crossings.push_back(a.x + t * (b.x - a.x));
+        }
+    }
+
+    std::sort(crossings.begin(), crossings.end());
+
+    for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+        // pixels whose centre lies inside [left, right)
+        int x0 = std::max(0, (int)std::ceil(crossings[i] - 0.5f));
+        int x1 = std::min(width, (int)std::ceil(crossings[i + 1] - 0.5f));
+        if (x0 < x1) {
+            runs.push_back(std::make_pair(x0, x1));
+        }
+    }
+}
+
+
+bool ZoneMask::build(const std::vector<MotionZone> &allZones, const cv::Size &size) {
+    clear();
+
+    if (size.width <= 0 || size.height <= 0) {
+        return false;
+    }
+
+    std::vector<const MotionZone*> excludes;
+    for (const auto &zone : allZones) {
+        if (zone.polygon.size() < 3) {
+            std::cerr << "Motion zone " << zone.name << " needs at least 3 points" << std::endl;
+            continue;
+        }
+
+        if (zone.exclude) {
+            excludes.push_back(&zone);
+        }
+        else {
+            zones.push_back(zone);
+        }
+    }
+
+    // no include zone: the whole frame is one implicit zone with detector defaults
+    bool implicitZone = zones.empty();
+    if (implicitZone) {
+        zones.push_back(MotionZone("frame", std::vector<cv::Point>()));
+    }
+
+    frameSize = size;
+    rowStart.assign(size.height + 1, 0);
+
+    // owner of each pixel on the current row, -1 for inactive
+    std::vector<int> owner(size.width);
+    std::vector<float> crossings;
+    std::vector<std::pair<int, int>> runs;
+
+    int minX = size.width, maxX = -1, minY = size.height, maxY = -1;
+
+    for (int y = 0; y < size.height; y++) {
+        std::fill(owner.begin(), owner.end(), implicitZone ? 0 : -1);
+
+        // earlier include zones take priority where zones overlap
+        for (int z = (int)zones.size() - 1; z >= 0 && !implicitZone; z--) {
+            rasteriseRow(zones[z].polygon, y, size.width, crossings, runs);
+            for (const auto &run : runs) {
+                std::fill(owner.begin() + run.first, owner.begin() + run.second, z);
+            }
+        }
+
+        for (const auto *zone : excludes) {
+            rasteriseRow(zone->polygon, y, size.width, crossings, runs);
+            for (const auto &run : runs) {
+                std::fill(owner.begin() + run.first, owner.begin() + run.second, -1);
+            }
+        }
+
+        // run-length encode the row
+        int x = 0;
+        while (x < size.width) {
+            if (owner[x] < 0) {
+                x++;
+                continue;
+            }
+
+            ZoneSpan span;
+            span.x0 = x;
+            span.zone = owner[x];
+            while (x < size.width && owner[x] == span.zone) {
+                x++;
+            }
+            span.x1 = x;
+            spans.push_back(span);
+
+            activePixels += span.x1 - span.x0;
+            minX = std::min(minX, span.x0);
+            maxX = std::max(maxX, span.x1);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+        }
+
+        rowStart[y + 1] = (int)spans.size();
+    }
+
+    if (maxX >= 0) {
+        activeBounds = cv::Rect(minX, minY, maxX - minX, maxY - minY + 1);
+    }
+
+    std::cout << "Motion zones built: " << spans.size() << " spans, "
+              << (int)(getActiveFraction() * 100.0) << "% of frame active" << std::endl;
+
+    return true;
+}
+
+
+void ZoneMask::clear() {
+    zones.clear();
+    spans.clear();
+    rowStart.clear();
+    frameSize = cv::Size();
+    activeBounds = cv::Rect();
+    activePixels = 0;
+}
+
+
+bool ZoneMask::empty() const {
+    return rowStart.empty();
+}
+
+
+const ZoneSpan *ZoneMask::rowBegin(int y) const {
+    return spans.data() + rowStart[y];
+}
+
+
+const ZoneSpan *ZoneMask::rowEnd(int y) const {
+    return spans.data() + rowStart[y + 1];
+}
+
+
+int ZoneMask::zoneAt(int x, int y) const {
+    if (empty() || y < 0 || y >= frameSize.height) {
+        return -1;
+    }
+
+    for (const ZoneSpan *s = rowBegin(y); s != rowEnd(y); s++) {
+        if (x >= s->x0 && x < s->x1) {
+            return s->zone;
+        }
+    }
+    return -1;
+}
+
+
+int ZoneMask::getZoneThreshold(int zone, int fallback) const {
+    if (zone < 0 || zone >= (int)zones.size() || zones[zone].threshold < 0) {
+        return fallback;
+    }
+    return zones[zone].threshold;
+}
+
+
+double ZoneMask::getZoneMinArea(int zone, double fallback) const {
+    if (zone < 0 || zone >= (int)zones.size() || zones[zone].minArea < 0.0) {
+        return fallback;
+    }
+    return zones[zone].minArea;
+}
+
+
+double ZoneMask::getSmallestMinArea(double fallback) const {
+    double smallest = fallback;
+    for (int z = 0; z < (int)zones.size(); z++) {
+        smallest = std::min(smallest, getZoneMinArea(z, fallback));
+    }
+    return smallest;
+}
+
+
+int ZoneMask::getZoneCount() const {
+    return (int)zones.size();
+}
+
+
+cv::Size ZoneMask::getFrameSize() const {
+    return frameSize;
+}
+
+
+cv::Rect ZoneMask::getActiveBounds() const {
+    return activeBounds;
+}
+
+
+double ZoneMask::getActiveFraction() const {
+    double total = (double)frameSize.width * frameSize.height;
+    return total > 0.0 ? activePixels / total : 0.0;
+}
@@ -0,0 +1,181 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "ObjectTracker.h"
+
+
+ObjectTracker::ObjectTracker(double minIoU, int maxMisses, double maxCentroidShift)
+    : nextId(1), minIoU(minIoU), maxCentroidShift(maxCentroidShift),
+      maxMisses(std::max(0, maxMisses)), matchRatio(1.0), newTracks(0) {}
+
+
+ObjectTracker::~ObjectTracker() {}
+
+
+double ObjectTracker::iou(const cv::Rect &a, const cv::Rect &b) {
+    double inter = (a & b).area();
+    double uni = (double)a.area() + b.area() - inter;
+    return uni > 0.0 ? inter / uni : 0.0;
+}
+
+
+cv::Point2f ObjectTracker::centroid(const cv::Rect &r) {
+    return cv::Point2f(r.x + r.width * 0.5f, r.y + r.height * 0.5f);
+}
+
+
+std::vector<TrackedObject> ObjectTracker::update(const std::vector<cv::Rect> &detections) {
+    struct Candidate {
+        double score;
+        int track;
+        int det;
+    };
+
+    // score every plausible pair. IoU matches always beat centroid-only matches,
+    // which only rescue small fast objects whose boxes no longer overlap
+    std::vector<Candidate> candidates;
+    for (int t = 0; t < (int)tracks.size(); t++) {
+        // coasting tracks are extrapolated over the frames they missed
+        float steps = (float)(tracks[t].misses + 1);
+        cv::Point2f c = centroid(tracks[t].bbox) + tracks[t].velocity * steps;
+        double diag = std::sqrt((double)tracks[t].bbox.width * tracks[t].bbox.width +
+                                (double)tracks[t].bbox.height * tracks[t].bbox.height);
+
+        for (int d = 0; d < (int)detections.size(); d++) {
+            double overlap = iou(tracks[t].bbox, detections[d]);
+            if (overlap >= minIoU) {
+                Candidate cand = {1.0 + overlap, t, d};
+                candidates.push_back(cand);
+                continue;
+            }
+
+            cv::Point2f dc = centroid(detections[d]);
+            double dist = std::sqrt((dc.x - c.x) * (dc.x - c.x) + (dc.y - c.y) * (dc.y - c.y));
+            if (diag > 0.0 && dist <= maxCentroidShift * diag) {
+                Candidate cand = {1.0 - dist / (maxCentroidShift * diag), t, d};
+                candidates.push_back(cand);
+            }
+        }
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate &a, const Candidate &b) { return a.score > b.score; });
+
+    // greedy one-to-one assignment, best pairs first
+    std::vector<int> trackMatch(tracks.size(), -1);
+    std::vector<bool> detUsed(detections.size(), false);
+    int matched = 0;
+
+    for (const auto &cand : candidates) {
+        if (trackMatch[cand.track] >= 0 || detUsed[cand.det]) {
+            continue;
+        }
+        trackMatch[cand.track] = cand.det;
+        detUsed[cand.det] = true;
+        matched++;
+    }
+
+    matchRatio = tracks.empty() ? 1.0 : (double)matched / tracks.size();
+
+    // update matched tracks, age out the rest
+    std::vector<TrackedObject> alive;
+    for (size_t t = 0; t < tracks.size(); t++) {
+        TrackedObject &track = tracks[t];
+        track.age++;
+
+        if (trackMatch[t] >= 0) {
+            const cv::Rect &det = detections[trackMatch[t]];
+            cv::Point2f shift = centroid(det) - centroid(track.bbox);
+            track.velocity = track.velocity * 0.5f + shift * 0.5f;
+            track.bbox = det;
+            track.hits++;
+            track.misses = 0;
+        }
+        else {
+            track.misses++;
+        }
+
+        if (track.misses <= maxMisses) {
+            alive.push_back(track);
+        }
+    }
+
+    // unmatched detections start new tracks
+    newTracks = 0;
+    for (size_t d = 0; d < detections.size(); d++) {
+        if (detUsed[d]) {
+            continue;
+        }
+
+        TrackedObject track;
+        track.id = nextId++;
+        track.bbox = detections[d];
+        track.velocity = cv::Point2f(0.0f, 0.0f);
+        track.age = 1;
+        track.hits = 1;
+        track.misses = 0;
+        alive.push_back(track);
+        newTracks++;
+    }
+
+    tracks.swap(alive);
+
+    std::vector<TrackedObject> visible;
+    for (const auto &track : tracks) {
+        if (track.misses == 0) {
+            visible.push_back(track);
+        }
+    }
+
+    return visible;
+}
+
+
+std::vector<cv::Rect> ObjectTracker::predictRegions(int margin, const cv::Size &frameSize) const {
+    std::vector<cv::Rect> regions;
+    cv::Rect frameRect(0, 0, frameSize.width, frameSize.height);
+
+    for (const auto &track : tracks) {
+        // coasting tracks get a wider search window
+        int steps = 1 + track.misses;
+        int grow = margin * steps;
+        cv::Rect r(cvRound(track.bbox.x + track.velocity.x * steps) - grow,
+                   cvRound(track.bbox.y + track.velocity.y * steps) - grow,
+                   track.bbox.width + 2 * grow, track.bbox.height + 2 * grow);
+        r &= frameRect;
+
+        if (r.area() > 0) {
+            regions.push_back(r);
+        }
+    }
+
+    return regions;
+}
+
+
+const std::vector<TrackedObject> &ObjectTracker::getTracks() const {
+    return tracks;
+}
+
+
+double ObjectTracker::getMatchRatio() const {
+    return matchRatio;
+}
+
+
+int ObjectTracker::getNewTrackCount() const {
+    return newTracks;
+}
+
+
+bool ObjectTracker::empty() const {
+    return tracks.empty();
+}
+
+
+void ObjectTracker::reset() {
+    tracks.clear();
+    matchRatio = 1.0;
+    newTracks = 0;
+}
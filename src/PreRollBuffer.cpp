@@ -0,0 +1,236 @@
+#include <iostream>
+
+#include "PreRollBuffer.h"
+
+
+namespace {
+
+// frames waiting for the encoder. more than this and it has fallen behind,
+// the oldest go rather than letting raw frames pile up in memory
+const size_t kMaxRawFrames = 4;
+
+}   // namespace
+
+
+PreRollBuffer::PreRollBuffer(size_t budgetBytes, int maxDurationMs, int jpegQuality)
+    : busy(false), generation(0), budgetBytes(budgetBytes), usedBytes(0),
+      maxDurationMs(std::max(0, maxDurationMs)), evictedFrames(0), stopping(false) {
+
+    setJpegQuality(jpegQuality);
+    encoder = std::thread(&PreRollBuffer::encoderLoop, this);
+}
+
+
+PreRollBuffer::~PreRollBuffer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    if (encoder.joinable()) {
+        encoder.join();
+    }
+}
+
+
+// caller holds the mutex
+void PreRollBuffer::evictFront() {
+    usedBytes -= frames.front().data.size();
+    recycle(frames.front().data);
+    frames.pop_front();
+    evictedFrames++;
+}
+
+
+// caller holds the mutex. keeps the largest buffer around so the next
+// encode does not allocate
+void PreRollBuffer::recycle(std::vector<uchar> &data) {
+    if (data.capacity() > spare.capacity()) {
+        spare.swap(data);
+    }
+}
+
+
+void PreRollBuffer::encoderLoop() {
+    std::vector<int> params;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return stopping || !raw.empty(); });
+        if (stopping) {
+            return;
+        }
+
+        encoding = std::move(raw.front());
+        raw.pop_front();
+        busy = true;
+        uint64_t started = generation;
+        params = encodeParams;
+
+        EncodedFrame item;
+        item.data.swap(spare);
+        item.timestamp = encoding.timestamp;
+        cv::Mat frame = encoding.frame;
+
+        lock.unlock();
+        bool encoded = cv::imencode(".jpg", frame, item.data, params);
+        frame.release();
+        lock.lock();
+
+        busy = false;
+        encoding.frame.release();
+
+        if (!encoded) {
+            std::cerr << "Failed to encode pre-roll frame" << std::endl;
+            recycle(item.data);
+            continue;
+        }
+
+        // flushed or cleared while encoding, the frame went on without it
+        if (started != generation || item.data.size() > budgetBytes) {
+            recycle(item.data);
+            continue;
+        }
+
+        // drop frames older than the pre-roll window, then whatever else the
+        // new frame needs to fit the byte budget
+        auto oldest = item.timestamp - std::chrono::milliseconds(maxDurationMs);
+        while (!frames.empty() && frames.front().timestamp < oldest) {
+            evictFront();
+        }
+        while (!frames.empty() && usedBytes + item.data.size() > budgetBytes) {
+            evictFront();
+        }
+
+        usedBytes += item.data.size();
+        frames.push_back(std::move(item));
+    }
+}
+
+
+bool PreRollBuffer::push(const cv::Mat &frame) {
+    if (frame.empty()) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (raw.size() >= kMaxRawFrames) {
+            raw.pop_front();
+            evictedFrames++;
+        }
+
+        RawFrame item;
+        item.frame = frame;
+        item.timestamp = Clock::now();
+        raw.push_back(item);
+    }
+    wake.notify_one();
+
+    return true;
+}
+
+
+size_t PreRollBuffer::flushTo(VideoRecorder &recorder) {
+    std::deque<EncodedFrame> encoded;
+    std::vector<cv::Mat> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        encoded.swap(frames);
+        usedBytes = 0;
+
+        // the frame being encoded comes right after the compressed ones
+        if (busy) {
+            pending.push_back(encoding.frame);
+        }
+        for (const auto &item : raw) {
+            pending.push_back(item.frame);
+        }
+        raw.clear();
+        generation++;
+    }
+
+    size_t count = encoded.size() + pending.size();
+    if (!recorder.writeEncodedFrames(encoded)) {
+        return 0;
+    }
+
+    // the recorder writes its compressed backlog before anything queued
+    for (const auto &frame : pending) {
+        recorder.writeFrame(frame);
+    }
+
+    return count;
+}
+
+
+void PreRollBuffer::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    frames.clear();
+    raw.clear();
+    usedBytes = 0;
+    generation++;
+}
+
+
+void PreRollBuffer::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budgetBytes = bytes;
+    while (!frames.empty() && usedBytes > budgetBytes) {
+        evictFront();
+    }
+}
+
+
+void PreRollBuffer::setMaxDuration(int ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    maxDurationMs = std::max(0, ms);
+}
+
+
+void PreRollBuffer::setJpegQuality(int quality) {
+    std::lock_guard<std::mutex> lock(mutex);
+    encodeParams.clear();
+    encodeParams.push_back(cv::IMWRITE_JPEG_QUALITY);
+    encodeParams.push_back(std::max(1, std::min(100, quality)));
+}
+
+
+size_t PreRollBuffer::getFrameCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frames.size() + raw.size() + (busy ? 1 : 0);
+}
+
+
+size_t PreRollBuffer::getUsedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usedBytes;
+}
+
+
+size_t PreRollBuffer::getBudgetBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return budgetBytes;
+}
+
+
+double PreRollBuffer::getDurationSeconds() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // the oldest frame is compressed unless the encoder has not caught up
+    // yet, the newest one is still waiting unless it has
+    if (frames.size() + raw.size() < 2) {
+        return 0.0;
+    }
+    Clock::time_point first = frames.empty() ? raw.front().timestamp : frames.front().timestamp;
+    Clock::time_point last = raw.empty() ? frames.back().timestamp : raw.back().timestamp;
+
+    return std::chrono::duration<double>(last - first).count();
+}
+
+
+uint64_t PreRollBuffer::getEvictedFrames() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return evictedFrames;
+}
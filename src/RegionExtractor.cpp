@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <climits>
+
+#include "RegionExtractor.h"
+
+
+RegionExtractor::RegionExtractor(int cellSize, int maxRegions, int mergeDistance)
+    : cellSize(std::max(1, cellSize)), minCellFill(1),
+      mergeDistance(std::max(0, mergeDistance)), maxRegions(std::max(1, maxRegions)),
+      lastRegionCount(0) {}
+
+
+RegionExtractor::~RegionExtractor() {}
+
+
+int RegionExtractor::findRoot(int idx) {
+    // path halving keeps the trees flat without recursion
+    while (parent[idx] != idx) {
+        parent[idx] = parent[parent[idx]];
+        idx = parent[idx];
+    }
+    return idx;
+}
+
+
+void RegionExtractor::unite(int a, int b) {
+    int ra = findRoot(a);
+    int rb = findRoot(b);
+    if (ra == rb) {
+        return;
+    }
+
+    // the lower run index always becomes the root, so labelling is deterministic
+    if (ra < rb) {
+        parent[rb] = ra;
+    }
+    else {
+        parent[ra] = rb;
+    }
+}
+
+
+// one run per stretch of set pixels in a row, each joined with the runs of
+// the row above that touch it, diagonally included
+void RegionExtractor::findRuns(const cv::Mat &mask) {
+    runStart.clear();
+    runEnd.clear();
+    runRow.clear();
+    parent.clear();
+
+    int prevBegin = 0;
+    int prevEnd = 0;
+
+    for (int y = 0; y < mask.rows; y++) {
+        const uchar *row = mask.ptr<uchar>(y);
+        int rowBegin = (int)runStart.size();
+        int above = prevBegin;
+
+        int x = 0;
+        while (x < mask.cols) {
+            // most of a motion mask is empty
+            while (x < mask.cols && !row[x]) {
+                x++;
+            }
+            if (x == mask.cols) {
+                break;
+            }
+            int first = x;
+            while (x < mask.cols && row[x]) {
+                x++;
+            }
+            int last = x - 1;
+
+            int run = (int)runStart.size();
+            runStart.push_back(first);
+            runEnd.push_back(last);
+            runRow.push_back(y);
+            parent.push_back(run);
+
+            // runs above are sorted, skip the ones that end too far left and
+            // link the ones that reach within a pixel of this run
+            while (above < prevEnd && runEnd[above] < first - 1) {
+                above++;
+            }
+            for (int a = above; a < prevEnd && runStart[a] <= last + 1; a++) {
+                unite(run, a);
+            }
+        }
+
+        prevBegin = rowBegin;
+        prevEnd = (int)runStart.size();
+    }
+}
+
+
+// joins components that come within mergeDistance cells of each other.
+// components sharing a cell are joined as well
+void RegionExtractor::bridgeCells(const cv::Mat &mask) {
+    int gridW = (mask.cols + cellSize - 1) / cellSize;
+    int gridH = (mask.rows + cellSize - 1) / cellSize;
+    cellRun.assign((size_t)gridW * gridH, -1);
+    cellCount.assign((size_t)gridW * gridH, 0);
+
+    for (int run = 0; run < (int)runStart.size(); run++) {
+        int base = (runRow[run] / cellSize) * gridW;
+        for (int cx = runStart[run] / cellSize; cx <= runEnd[run] / cellSize; cx++) {
+            int x0 = std::max(runStart[run], cx * cellSize);
+            int x1 = std::min(runEnd[run], cx * cellSize + cellSize - 1);
+            int idx = base + cx;
+            cellCount[idx] += x1 - x0 + 1;
+            if (cellRun[idx] < 0) {
+                cellRun[idx] = run;
+            }
+            else {
+                unite(run, cellRun[idx]);
+            }
+        }
+    }
+
+    // link each cell to already visited cells in reach
+    int reach = mergeDistance;
+    for (int cy = 0; cy < gridH; cy++) {
+        for (int cx = 0; cx < gridW; cx++) {
+            int idx = cy * gridW + cx;
+            if (cellRun[idx] < 0 || cellCount[idx] < minCellFill) {
+                continue;
+            }
+
+            int xLo = std::max(0, cx - reach);
+            int xHi = std::min(gridW - 1, cx + reach);
+            int yLo = std::max(0, cy - reach);
+
+            for (int ny = yLo; ny <= cy; ny++) {
+                for (int nx = xLo; nx <= (ny < cy ? xHi : cx - 1); nx++) {
+                    int other = ny * gridW + nx;
+                    if (cellRun[other] >= 0 && cellCount[other] >= minCellFill) {
+                        unite(cellRun[idx], cellRun[other]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+int RegionExtractor::label(const cv::Mat &mask) {
+    regionScratch.clear();
+
+    if (mask.empty() || mask.type() != CV_8UC1) {
+        return 0;
+    }
+
+    findRuns(mask);
+    if (mergeDistance > 0) {
+        bridgeCells(mask);
+    }
+
+    // gather area and bounding box per root in scan order. the bbox fields
+    // hold min/max corners until the final pass turns them into a cv::Rect
+    int runs = (int)runStart.size();
+    regionIndex.assign(runs, -1);
+
+    for (int run = 0; run < runs; run++) {
+        int root = findRoot(run);
+        int r = regionIndex[root];
+        if (r < 0) {
+            r = (int)regionScratch.size();
+            regionIndex[root] = r;
+
+            MotionRegion region;
+            region.bbox = cv::Rect(INT_MAX, INT_MAX, -1, -1);
+            region.area = 0;
+            regionScratch.push_back(region);
+        }
+
+        MotionRegion &region = regionScratch[r];
+        region.area += runEnd[run] - runStart[run] + 1;
+        region.bbox.x = std::min(region.bbox.x, runStart[run]);
+        region.bbox.y = std::min(region.bbox.y, runRow[run]);
+        region.bbox.width = std::max(region.bbox.width, runEnd[run]);
+        region.bbox.height = std::max(region.bbox.height, runRow[run]);
+    }
+
+    for (auto &region : regionScratch) {
+        region.bbox.width = region.bbox.width - region.bbox.x + 1;
+        region.bbox.height = region.bbox.height - region.bbox.y + 1;
+    }
+
+    return (int)regionScratch.size();
+}
+
+
+static bool largerRegionFirst(const MotionRegion &a, const MotionRegion &b) {
+    if (a.area != b.area) {
+        return a.area > b.area;
+    }
+    if (a.bbox.y != b.bbox.y) {
+        return a.bbox.y < b.bbox.y;
+    }
+    return a.bbox.x < b.bbox.x;
+}
+
+
+int RegionExtractor::extract(const cv::Mat &mask, double minArea,
+                             std::vector<MotionRegion> &regions) {
+    regions.clear();
+    label(mask);
+
+    for (const auto &r : regionScratch) {
+        if (r.area >= minArea) {
+            regions.push_back(r);
+        }
+    }
+    lastRegionCount = (int)regions.size();
+
+    // keep the largest regions, ties broken by position
+    if ((int)regions.size() > maxRegions) {
+        std::partial_sort(regions.begin(), regions.begin() + maxRegions,
+                          regions.end(), largerRegionFirst);
+        regions.resize(maxRegions);
+    }
+    else {
+        std::sort(regions.begin(), regions.end(), largerRegionFirst);
+    }
+
+    return (int)regions.size();
+}
+
+
+int RegionExtractor::extract(const cv::Mat &mask, double minArea,
+                             std::vector<cv::Rect> &regions) {
+    // boxes only, found through a member buffer so a frame does not allocate
+    extract(mask, minArea, rectScratch);
+
+    regions.clear();
+    for (const auto &r : rectScratch) {
+        regions.push_back(r.bbox);
+    }
+
+    return (int)regions.size();
+}
+
+
+bool RegionExtractor::hasRegion(const cv::Mat &mask, double minArea) {
+    label(mask);
+
+    for (const auto &r : regionScratch) {
+        if (r.area >= minArea) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void RegionExtractor::setCellSize(int size) {
+    cellSize = std::max(1, size);
+    minCellFill = std::min(minCellFill, cellSize * cellSize);
+}
+
+
+void RegionExtractor::setMinCellFill(int pixels) {
+    minCellFill = std::max(1, std::min(cellSize * cellSize, pixels));
+}
+
+
+void RegionExtractor::setMergeDistance(int cells) {
+    mergeDistance = std::max(0, cells);
+}
+
+
+void RegionExtractor::setMaxRegions(int count) {
+    maxRegions = std::max(1, count);
+}
+
+
+int RegionExtractor::getCellSize() const {
+    return cellSize;
+}
+
+
+int RegionExtractor::getMaxRegions() const {
+    return maxRegions;
+}
+
+
+int RegionExtractor::getLastRegionCount() const {
+    return lastRegionCount;
+}
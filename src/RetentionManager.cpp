@@ -0,0 +1,316 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "RetentionManager.h"
+#include "FrameIndex.h"
+
+
+RetentionManager::RetentionManager(uint64_t globalBudgetBytes, int intervalMs, size_t batchSize)
+    : globalBudget(globalBudgetBytes), intervalMs(std::max(100, intervalMs)),
+      batchSize(std::max((size_t)1, batchSize)), running(false) {
+
+    stats.totalBytes = 0;
+    stats.segmentCount = 0;
+    stats.deletedSegments = 0;
+    stats.deletedBytes = 0;
+    stats.passes = 0;
+}
+
+
+RetentionManager::~RetentionManager() {
+    stop();
+}
+
+
+void RetentionManager::setGlobalBudget(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    globalBudget = bytes;
+}
+
+
+void RetentionManager::setCameraBudget(const std::string &camId, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    cameraBudgets[camId] = bytes;
+}
+
+
+void RetentionManager::setBatchSize(size_t files) {
+    std::lock_guard<std::mutex> lock(mutex);
+    batchSize = std::max((size_t)1, files);
+}
+
+
+void RetentionManager::addSegment(const std::string &camId, const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(std::make_pair(camId, path));
+}
+
+
+bool RetentionManager::isSegmentName(const std::string &name, const std::string &prefix,
+                                     const std::string &extension) {
+    // the part after the prefix is exactly "_YYYYMMDD_HHMMSS_mmm"
+    const std::string stamp = "_dddddddd_dddddd_ddd";
+    if (name.size() != prefix.size() + stamp.size() + extension.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - extension.size(), extension.size(), extension) != 0) {
+        return false;
+    }
+
+    for (size_t i = 0; i < stamp.size(); i++) {
+        char c = name[prefix.size() + i];
+        if (stamp[i] == 'd' ? !isdigit((unsigned char)c) : c != stamp[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int64_t RetentionManager::segmentTimeMs(const std::string &path) {
+    // "_YYYYMMDD_HHMMSS_mmm" right before the extension, in local time
+    const std::string stamp = "_dddddddd_dddddd_ddd";
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) ||
+        dot < stamp.size()) {
+        return -1;
+    }
+
+    size_t begin = dot - stamp.size();
+    for (size_t i = 0; i < stamp.size(); i++) {
+        char c = path[begin + i];
+        if (stamp[i] == 'd' ? !isdigit((unsigned char)c) : c != stamp[i]) {
+            return -1;
+        }
+    }
+
+    auto number = [&path, begin](size_t at, size_t digits) {
+        return atoi(path.substr(begin + at, digits).c_str());
+    };
+
+    tm local_tm = tm();
+    local_tm.tm_year = number(1, 4) - 1900;
+    local_tm.tm_mon = number(5, 2) - 1;
+    local_tm.tm_mday = number(7, 2);
+    local_tm.tm_hour = number(10, 2);
+    local_tm.tm_min = number(12, 2);
+    local_tm.tm_sec = number(14, 2);
+    local_tm.tm_isdst = -1;
+
+    time_t t = mktime(&local_tm);
+    if (t == (time_t)-1) {
+        return -1;
+    }
+
+    return (int64_t)t * 1000 + number(17, 3);
+}
+
+
+namespace {
+
+// a segment's place in the deletion order
+int64_t segmentTime(const std::string &path, const struct stat &info) {
+    int64_t named = RetentionManager::segmentTimeMs(path);
+    return named >= 0 ? named : (int64_t)info.st_mtime * 1000;
+}
+
+}   // namespace
+
+
+size_t RetentionManager::scanDirectory(const std::string &camId, const std::string &directory,
+                                       const std::string &prefix, const std::string &extension) {
+    DIR *dir = opendir(directory.empty() ? "." : directory.c_str());
+    if (!dir) {
+        std::cerr << "Failed to open segment directory: " << directory << std::endl;
+        return 0;
+    }
+
+    std::vector<std::string> names;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        std::string name = entry->d_name;
+        if (isSegmentName(name, prefix, extension)) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+
+    std::vector<Segment> found;
+    for (const auto &name : names) {
+        Segment segment;
+        segment.camId = camId;
+        segment.path = directory.empty() ? name : directory + "/" + name;
+
+        struct stat info;
+        if (stat(segment.path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        segment.bytes = info.st_size;
+        segment.timeMs = segmentTime(segment.path, info);
+        found.push_back(segment);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t before = segments.size();
+    track(found);
+
+    return segments.size() - before;
+}
+
+
+// caller holds the mutex
+void RetentionManager::track(const std::vector<Segment> &found) {
+    for (const auto &segment : found) {
+        if (!tracked.insert(segment.path).second) {
+            continue;
+        }
+
+        segments.insert(std::make_pair(segment.timeMs, segment));
+        cameraBytes[segment.camId] += segment.bytes;
+        stats.totalBytes += segment.bytes;
+    }
+    stats.segmentCount = segments.size();
+}
+
+
+void RetentionManager::collectPending() {
+    std::vector<std::pair<std::string, std::string>> closed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed.swap(pending);
+    }
+
+    // size the files outside the lock, writer threads keep adding meanwhile
+    std::vector<Segment> sized;
+    for (const auto &item : closed) {
+        struct stat info;
+        if (stat(item.second.c_str(), &info) != 0) {
+            continue;
+        }
+
+        Segment segment;
+        segment.camId = item.first;
+        segment.path = item.second;
+        segment.bytes = info.st_size;
+        segment.timeMs = segmentTime(segment.path, info);
+        sized.push_back(segment);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    track(sized);
+}
+
+
+bool RetentionManager::overBudget(const Segment &segment) const {
+    if (globalBudget > 0 && stats.totalBytes > globalBudget) {
+        return true;
+    }
+
+    auto budget = cameraBudgets.find(segment.camId);
+    if (budget == cameraBudgets.end() || budget->second == 0) {
+        return false;
+    }
+
+    auto used = cameraBytes.find(segment.camId);
+    return used != cameraBytes.end() && used->second > budget->second;
+}
+
+
+void RetentionManager::enforceBudgets() {
+    std::vector<Segment> victims;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // walk oldest first, taking at most one batch per pass
+        auto it = segments.begin();
+        while (it != segments.end() && victims.size() < batchSize) {
+            const Segment &segment = it->second;
+            if (!overBudget(segment)) {
+                ++it;
+                continue;
+            }
+
+            cameraBytes[segment.camId] -= segment.bytes;
+            stats.totalBytes -= segment.bytes;
+            tracked.erase(segment.path);
+            victims.push_back(segment);
+            it = segments.erase(it);
+        }
+        stats.segmentCount = segments.size();
+        stats.passes++;
+    }
+
+    for (const auto &segment : victims) {
+        if (unlink(segment.path.c_str()) != 0) {
+            std::cerr << "Failed to delete segment: " << segment.path << std::endl;
+            continue;
+        }
+
+        // the frame index goes with its recording, if there is one
+        unlink(FrameIndexReader::indexPathFor(segment.path).c_str());
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.deletedSegments++;
+        stats.deletedBytes += segment.bytes;
+    }
+}
+
+
+void RetentionManager::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (running) {
+        wake.wait_for(lock, std::chrono::milliseconds(intervalMs));
+        if (!running) {
+            break;
+        }
+
+        lock.unlock();
+        collectPending();
+        enforceBudgets();
+        lock.lock();
+    }
+}
+
+
+bool RetentionManager::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        return false;
+    }
+
+    running = true;
+    worker = std::thread(&RetentionManager::workerLoop, this);
+
+    return true;
+}
+
+
+void RetentionManager::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    wake.notify_all();
+
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+
+RetentionStats RetentionManager::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
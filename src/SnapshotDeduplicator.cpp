@@ -0,0 +1,136 @@
+#include <iostream>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+#include "SnapshotDeduplicator.h"
+
+
+namespace {
+
+const int kHashCols = 9;            // 8 comparisons per row
+const int kHashRows = 8;
+const int kSamplesPerAxis = 8;      // per cell, 64 samples per cell
+
+}   // namespace
+
+
+SnapshotDeduplicator::SnapshotDeduplicator(int maxDistance)
+    : maxDistance(maxDistance), hasReference(false), referenceHash(0) {}
+
+
+DedupDecision SnapshotDeduplicator::check(const cv::Mat &frame) const {
+    DedupDecision decision;
+    decision.hash = dHash(frame);
+    decision.distance = hasReference ? distance(decision.hash, referenceHash) : -1;
+    decision.duplicate = maxDistance >= 0 && hasReference && decision.distance <= maxDistance;
+    decision.reference = referencePath;
+
+    return decision;
+}
+
+
+void SnapshotDeduplicator::accept(const DedupDecision &decision, const std::string &path) {
+    hasReference = true;
+    referenceHash = decision.hash;
+    referencePath = path;
+}
+
+
+void SnapshotDeduplicator::reset() {
+    hasReference = false;
+    referenceHash = 0;
+    referencePath.clear();
+}
+
+
+uint64_t SnapshotDeduplicator::dHash(const cv::Mat &frame) {
+    if (frame.empty() || frame.depth() != CV_8U) {
+        return 0;
+    }
+
+    int channels = frame.channels();
+    int cells[kHashRows][kHashCols];
+
+    for (int row = 0; row < kHashRows; row++) {
+        int y0 = row * frame.rows / kHashRows;
+        int y1 = (row + 1) * frame.rows / kHashRows;
+
+        for (int col = 0; col < kHashCols; col++) {
+            int x0 = col * frame.cols / kHashCols;
+            int x1 = (col + 1) * frame.cols / kHashCols;
+
+            // mean luma over a grid of samples centred in the cell
+            int sum = 0;
+            for (int sy = 0; sy < kSamplesPerAxis; sy++) {
+                int y = y0 + (2 * sy + 1) * (y1 - y0) / (2 * kSamplesPerAxis);
+                const uchar *line = frame.ptr<uchar>(std::min(y, frame.rows - 1));
+
+                for (int sx = 0; sx < kSamplesPerAxis; sx++) {
+                    int x = x0 + (2 * sx + 1) * (x1 - x0) / (2 * kSamplesPerAxis);
+                    const uchar *p = line + std::min(x, frame.cols - 1) * channels;
+
+                    // BT.601 weights in 8-bit fixed point, BGR order
+                    sum += channels >= 3 ? (29 * p[0] + 150 * p[1] + 77 * p[2]) >> 8 : p[0];
+                }
+            }
+            cells[row][col] = sum;
+        }
+    }
+
+    uint64_t hash = 0;
+    for (int row = 0; row < kHashRows; row++) {
+        for (int col = 0; col < kHashCols - 1; col++) {
+            hash = (hash << 1) | (cells[row][col] > cells[row][col + 1] ? 1 : 0);
+        }
+    }
+
+    return hash;
+}
+
+
+int SnapshotDeduplicator::distance(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
+
+
+std::string SnapshotDeduplicator::indexLine(int64_t timestampMs, const std::string &path,
+                                            const DedupDecision &decision) {
+    std::stringstream ss;
+    ss << timestampMs << "," << path << "," << (decision.duplicate ? "skipped" : "stored") << ","
+       << std::hex << std::setw(16) << std::setfill('0') << decision.hash << std::dec << ","
+       << decision.distance << "," << (decision.duplicate ? decision.reference : "");
+
+    return ss.str();
+}
+
+
+bool SnapshotDeduplicator::appendIndex(const std::string &indexPath,
+                                       const std::vector<std::string> &lines) {
+    if (lines.empty()) {
+        return true;
+    }
+
+    FILE *file = fopen(indexPath.c_str(), "a");
+    if (!file) {
+        std::cerr << "Failed to open snapshot index: " << indexPath << std::endl;
+        return false;
+    }
+
+    // a new index starts with the column names. where an append stream starts
+    // is up to the C library (musl reports 0), so seek to the end first
+    bool ok = true;
+    if (fseek(file, 0, SEEK_END) == 0 && ftell(file) == 0) {
+        ok = fputs("timestamp_ms,file,status,hash,distance,reference\n", file) >= 0;
+    }
+    for (const auto &line : lines) {
+        ok = ok && fputs(line.c_str(), file) >= 0 && fputc('\n', file) != EOF;
+    }
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok) {
+        std::cerr << "Failed to write snapshot index: " << indexPath << std::endl;
+    }
+
+    return ok;
+}
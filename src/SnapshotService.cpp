@@ -0,0 +1,256 @@
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+
+#include "SnapshotService.h"
+#include "JpegEncoder.h"
+
+
+SnapshotService::SnapshotService(const SnapshotSettings &settings)
+    : settings(settings), running(false) {
+
+    this->settings.queueCapacity = std::max((size_t)1, settings.queueCapacity);
+    if (this->settings.workers <= 0) {
+        this->settings.workers = std::max(1, (int)std::thread::hardware_concurrency() / 2);
+    }
+
+    stats.submitted = 0;
+    stats.written = 0;
+    stats.dropped = 0;
+    stats.failed = 0;
+    stats.bytesWritten = 0;
+    stats.queueDepth = 0;
+    stats.peakQueueDepth = 0;
+}
+
+
+SnapshotService::~SnapshotService() {
+    stop();
+
+    // the workers have drained the queue, every pooled buffer is back
+    for (auto &entry : pools) {
+        imagePoolDestroy(entry.pool);
+    }
+}
+
+
+bool SnapshotService::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        return false;
+    }
+
+    running = true;
+    for (int i = 0; i < settings.workers; i++) {
+        workers.push_back(std::thread(&SnapshotService::workerLoop, this));
+    }
+
+    std::cout << "Snapshot service started with " << settings.workers << " workers" << std::endl;
+
+    return true;
+}
+
+
+void SnapshotService::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    jobReady.notify_all();
+
+    // workers only exit once the queue is empty
+    for (auto &worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+
+bool SnapshotService::isRunning() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return running;
+}
+
+
+bool SnapshotService::submit(const cv::Mat &frame, const std::string &path) {
+    return submit(frame, path, -1, cv::Size(0, 0));
+}
+
+
+bool SnapshotService::submit(const cv::Mat &frame, const std::string &path, int quality,
+                             const cv::Size &maxSize, SnapshotCallback done) {
+    if (frame.empty() || path.empty()) {
+        return false;
+    }
+
+    Job job;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return false;
+        }
+
+        stats.submitted++;
+        if (queue.size() >= settings.queueCapacity) {
+            stats.dropped++;
+            return false;
+        }
+
+        ImagePool *pool = poolFor(frame);
+        if (pool) {
+            job.image = OwnedImage(pool);
+            if (!job.image.valid()) {
+                stats.dropped++;
+                return false;
+            }
+            job.frame = job.image.mat();
+        }
+    }
+
+    // the caller may reuse its frame right away (VideoCapture reads into the
+    // same buffer), so the job gets its own copy. done outside the lock.
+    // copyTo writes into the pooled pixels since the shape already matches
+    frame.copyTo(job.frame);
+    job.path = path;
+    job.quality = quality < 0 ? settings.jpegQuality : quality;
+    job.maxSize = maxSize.area() > 0 ? maxSize : settings.maxSize;
+    job.done = done;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running || queue.size() >= settings.queueCapacity) {
+            stats.dropped++;
+            return false;
+        }
+
+        queue.push_back(std::move(job));
+        stats.queueDepth = queue.size();
+        stats.peakQueueDepth = std::max(stats.peakQueueDepth, queue.size());
+    }
+    jobReady.notify_one();
+
+    return true;
+}
+
+
+void SnapshotService::workerLoop() {
+    // per worker, kept for the whole lifetime of the thread
+    JpegEncoder encoder;
+    cv::Mat scaled;
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        jobReady.wait(lock, [this] { return !running || !queue.empty(); });
+        if (queue.empty()) {
+            break;
+        }
+
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        stats.queueDepth = queue.size();
+        lock.unlock();
+
+        const cv::Mat *source = &job.frame;
+        cv::Size target = fitWithin(job.frame.size(), job.maxSize);
+        if (target != job.frame.size()) {
+            cv::resize(job.frame, scaled, target, 0, 0, cv::INTER_AREA);
+            source = &scaled;
+        }
+
+        bool ok = encoder.encode(*source, job.quality) &&
+                  writeFile(job.path, encoder.data(), encoder.size());
+
+        if (job.done) {
+            job.done(job.path, ok);
+        }
+
+        lock.lock();
+        if (ok) {
+            stats.written++;
+            stats.bytesWritten += encoder.size();
+        }
+        else {
+            stats.failed++;
+        }
+        // job goes out of scope here, its buffer back to the pool
+    }
+}
+
+
+// caller holds the mutex. NULL for frames the pools cannot describe, those
+// are copied to the heap
+ImagePool *SnapshotService::poolFor(const cv::Mat &frame) {
+    if (frame.depth() != CV_8U || frame.channels() > 4) {
+        return nullptr;
+    }
+
+    PixelFormat format = pixelFormatFor(frame);
+    for (const auto &entry : pools) {
+        if (entry.size == frame.size() && entry.format == format) {
+            return entry.pool;
+        }
+    }
+
+    int maxBuffers = (int)settings.queueCapacity + settings.workers;
+    ImagePool *pool = imagePoolCreate(frame.cols, frame.rows, format, 4, maxBuffers);
+    if (!pool) {
+        return nullptr;
+    }
+
+    FramePool entry;
+    entry.size = frame.size();
+    entry.format = format;
+    entry.pool = pool;
+    pools.push_back(entry);
+
+    return pool;
+}
+
+
+bool SnapshotService::writeFile(const std::string &path, const unsigned char *data,
+                                unsigned long size) {
+    std::string temporary = path + ".tmp";
+
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to open snapshot: " << temporary << std::endl;
+        return false;
+    }
+
+    bool ok = fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write snapshot: " << path << std::endl;
+        remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+SnapshotStats SnapshotService::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+
+cv::Size SnapshotService::fitWithin(const cv::Size &frameSize, const cv::Size &maxSize) {
+    if (maxSize.width <= 0 || maxSize.height <= 0 ||
+        (frameSize.width <= maxSize.width && frameSize.height <= maxSize.height)) {
+        return frameSize;
+    }
+
+    double scale = std::min((double)maxSize.width / frameSize.width,
+                            (double)maxSize.height / frameSize.height);
+
+    return cv::Size(std::max(1, (int)std::lround(frameSize.width * scale)),
+                    std::max(1, (int)std::lround(frameSize.height * scale)));
+}
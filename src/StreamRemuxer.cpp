@@ -0,0 +1,390 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+
+#include "StreamRemuxer.h"
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+}
+#endif
+
+
+StreamRemuxer::StreamRemuxer(const std::string &sourceUrl)
+    : sourceUrl(sourceUrl), container("mp4"), running(false) {
+
+    stats.packetsWritten = 0;
+    stats.bytesWritten = 0;
+    stats.keyframes = 0;
+    stats.segments = 0;
+    stats.reconnects = 0;
+}
+
+
+StreamRemuxer::~StreamRemuxer() {
+    stop();
+}
+
+
+bool StreamRemuxer::isSupported() {
+#ifdef HAVE_FFMPEG
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool StreamRemuxer::start(const std::string &directory, const std::string &prefix,
+                          const SegmentSettings &settings, const std::string &container) {
+    if (!isSupported()) {
+        std::cerr << "Remux recording needs FFmpeg, rebuild with libavformat" << std::endl;
+        return false;
+    }
+
+    if (running) {
+        std::cerr << "Remuxer already running for: " << sourceUrl << std::endl;
+        return false;
+    }
+
+    // a previous run that ended on its own still needs joining
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    if (container != "mp4" && container != "mkv") {
+        std::cerr << "Unsupported remux container: " << container << std::endl;
+        return false;
+    }
+
+    this->directory = directory;
+    this->prefix = prefix;
+    this->segmentSettings = settings;
+    this->container = container;
+
+    running = true;
+    worker = std::thread(&StreamRemuxer::remuxLoop, this);
+    std::cout << "Started remux recording of " << sourceUrl << " to: " << directory
+              << "/" << prefix << "_*." << container << std::endl;
+
+    return true;
+}
+
+
+void StreamRemuxer::stop() {
+    if (!worker.joinable()) {
+        return;
+    }
+
+    running = false;
+    worker.join();
+
+    std::cout << "Stopped remux recording of " << sourceUrl << " (" << stats.segments
+              << " segments, " << stats.packetsWritten << " packets)" << std::endl;
+}
+
+
+void StreamRemuxer::remuxLoop() {
+    // reconnect with a growing delay until stopped, cameras drop streams
+    int backoffMs = 500;
+
+    while (running) {
+        if (remuxSession()) {
+            backoffMs = 500;
+        }
+        if (!running) {
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats.reconnects++;
+        }
+
+        auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(backoffMs);
+        while (running && std::chrono::steady_clock::now() < until) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        backoffMs = std::min(backoffMs * 2, 10000);
+    }
+}
+
+
+#ifdef HAVE_FFMPEG
+
+namespace {
+
+// lets a blocking read on a dead RTSP connection notice stop()
+int interruptCallback(void *opaque) {
+    return !static_cast<std::atomic<bool> *>(opaque)->load();
+}
+
+
+struct OutputSegment {
+    AVFormatContext *ctx;
+    std::vector<int> streamMap;     // input stream index -> output index, -1 skipped
+    int64_t origin;                 // dts of the keyframe that opened the segment
+    AVRational originBase;          // the video stream's time base origin is in
+    std::string path;
+
+    OutputSegment() : ctx(nullptr), origin(AV_NOPTS_VALUE), originBase(av_make_q(1, 1)) {}
+};
+
+
+bool openSegment(AVFormatContext *input, OutputSegment &out, const std::string &path,
+                 const std::string &container) {
+    if (avformat_alloc_output_context2(&out.ctx, nullptr,
+                                       container == "mkv" ? "matroska" : "mp4",
+                                       path.c_str()) < 0 || !out.ctx) {
+        std::cerr << "Failed to create output context: " << path << std::endl;
+        return false;
+    }
+
+    out.path = path;
+    out.streamMap.assign(input->nb_streams, -1);
+
+    for (unsigned int i = 0; i < input->nb_streams; i++) {
+        AVCodecParameters *params = input->streams[i]->codecpar;
+        if (params->codec_type != AVMEDIA_TYPE_VIDEO && params->codec_type != AVMEDIA_TYPE_AUDIO) {
+            continue;
+        }
+
+        AVStream *stream = avformat_new_stream(out.ctx, nullptr);
+        if (!stream || avcodec_parameters_copy(stream->codecpar, params) < 0) {
+            return false;
+        }
+        stream->codecpar->codec_tag = 0;    // let the muxer pick its own tag
+        stream->time_base = input->streams[i]->time_base;
+        out.streamMap[i] = stream->index;
+    }
+
+    if (!(out.ctx->oformat->flags & AVFMT_NOFILE) &&
+        avio_open(&out.ctx->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+        std::cerr << "Failed to open segment: " << path << std::endl;
+        return false;
+    }
+
+    if (avformat_write_header(out.ctx, nullptr) < 0) {
+        std::cerr << "Failed to write segment header: " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+// returns true when a finished file was left on disk
+bool closeSegment(OutputSegment &out, bool headerWritten) {
+    if (!out.ctx) {
+        return false;
+    }
+
+    if (headerWritten) {
+        av_write_trailer(out.ctx);
+    }
+    if (!(out.ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&out.ctx->pb);
+    }
+    avformat_free_context(out.ctx);
+    out.ctx = nullptr;
+
+    return headerWritten;
+}
+
+}   // namespace
+
+
+bool StreamRemuxer::remuxSession() {
+    AVFormatContext *input = avformat_alloc_context();
+    input->interrupt_callback.callback = interruptCallback;
+    input->interrupt_callback.opaque = &running;
+
+    AVDictionary *options = nullptr;
+    if (sourceUrl.compare(0, 7, "rtsp://") == 0) {
+        av_dict_set(&options, "rtsp_transport", "tcp", 0);
+#if LIBAVFORMAT_VERSION_MAJOR >= 59
+        av_dict_set(&options, "timeout", "5000000", 0);
+#else
+        av_dict_set(&options, "stimeout", "5000000", 0);
+#endif
+    }
+
+    int ret = avformat_open_input(&input, sourceUrl.c_str(), nullptr, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        std::cerr << "Failed to open stream for remux: " << sourceUrl << std::endl;
+        return false;
+    }
+
+    if (avformat_find_stream_info(input, nullptr) < 0) {
+        std::cerr << "Failed to read stream info: " << sourceUrl << std::endl;
+        avformat_close_input(&input);
+        return false;
+    }
+
+    int videoIndex = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (videoIndex < 0) {
+        std::cerr << "No video stream in: " << sourceUrl << std::endl;
+        avformat_close_input(&input);
+        return false;
+    }
+
+    // raw elementary streams (a bare .h264 file) carry no timestamps, they are
+    // synthesised from the frame rate
+    AVStream *video = input->streams[videoIndex];
+    AVRational frameRate = av_guess_frame_rate(input, video, nullptr);
+    if (frameRate.num <= 0 || frameRate.den <= 0) {
+        frameRate = av_make_q(25, 1);
+    }
+    int64_t frameDuration = av_rescale_q(1, av_inv_q(frameRate), video->time_base);
+    int64_t syntheticPts = 0;
+
+    OutputSegment out;
+    bool headerWritten = false;
+    bool delivered = false;
+    auto segmentStart = std::chrono::steady_clock::now();
+    int64_t segmentBytes = 0;
+    AVPacket *packet = av_packet_alloc();
+
+    while (running && (ret = av_read_frame(input, packet)) >= 0) {
+        int in = packet->stream_index;
+        bool keyframe = in == videoIndex && (packet->flags & AV_PKT_FLAG_KEY);
+
+        if (in == videoIndex && packet->pts == AV_NOPTS_VALUE) {
+            packet->pts = packet->dts = syntheticPts;
+            packet->duration = frameDuration;
+            syntheticPts += frameDuration;
+        }
+
+        // segments start on a video keyframe, and so does the first one
+        bool rotate = false;
+        if (keyframe && headerWritten) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now() - segmentStart);
+            rotate = (segmentSettings.segmentSeconds > 0 &&
+                      elapsed.count() >= segmentSettings.segmentSeconds) ||
+                     (segmentSettings.segmentBytes > 0 &&
+                      (uint64_t)segmentBytes >= segmentSettings.segmentBytes);
+        }
+
+        if (rotate || (keyframe && !out.ctx)) {
+            std::string closedPath = out.path;
+            if (closeSegment(out, headerWritten) && fileClosedCallback) {
+                fileClosedCallback(closedPath);
+            }
+            headerWritten = false;
+
+            std::string path = VideoRecorder::timestampedPath(directory, prefix, "." + container);
+            if (!openSegment(input, out, path, container)) {
+                closeSegment(out, false);
+                av_packet_unref(packet);
+                break;
+            }
+            headerWritten = true;
+            out.origin = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+            out.originBase = video->time_base;
+            segmentStart = std::chrono::steady_clock::now();
+            segmentBytes = 0;
+
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats.segments++;
+            outputPath = path;
+        }
+
+        if (!out.ctx || out.streamMap[in] < 0) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        // shift every stream by the same instant, the keyframe that opened
+        // the segment, so audio keeps its place against the video. then
+        // convert to the time base the muxer settled on
+        AVRational inBase = input->streams[in]->time_base;
+        int64_t shift = av_rescale_q(out.origin, out.originBase, inBase);
+        int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+        if (dts != AV_NOPTS_VALUE && dts < shift) {
+            // audio read just after the keyframe but timed before it
+            // belongs to the previous segment
+            av_packet_unref(packet);
+            continue;
+        }
+        if (packet->pts != AV_NOPTS_VALUE) {
+            packet->pts -= shift;
+        }
+        if (packet->dts != AV_NOPTS_VALUE) {
+            packet->dts -= shift;
+        }
+
+        AVStream *outStream = out.ctx->streams[out.streamMap[in]];
+        av_packet_rescale_ts(packet, inBase, outStream->time_base);
+        packet->stream_index = outStream->index;
+        packet->pos = -1;
+
+        int size = packet->size;
+        if (av_interleaved_write_frame(out.ctx, packet) < 0) {
+            std::cerr << "Failed to write packet to: " << out.path << std::endl;
+            break;
+        }
+        segmentBytes += size;
+        delivered = true;
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.packetsWritten++;
+        stats.bytesWritten += size;
+        if (keyframe) {
+            stats.keyframes++;
+        }
+    }
+
+    std::string closedPath = out.path;
+    if (closeSegment(out, headerWritten) && fileClosedCallback) {
+        fileClosedCallback(closedPath);
+    }
+
+    av_packet_free(&packet);
+    avformat_close_input(&input);
+
+    // a local file standing in for a camera ends instead of reconnecting
+    if (ret == AVERROR_EOF && sourceUrl.find("://") == std::string::npos) {
+        running = false;
+    }
+
+    return delivered;
+}
+
+#else
+
+bool StreamRemuxer::remuxSession() {
+    running = false;
+    return false;
+}
+
+#endif
+
+
+void StreamRemuxer::setFileClosedCallback(const std::function<void(const std::string &)> &callback) {
+    if (running) {
+        std::cerr << "File callback must be set before the remuxer starts" << std::endl;
+        return;
+    }
+    fileClosedCallback = callback;
+}
+
+
+bool StreamRemuxer::isRunning() const {
+    return running;
+}
+
+
+std::string StreamRemuxer::getOutputPath() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return outputPath;
+}
+
+
+RemuxStats StreamRemuxer::getStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
@@ -0,0 +1,267 @@
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <unistd.h>
+
+#include "StripPipeline.h"
+
+
+namespace {
+
+// below this the halo rows, converted and blurred twice, cost more than the
+// cache saves
+const int kMinStripRows = 64;
+
+// gray, blurred, delta and dilated bytes kept per strip row
+const int kStripBytesPerPixel = 4;
+
+// threads per pipeline when none are asked for, the caller and one helper
+const int kDefaultWorkers = 2;
+
+}   // namespace
+
+
+StripPipeline::StripPipeline(const StripPipelineSettings &settings)
+    : settings(settings), blurMethod(BlurMethod::GAUSSIAN), frame(nullptr), reference(nullptr),
+      mask(nullptr), threshold(25), stripRows(0), strips(0), nextStrip(0), stripsRemaining(0),
+      generation(0), stopping(false) {
+
+    this->settings.blurSize = std::max(1, settings.blurSize | 1);
+    this->settings.dilateSize = std::max(1, settings.dilateSize);
+    this->settings.dilateIterations = std::max(0, settings.dilateIterations);
+
+    workerCount = settings.workers > 0 ? settings.workers : kDefaultWorkers;
+    scratch.resize(workerCount);
+
+    dilateKernel = cv::getStructuringElement(cv::MORPH_RECT,
+                                             cv::Size(this->settings.dilateSize, this->settings.dilateSize));
+
+    stats.frames = 0;
+    stats.strips = 0;
+    stats.stripRows = 0;
+    stats.haloOverhead = 0.0;
+    stats.lastMs = 0.0;
+    stats.avgMs = 0.0;
+}
+
+
+StripPipeline::~StripPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        stopping = true;
+    }
+    workCv.notify_all();
+
+    for (auto &worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+
+int StripPipeline::blurHalo() const {
+    int halo = settings.blurSize / 2;
+
+    // the recursive and box blurs reach further than the kernel they stand
+    // in for, 3 sigma covers all but a fraction of a grey level
+    if (blurMethod != BlurMethod::GAUSSIAN) {
+        double sigma = 0.3 * ((settings.blurSize - 1) * 0.5 - 1) + 0.8;
+        halo = std::max(halo, (int)std::ceil(3 * sigma));
+    }
+
+    return halo;
+}
+
+
+int StripPipeline::dilateHalo() const {
+    return settings.dilateIterations * (settings.dilateSize / 2);
+}
+
+
+void StripPipeline::startWorkers() {
+    // scratch[0] belongs to the calling thread
+    for (int i = 1; i < workerCount; i++) {
+        workers.push_back(std::thread(&StripPipeline::workerLoop, this, i));
+    }
+}
+
+
+void StripPipeline::workerLoop(int index) {
+    uint64_t seenGeneration = 0;
+
+    std::unique_lock<std::mutex> lock(poolMutex);
+    while (true) {
+        workCv.wait(lock, [&] { return stopping || generation != seenGeneration; });
+        if (stopping) {
+            return;
+        }
+        seenGeneration = generation;
+
+        lock.unlock();
+        runStrips(scratch[index]);
+        lock.lock();
+    }
+}
+
+
+void StripPipeline::runStrips(Scratch &local) {
+    std::unique_lock<std::mutex> lock(poolMutex);
+    while (nextStrip < strips) {
+        int strip = nextStrip++;
+
+        lock.unlock();
+        processStrip(strip, local);
+        lock.lock();
+
+        if (--stripsRemaining == 0) {
+            doneCv.notify_all();
+        }
+    }
+}
+
+
+void StripPipeline::processStrip(int strip, Scratch &local) {
+    int rows = frame->rows;
+    int cols = frame->cols;
+
+    // output rows, rows the dilation reads, rows the blur reads
+    int y0 = strip * stripRows;
+    int y1 = std::min(rows, y0 + stripRows);
+    int t0 = std::max(0, y0 - dilateHalo());
+    int t1 = std::min(rows, y1 + dilateHalo());
+    int g0 = std::max(0, t0 - blurHalo());
+    int g1 = std::min(rows, t1 + blurHalo());
+
+    // rows past the ends of the local buffers get extrapolated, not the
+    // real neighbours, but they fall in the halo and are thrown away. at the
+    // top and bottom of the frame the extrapolation is the full-frame one
+    cv::Mat src = (*frame)(cv::Rect(0, g0, cols, g1 - g0));
+    if (src.channels() == 3) {
+        cv::cvtColor(src, local.gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        src.copyTo(local.gray);
+    }
+
+    local.blur.setMethod(blurMethod);
+    local.blur.blur(local.gray, local.blurred, settings.blurSize);
+
+    cv::Mat blurredRows = local.blurred(cv::Rect(0, t0 - g0, cols, t1 - t0));
+    cv::absdiff((*reference)(cv::Rect(0, t0, cols, t1 - t0)), blurredRows, local.delta);
+    cv::threshold(local.delta, local.delta, threshold, 255, cv::THRESH_BINARY);
+    cv::dilate(local.delta, local.dilated, dilateKernel, cv::Point(-1, -1), settings.dilateIterations);
+
+    cv::Rect out(0, y0, cols, y1 - y0);
+    cv::Mat maskRows = (*mask)(out);
+    cv::Mat nextRows = next(out);
+    local.dilated(cv::Rect(0, y0 - t0, cols, y1 - y0)).copyTo(maskRows);
+    local.blurred(cv::Rect(0, y0 - g0, cols, y1 - y0)).copyTo(nextRows);
+}
+
+
+void StripPipeline::process(const cv::Mat &frame, cv::Mat &reference, cv::Mat &mask,
+                            int threshold) {
+    std::lock_guard<std::mutex> runLock(runMutex);
+    auto t0 = std::chrono::steady_clock::now();
+
+    if (frame.empty() || reference.size() != frame.size() || reference.type() != CV_8UC1) {
+        std::cerr << "Strip pipeline needs a reference of the frame's size" << std::endl;
+        mask = cv::Mat::zeros(frame.size(), CV_8UC1);
+        return;
+    }
+
+    // strips read the old reference in their halo while others write the
+    // new one, so it goes to a second buffer that is swapped in at the end
+    mask.create(frame.size(), CV_8UC1);
+    next.create(frame.size(), CV_8UC1);
+
+    this->frame = &frame;
+    this->reference = &reference;
+    this->mask = &mask;
+    this->threshold = threshold;
+
+    int halo = blurHalo() + dilateHalo();
+    stripRows = settings.stripRows > 0 ? settings.stripRows
+                                       : stripRowsFor(frame.cols, halo, l2CacheBytes());
+    stripRows = std::min(stripRows, frame.rows);
+    strips = (frame.rows + stripRows - 1) / stripRows;
+
+    if (workerCount > 1 && strips > 1) {
+        if (workers.empty()) {
+            startWorkers();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(poolMutex);
+            nextStrip = 0;
+            stripsRemaining = strips;
+            generation++;
+        }
+        workCv.notify_all();
+
+        runStrips(scratch[0]);
+
+        std::unique_lock<std::mutex> lock(poolMutex);
+        doneCv.wait(lock, [this] { return stripsRemaining == 0; });
+    }
+    else {
+        for (int strip = 0; strip < strips; strip++) {
+            processStrip(strip, scratch[0]);
+        }
+    }
+
+    std::swap(reference, next);
+    this->frame = nullptr;
+    this->reference = nullptr;
+    this->mask = nullptr;
+
+    // rows converted and blurred beyond the frame's own
+    long blurredRows = 0;
+    for (int strip = 0; strip < strips; strip++) {
+        int y0 = strip * stripRows;
+        int y1 = std::min(frame.rows, y0 + stripRows);
+        blurredRows += std::min(frame.rows, y1 + halo) - std::max(0, y0 - halo);
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.frames++;
+    stats.strips = strips;
+    stats.stripRows = stripRows;
+    stats.haloOverhead = (double)blurredRows / frame.rows - 1.0;
+    stats.lastMs = ms;
+    stats.avgMs = stats.frames == 1 ? ms : 0.9 * stats.avgMs + 0.1 * ms;
+}
+
+
+void StripPipeline::setBlurMethod(BlurMethod method) {
+    std::lock_guard<std::mutex> runLock(runMutex);
+    blurMethod = method;
+}
+
+
+StripPipelineStats StripPipeline::getStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
+
+
+int StripPipeline::stripRowsFor(int width, int halo, size_t cacheBytes) {
+    size_t rowBytes = (size_t)std::max(1, width) * kStripBytesPerPixel;
+    int rows = (int)(cacheBytes / rowBytes) - 2 * halo;
+
+    return std::max(kMinStripRows, rows);
+}
+
+
+size_t StripPipeline::l2CacheBytes() {
+    long size = -1;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+
+    // per core on most parts, assume 1 MB when the system will not say
+    return size > 0 ? (size_t)size : (size_t)1 << 20;
+}
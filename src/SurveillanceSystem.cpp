@@ -2,9 +2,10 @@
 #include <chrono>
 
 #include "SurveillanceSystem.h"
+#include "IPCamera.h"
 
 
-SurveillanceSystem::SurveillanceSystem() : running(false) {}
+SurveillanceSystem::SurveillanceSystem() : liveViewEnabled(false), running(false) {}
 
 
 SurveillanceSystem::~SurveillanceSystem() {
@@ -42,6 +43,15 @@ bool SurveillanceSystem::removeCamera(const std::string &id) {
 
     // remove from recorders
     videoRecorders.erase(id);
+    remuxers.erase(id);
+
+    activityGovernors.erase(id);
+    eventRecorders.erase(id);
+    denoisers.erase(id);
+    motionSnapshots.erase(id);
+    if (timelapse) {
+        timelapse->removeCamera(id);
+    }
 
     // remove from camera manager
     return camManager.removeCamera(id);
@@ -58,6 +68,9 @@ bool SurveillanceSystem::enableMotionDetection(const std::string &camId, int thr
     auto it = motionDetectors.find(camId);
     if (it != motionDetectors.end()) {
         it->second.setThreshold(threshold);
+        if (batchEngine) {
+            batchEngine->setThreshold(camId, threshold);
+        }
         std::cout << "Motion detection enabled for camera: " << camId << std::endl;
         return true;
     }
@@ -77,6 +90,198 @@ bool SurveillanceSystem::disableMotionDetection(const std::string &camId) {
 }
 
 
+bool SurveillanceSystem::setMotionZones(const std::string &camId,
+                                        const std::vector<MotionZone> &zones) {
+    auto it = motionDetectors.find(camId);
+    if (it == motionDetectors.end()) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    // the monitor thread uses the detector without a lock
+    if (running) {
+        std::cerr << "Motion zones must be set before start()" << std::endl;
+        return false;
+    }
+
+    it->second.setZones(zones);
+    std::cout << "Motion zones set for camera: " << camId << " (" << zones.size()
+              << " zones)" << std::endl;
+
+    return true;
+}
+
+
+bool SurveillanceSystem::setMotionBlur(const std::string &camId, BlurMethod method) {
+    auto it = motionDetectors.find(camId);
+    if (it == motionDetectors.end()) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    // the monitor thread uses the detector without a lock
+    if (running) {
+        std::cerr << "Motion blur must be set before start()" << std::endl;
+        return false;
+    }
+
+    it->second.setBlurMethod(method);
+    std::cout << "Motion blur for camera " << camId << ": "
+              << BlurEngine::methodName(method) << std::endl;
+
+    return true;
+}
+
+
+bool SurveillanceSystem::enableStripPipeline(const std::string &camId, int workers) {
+    auto it = motionDetectors.find(camId);
+    if (it == motionDetectors.end()) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    // the monitor thread uses the detector without a lock
+    if (running) {
+        std::cerr << "Strip pipeline must be enabled before start()" << std::endl;
+        return false;
+    }
+
+    it->second.enableStripPipeline(workers);
+    std::cout << "Strip pipeline enabled for camera: " << camId << std::endl;
+
+    return true;
+}
+
+
+bool SurveillanceSystem::enableObjectTracking(const std::string &camId, int keyframeInterval) {
+    auto it = motionDetectors.find(camId);
+    if (it == motionDetectors.end()) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    // the monitor thread uses the detector without a lock
+    if (running) {
+        std::cerr << "Object tracking must be enabled before start()" << std::endl;
+        return false;
+    }
+
+    it->second.enableTracking(keyframeInterval);
+    std::cout << "Object tracking enabled for camera: " << camId
+              << " (keyframe every " << keyframeInterval << " frames)" << std::endl;
+
+    return true;
+}
+
+
+bool SurveillanceSystem::enableTemporalDenoise(const std::string &camId,
+                                               const TemporalDenoiseSettings &settings) {
+    auto cam = camManager.getCamera(camId);
+    if (!cam) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    if (running) {
+        std::cerr << "Temporal denoise must be enabled before start()" << std::endl;
+        return false;
+    }
+
+    denoisers[camId].reset(new TemporalDenoiser(settings));
+    std::cout << "Temporal denoise enabled for camera: " << camId << " (strength "
+              << settings.strength << ", threshold " << settings.noiseThreshold << ")" << std::endl;
+
+    return true;
+}
+
+
+bool SurveillanceSystem::disableTemporalDenoise(const std::string &camId) {
+    if (running) {
+        std::cerr << "Temporal denoise cannot be disabled while running" << std::endl;
+        return false;
+    }
+
+    return denoisers.erase(camId) > 0;
+}
+
+
+bool SurveillanceSystem::getDenoiseStats(const std::string &camId, TemporalDenoiseStats &stats) const {
+    auto it = denoisers.find(camId);
+    if (it == denoisers.end()) {
+        return false;
+    }
+
+    stats = it->second->getStats();
+    return true;
+}
+
+
+bool SurveillanceSystem::enableBatchMotion(const cv::Size &analysisSize, int workers) {
+    if (running) {
+        std::cerr << "Batch motion must be enabled before start" << std::endl;
+        return false;
+    }
+
+    batchEngine.reset(new BatchMotionEngine(analysisSize, workers));
+    std::cout << "Batch motion analysis enabled" << std::endl;
+
+    return true;
+}
+
+
+BatchMotionStats SurveillanceSystem::getBatchMotionStats() const {
+    if (batchEngine) {
+        return batchEngine->getStats();
+    }
+
+    return BatchMotionStats();
+}
+
+
+bool SurveillanceSystem::enableActivityGovernor(const std::string &camId,
+                                                const ActivitySettings &settings) {
+    auto cam = camManager.getCamera(camId);
+    if (!cam) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    // the monitor threads hold pointers into the map
+    if (running) {
+        std::cerr << "Activity governor must be enabled before start()" << std::endl;
+        return false;
+    }
+
+    activityGovernors[camId].reset(new ActivityGovernor(settings));
+    std::cout << "Activity governor enabled for camera: " << camId << " ("
+              << settings.activeFps << " fps active, " << settings.idleFps
+              << " fps idle)" << std::endl;
+
+    return true;
+}
+
+
+bool SurveillanceSystem::disableActivityGovernor(const std::string &camId) {
+    if (running) {
+        std::cerr << "Activity governor cannot be disabled while running" << std::endl;
+        return false;
+    }
+
+    return activityGovernors.erase(camId) > 0;
+}
+
+
+bool SurveillanceSystem::getActivityStats(const std::string &camId, ActivityStats &stats) const {
+    auto it = activityGovernors.find(camId);
+    if (it == activityGovernors.end()) {
+        return false;
+    }
+
+    stats = it->second->getStats();
+    return true;
+}
+
+
 bool SurveillanceSystem::startRecording(const std::string &camId, const std::string &filename) {
     auto cam = camManager.getCamera(camId);
     if (!cam) {
@@ -84,24 +289,281 @@ bool SurveillanceSystem::startRecording(const std::string &camId, const std::str
         return false;
     }
 
-    // create or get recorder
-    if (videoRecorders.find(camId) == videoRecorders.end()) {
-        videoRecorders[camId] = VideoRecorder();
+    // create or get recorder. recorders own a writer thread and are built in place
+    VideoRecorder &recorder = videoRecorders[camId];
+
+    // record in the format the camera actually delivers. before the camera
+    // is connected the recorder takes it from the first frame
+    return recorder.startRecording(filename, cam->getStreamFormat());
+}
+
+
+bool SurveillanceSystem::setRecorderBackend(const std::string &camId, RecorderBackend backend,
+                                            const MjpegWriterSettings &settings) {
+    auto cam = camManager.getCamera(camId);
+    if (!cam) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    VideoRecorder &recorder = videoRecorders[camId];
+    if (recorder.getRecordingStatus()) {
+        std::cerr << "Recorder backend cannot change while recording: " << camId << std::endl;
+        return false;
+    }
+
+    recorder.setBackend(backend, settings);
+    return true;
+}
+
+
+bool SurveillanceSystem::startSegmentedRecording(const std::string &camId, const std::string &directory,
+                                                 const SegmentSettings &settings) {
+    auto cam = camManager.getCamera(camId);
+    if (!cam) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    VideoRecorder &recorder = videoRecorders[camId];
+    if (retention && !recorder.getRecordingStatus()) {
+        // pick up segments from earlier runs so they count against the budget
+        retention->scanDirectory(camId, directory, camId);
+
+        RetentionManager *manager = retention.get();
+        recorder.setFileClosedCallback([manager, camId](const std::string &path) {
+            manager->addSegment(camId, path);
+        });
+    }
+
+    return recorder.startSegmentedRecording(directory, camId, cam->getStreamFormat(), settings);
+}
+
+
+bool SurveillanceSystem::startRemuxRecording(const std::string &camId, const std::string &directory,
+                                             const SegmentSettings &settings,
+                                             const std::string &container) {
+    auto cam = camManager.getCamera(camId);
+    if (!cam) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    auto ipCam = std::dynamic_pointer_cast<IPCamera>(cam);
+    if (!ipCam) {
+        std::cerr << "Remux recording needs an IP camera: " << camId << std::endl;
+        return false;
+    }
+
+    // the remuxer opens its own session to the camera, the decoded stream
+    // used for motion detection is left alone
+    std::unique_ptr<StreamRemuxer> &remuxer = remuxers[camId];
+    if (remuxer && remuxer->isRunning()) {
+        std::cerr << "Already recording. Stop current recording first." << std::endl;
+        return false;
+    }
+    remuxer.reset(new StreamRemuxer(ipCam->getStreamUrl()));
+
+    if (retention) {
+        retention->scanDirectory(camId, directory, camId, "." + container);
+
+        RetentionManager *manager = retention.get();
+        remuxer->setFileClosedCallback([manager, camId](const std::string &path) {
+            manager->addSegment(camId, path);
+        });
+    }
+
+    return remuxer->start(directory, camId, settings, container);
+}
+
+
+bool SurveillanceSystem::enableRetention(uint64_t globalBudgetBytes) {
+    if (retention) {
+        retention->setGlobalBudget(globalBudgetBytes);
+        return true;
+    }
+
+    retention.reset(new RetentionManager(globalBudgetBytes));
+    retention->start();
+    std::cout << "Retention enabled (global budget " << globalBudgetBytes / (1024 * 1024)
+              << " MB)" << std::endl;
+
+    return true;
+}
+
+
+bool SurveillanceSystem::setCameraDiskBudget(const std::string &camId, uint64_t bytes) {
+    if (!retention) {
+        std::cerr << "Retention is not enabled" << std::endl;
+        return false;
+    }
+
+    retention->setCameraBudget(camId, bytes);
+    return true;
+}
+
+
+bool SurveillanceSystem::getRetentionStats(RetentionStats &stats) const {
+    if (!retention) {
+        return false;
+    }
+
+    stats = retention->getStats();
+    return true;
+}
+
+
+bool SurveillanceSystem::getRecorderStats(const std::string &camId, RecorderStats &stats) const {
+    auto it = videoRecorders.find(camId);
+    if (it == videoRecorders.end()) {
+        return false;
+    }
+
+    stats = it->second.getStats();
+    return true;
+}
+
+
+bool SurveillanceSystem::enableEventRecording(const std::string &camId, const std::string &outputDir,
+                                              const EventRecordingSettings &settings) {
+    auto cam = camManager.getCamera(camId);
+    if (!cam) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    if (running) {
+        std::cerr << "Event recording must be enabled before start()" << std::endl;
+        return false;
+    }
+
+    eventRecorders[camId].reset(new EventRecorder(camId, outputDir, settings));
+    std::cout << "Event recording enabled for camera: " << camId << " ("
+              << settings.preRollMs / 1000.0 << " s pre-roll, "
+              << settings.postRollMs / 1000.0 << " s post-roll)" << std::endl;
+
+    return true;
+}
+
+
+bool SurveillanceSystem::disableEventRecording(const std::string &camId) {
+    if (running) {
+        std::cerr << "Event recording cannot be disabled while running" << std::endl;
+        return false;
+    }
+    return eventRecorders.erase(camId) > 0;
+}
+
+
+bool SurveillanceSystem::enableMotionSnapshots(const std::string &camId, const std::string &outputDir,
+                                               const MotionSnapshotSettings &settings) {
+    auto cam = camManager.getCamera(camId);
+    if (!cam) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    if (running) {
+        std::cerr << "Motion snapshots must be enabled before start()" << std::endl;
+        return false;
+    }
+
+    // one service shared by all cameras, started with the system
+    if (!snapshots) {
+        snapshots.reset(new SnapshotService());
+    }
+
+    MotionSnapshotTarget &target = motionSnapshots[camId];
+    target.directory = outputDir;
+    target.settings = settings;
+
+    std::cout << "Motion snapshots enabled for camera: " << camId << " -> " << outputDir << std::endl;
+
+    return true;
+}
+
+
+bool SurveillanceSystem::disableMotionSnapshots(const std::string &camId) {
+    if (running) {
+        std::cerr << "Motion snapshots cannot be disabled while running" << std::endl;
+        return false;
+    }
+    return motionSnapshots.erase(camId) > 0;
+}
+
+
+bool SurveillanceSystem::getSnapshotStats(SnapshotStats &stats) const {
+    if (!snapshots) {
+        return false;
+    }
+
+    stats = snapshots->getStats();
+    return true;
+}
+
+
+bool SurveillanceSystem::enableTimelapse(const std::string &camId, const std::string &outputDir,
+                                         const TimelapseSettings &settings) {
+    auto cam = camManager.getCamera(camId);
+    if (!cam) {
+        std::cerr << "Camera not found: " << camId << std::endl;
+        return false;
+    }
+
+    if (running) {
+        std::cerr << "Timelapse must be enabled before start()" << std::endl;
+        return false;
+    }
+
+    // encodes go through the same snapshot pool as motion thumbnails
+    if (!snapshots) {
+        snapshots.reset(new SnapshotService());
+    }
+    if (!timelapse) {
+        timelapse.reset(new TimelapseScheduler(*snapshots));
+    }
+
+    if (!timelapse->addCamera(camId, outputDir, settings)) {
+        return false;
     }
 
-    // get frame size from camera (use default if not available)
-    cv::Size frameSize(640, 480);
+    std::cout << "Timelapse enabled for camera: " << camId << " (every "
+              << settings.intervalMs / 1000.0 << " s) -> " << outputDir << std::endl;
 
-    return videoRecorders[camId].startRecording(filename, 30, frameSize);
+    return true;
+}
+
+
+bool SurveillanceSystem::disableTimelapse(const std::string &camId) {
+    if (!timelapse) {
+        return false;
+    }
+    return timelapse->removeCamera(camId);
+}
+
+
+bool SurveillanceSystem::getTimelapseStats(const std::string &camId, TimelapseStats &stats) const {
+    if (!timelapse) {
+        return false;
+    }
+    return timelapse->getStats(camId, stats);
 }
 
 
 bool SurveillanceSystem::stopRecording(const std::string &camId) {
+    bool stopped = false;
+
+    auto remuxItem = remuxers.find(camId);
+    if (remuxItem != remuxers.end()) {
+        remuxItem->second->stop();
+        stopped = true;
+    }
+
     auto it = videoRecorders.find(camId);
     if (it != videoRecorders.end()) {
-        return it->second.stopRecording();
+        stopped = it->second.stopRecording() || stopped;
     }
-    return false;
+    return stopped;
 }
 
 
@@ -118,7 +580,25 @@ void SurveillanceSystem::monitorCamera(const std::string &camId) {
 
     std::cout << "Monitoring started for camera: " << camId << std::endl;
 
+    uint64_t lastBatchSeq = 0;
+
+    // the stream's own rate is never changed, an idle camera is only read
+    // more slowly where the source allows it
+    int streamFps = std::max(1, cam->getFPS());
+    int captureFps = streamFps;
+
+    auto snapshotItem = motionSnapshots.find(camId);
+    const MotionSnapshotTarget *snapshotTarget = snapshotItem != motionSnapshots.end()
+                                               ? &snapshotItem->second : nullptr;
+    auto lastSnapshot = std::chrono::steady_clock::time_point();
+
+    auto denoiserItem = denoisers.find(camId);
+    TemporalDenoiser *denoiser = denoiserItem != denoisers.end() ? denoiserItem->second.get() : nullptr;
+    std::vector<cv::Rect> lastMotion;   // boxes fresh from the previous frame, kept sharp by the denoiser
+
     while (running) {
+        auto loopStart = std::chrono::steady_clock::now();
+
         // capture frame
         if (!cam->captureFrame()) {
             std::cerr << "Failed to capture frame from: " << camId << std::endl;
@@ -126,8 +606,19 @@ void SurveillanceSystem::monitorCamera(const std::string &camId) {
             continue;
         }
 
-        // run 3A tuning
-        cam->run3ATuning();
+        // the governor decides whether this frame gets analysed at all
+        auto governorItem = activityGovernors.find(camId);
+        ActivityGovernor *governor = governorItem != activityGovernors.end()
+                                   ? governorItem->second.get() : nullptr;
+        bool analyse = !governor || governor->shouldAnalyse();
+
+        // run 3A tuning, at a reduced cadence while idle
+        if (analyse && (!governor || governor->shouldRun3A())) {
+            cam->run3ATuning();
+        }
+        else {
+            cam->apply3ASettings();
+        }
 
         // get current frame
         cv::Mat frame = cam->getFrame();
@@ -135,37 +626,170 @@ void SurveillanceSystem::monitorCamera(const std::string &camId) {
             continue;
         }
 
+        // denoise before anything looks at the frame, so motion detection,
+        // snapshots and the encoder all see the cleaned frame
+        if (denoiser) {
+            denoiser->process(frame, lastMotion);
+        }
+
+        // boxes only count for the frame they were found on. a skipped frame,
+        // or one without a new batch result, has none
+        lastMotion.clear();
+
+        // timelapse takes its frame before anything is drawn on it
+        if (timelapse) {
+            timelapse->offerFrame(camId, frame);
+        }
+
+        auto recorderItem = videoRecorders.find(camId);
+        bool recording = recorderItem != videoRecorders.end() &&
+                         recorderItem->second.getRecordingStatus();
+
+        auto eventItem = eventRecorders.find(camId);
+        EventRecorder *eventRecorder = eventItem != eventRecorders.end()
+                                     ? eventItem->second.get() : nullptr;
+
         // check for motion
-        auto motionItem = motionDetectors.find(camId);
-        if (motionItem != motionDetectors.end()) {
-            bool motionDetected = motionItem->second.detectMotion(frame);
+        bool motionDetected = false;
+        auto motionItem = motionDetectors.end();
+        if (analyse) {
+            motionItem = motionDetectors.find(camId);
+        }
 
-            if (motionDetected) {
-                std::cout << "Motion detected on camera: " << camId << std::endl;
+        if (motionItem != motionDetectors.end() && batchEngine && batchEngine->hasCamera(camId)) {
+            // hand the frame to the batch engine, pick up the last finished result
+            batchEngine->submitFrame(camId, frame);
 
-                // get motion region
-                auto regions = motionItem->second.getMotionRegions(frame);
+            BatchMotionResult result;
+            if (batchEngine->getResult(camId, result) && result.frameSeq != lastBatchSeq) {
+                lastBatchSeq = result.frameSeq;
+                motionDetected = result.motionDetected;
+                lastMotion = result.regions;
+
+                if (result.motionDetected) {
+                    std::cout << "Motion detected on camera: " << camId << std::endl;
+
+                    for (const auto &rect : result.regions) {
+                        cv::rectangle(frame, rect, cv::Scalar(0, 255, 0), 2);
+                    }
+                }
+            }
+        }
+        else if (motionItem != motionDetectors.end() && motionItem->second.isTrackingEnabled()) {
+            // persistent object IDs, full detection only on keyframes
+            auto objects = motionItem->second.trackMotion(frame);
+            motionDetected = !objects.empty();
+
+            for (const auto &obj : objects) {
+                lastMotion.push_back(obj.bbox);
+            }
+
+            if (!objects.empty()) {
+                std::cout << "Motion detected on camera: " << camId
+                          << " (" << objects.size() << " objects)" << std::endl;
+
+                for (const auto &obj : objects) {
+                    cv::rectangle(frame, obj.bbox, cv::Scalar(0, 255, 0), 2);
+                    cv::putText(frame, "#" + std::to_string(obj.id), obj.bbox.tl() + cv::Point(0, -4),
+                                cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 1);
+                }
+            }
+        }
+        else if (motionItem != motionDetectors.end()) {
+            // one pass gives both the decision and the regions. calling
+            // detectMotion first would consume the reference frame and leave
+            // getMotionRegions comparing the frame against itself
+            auto regions = motionItem->second.getMotionRegions(frame);
+            motionDetected = !regions.empty();
+            lastMotion = regions;
+
+            if (!regions.empty()) {
+                std::cout << "Motion detected on camera: " << camId << std::endl;
 
                 // draw bounding box on frame
                 for (const auto &rect : regions) {
-                    cv::rectangle(frame, rect, cv::Scalar(0, 255, 0), 2);                    
-                }                
+                    cv::rectangle(frame, rect, cv::Scalar(0, 255, 0), 2);
+                }
             }
         }
 
-        // record frame if recording is active
-        auto recorderItem = videoRecorders.find(camId);
-        if (recorderItem != videoRecorders.end() && recorderItem->second.getRecordingStatus()) {
-            recorderItem->second.writeFrame(frame);
+        if (governor && analyse && governor->reportMotion(motionDetected)) {
+            std::cout << "Camera " << camId << " is now "
+                      << (governor->getState() == ActivityState::ACTIVE ? "active" : "idle")
+                      << std::endl;
         }
 
-        // small delay to control frame rate
-        std::this_thread::sleep_for(std::chrono::milliseconds(33));
+        if (governor) {
+            // a recording needs every frame, so capture only slows down while
+            // nothing is recorded. a source that cannot slow down is read at
+            // full rate and only analysis is throttled, or its frames back up
+            bool recordingEvent = eventRecorder && eventRecorder->isRecording();
+            int wantedFps = recording || recordingEvent ? streamFps
+                                                        : std::min(streamFps, governor->getTargetFps());
+            if (wantedFps != captureFps) {
+                captureFps = cam->setCaptureRate(wantedFps) ? wantedFps : streamFps;
+            }
+        }
+
+        // motion thumbnail, only copied here, encoded and written by the service
+        if (snapshotTarget && motionDetected && loopStart - lastSnapshot >=
+                std::chrono::milliseconds(snapshotTarget->settings.minIntervalMs)) {
+            std::string path = VideoRecorder::timestampedPath(snapshotTarget->directory,
+                                                              camId + "_motion", ".jpg");
+            if (snapshots->submit(frame, path, snapshotTarget->settings.jpegQuality,
+                                  snapshotTarget->settings.thumbnailSize)) {
+                lastSnapshot = loopStart;
+            }
+        }
+
+        // record frame if recording is active. the frame is queued by reference,
+        // it is a fresh copy every iteration so nothing writes into it again.
+        // motion frames are keyframes so they survive a full queue, and are
+        // flagged in the frame index for seeking
+        if (recording) {
+            recorderItem->second.writeFrame(frame, motionDetected, motionDetected);
+        }
+
+        // motion-triggered recording, buffers pre-roll while nothing happens
+        if (eventRecorder) {
+            eventRecorder->processFrame(frame, motionDetected);
+        }
+
+        // the frame is finished, the display takes it by reference. its
+        // boxes are already drawn in, the mosaic gets none to draw again
+        if (mosaic) {
+            mosaic->publishFrame(camId, frame);
+        }
+
+        if (governor) {
+            // pace the loop to the current capture rate
+            std::this_thread::sleep_until(loopStart + std::chrono::milliseconds(1000 / captureFps));
+        }
+        else {
+            // small delay to control frame rate
+            std::this_thread::sleep_for(std::chrono::milliseconds(33));
+        }
     }
 
+    auto eventItem = eventRecorders.find(camId);
+    if (eventItem != eventRecorders.end()) {
+        eventItem->second->stop();
+    }
+
+    if (captureFps != streamFps) {
+        cam->setCaptureRate(streamFps);
+    }
     cam->disconnect();
     std::cout << "Monitoring stopped for camera: " << camId << std::endl;
 
+    ActivityStats activity;
+    if (getActivityStats(camId, activity)) {
+        std::cout << "Camera " << camId << " activity: " << activity.activeSeconds
+                  << " s active (" << activity.activeFrames << " frames), "
+                  << activity.idleSeconds << " s idle (" << activity.idleFrames
+                  << " frames), " << activity.transitions << " transitions" << std::endl;
+    }
+
 }
 
 bool SurveillanceSystem::start() {
@@ -176,8 +800,45 @@ bool SurveillanceSystem::start() {
 
     running = true;
 
-    // start monitoring thread for each camera
     auto cameras = camManager.getAllCameras();
+
+    // register cameras with motion detection in the batch engine. cameras
+    // with motion zones or object tracking keep their own detector
+    if (batchEngine) {
+        for (const auto &cam : cameras) {
+            auto it = motionDetectors.find(cam->getId());
+            if (it != motionDetectors.end() && !it->second.hasZones() &&
+                !it->second.isTrackingEnabled()) {
+                batchEngine->addCamera(cam->getId(), it->second.getThreshold(),
+                                       it->second.getMinArea());
+            }
+        }
+        batchEngine->start();
+    }
+
+    if (snapshots) {
+        snapshots->start();
+    }
+    if (timelapse) {
+        timelapse->start();
+    }
+
+    // the display mosaic only holds frame references until something renders it
+    std::vector<std::string> ids;
+    for (const auto &cam : cameras) {
+        ids.push_back(cam->getId());
+    }
+    liveView.reset();
+    mosaic.reset(new MosaicCompositor(ids, mosaicSettings));
+
+    if (liveViewEnabled) {
+        liveView.reset(new LiveViewServer(*mosaic, liveViewSettings));
+        if (!liveView->start()) {
+            liveView.reset();
+        }
+    }
+
+    // start monitoring thread for each camera
     for (const auto &cam : cameras) {
         std::string id = cam->getId();
         monitorThreads[id] = std::thread(&SurveillanceSystem::monitorCamera, this, id);
@@ -205,10 +866,30 @@ bool SurveillanceSystem::stop() {
 
     monitorThreads.clear();
 
+    if (liveView) {
+        liveView->stop();
+    }
+
+    if (batchEngine) {
+        batchEngine->stop();
+    }
+
     // stop all recordings
     for (auto &element : videoRecorders) {
         element.second.stopRecording();
     }
+    for (auto &element : remuxers) {
+        element.second->stop();
+    }
+
+    if (timelapse) {
+        timelapse->stop();
+    }
+
+    // writes out the snapshots still queued
+    if (snapshots) {
+        snapshots->stop();
+    }
 
     std::cout << "Surveillance system stopped" << std::endl;
 
@@ -219,6 +900,50 @@ bool SurveillanceSystem::isRunning() const {
     return running;
 }
 
+
+bool SurveillanceSystem::enableLiveView(const LiveViewSettings &settings) {
+    if (running) {
+        std::cerr << "Live view must be enabled before start()" << std::endl;
+        return false;
+    }
+
+    liveViewEnabled = true;
+    liveViewSettings = settings;
+    return true;
+}
+
+
+bool SurveillanceSystem::getLiveViewStats(LiveViewStats &stats) const {
+    if (!liveView) {
+        return false;
+    }
+
+    stats = liveView->getStats();
+    return true;
+}
+
+
+bool SurveillanceSystem::setMosaicSettings(const MosaicSettings &settings) {
+    if (running) {
+        std::cerr << "Mosaic settings must be set before start()" << std::endl;
+        return false;
+    }
+
+    mosaicSettings = settings;
+    return true;
+}
+
+
+bool SurveillanceSystem::getMosaicStats(MosaicStats &stats) const {
+    if (!mosaic) {
+        return false;
+    }
+
+    stats = mosaic->getStats();
+    return true;
+}
+
+
 void SurveillanceSystem::displayCamera(const std::string &camId) {
     auto cam = camManager.getCamera(camId);
     if (!cam) {
@@ -226,22 +951,22 @@ void SurveillanceSystem::displayCamera(const std::string &camId) {
         return; 
     }
 
+    if (!mosaic) {
+        std::cerr << "Display needs a started system" << std::endl;
+        return;
+    }
+
     std::string windowName = "Camera: " + camId;
     cv::namedWindow(windowName, cv::WINDOW_NORMAL);
 
+    // the monitor thread has already drawn the motion boxes
+    uint64_t shownSeq = 0;
     while (running) {
-        cv::Mat frame = cam->getFrame();
-        if (!frame.empty()) {
-            // draw motion regions if motion detector exists
-            auto motionIt = motionDetectors.find(camId);
-            if (motionIt != motionDetectors.end()) {
-                auto regions = motionIt->second.getMotionRegions(frame);
-                for (const auto &rect : regions) {
-                    cv::rectangle(frame, rect, cv::Scalar(0, 255, 0), 2);
-                }
-            }
-
+        cv::Mat frame;
+        uint64_t seq = 0;
+        if (mosaic->getLatestFrame(camId, frame, &seq) && seq != shownSeq) {
             cv::imshow(windowName, frame);
+            shownSeq = seq;
         }
 
         if (cv::waitKey(30) == 'q') {
@@ -254,32 +979,23 @@ void SurveillanceSystem::displayCamera(const std::string &camId) {
 
 
 void SurveillanceSystem::displayAllCameras() {
-    auto cameras = camManager.getAllCameras();
-
-    std::vector<std::string> windowNames;
-    for (const auto &cam : cameras) {
-        std::string windowName = "Camera: " + cam->getId();
-        cv::namedWindow(windowName, cv::WINDOW_NORMAL);
-        windowNames.push_back(windowName);
+    if (!mosaic) {
+        std::cerr << "Display needs a started system" << std::endl;
+        return;
     }
 
-    while (running) {
-        for (size_t i = 0; i < cameras.size(); i++) {
-            cv::Mat frame = cameras[i]->getFrame();
-
-            if (!frame.empty()) {
-                std::string camId = cameras[i]->getId();
+    const std::string windowName = "Cameras";
+    cv::namedWindow(windowName, cv::WINDOW_NORMAL);
 
-                // draw motion regions
-                auto motionIt = motionDetectors.find(camId);
-                if (motionIt != motionDetectors.end()) {
-                    auto regions = motionIt->second.getMotionRegions(frame);
-                    for (const auto &rect : regions) {
-                        cv::rectangle(frame, rect, cv::Scalar(0, 255, 0), 2);
-                    }
-                }
-                cv::imshow(windowNames[i], frame);
-            }
+    // one window, only tiles with a new frame are redrawn. the live view
+    // may render the mosaic too, so the window gets its own copy
+    uint64_t shownSeq = 0;
+    cv::Mat canvas;
+    while (running) {
+        uint64_t seq = mosaic->renderCopy(canvas, shownSeq);
+        if (seq != shownSeq) {
+            cv::imshow(windowName, canvas);
+            shownSeq = seq;
         }
 
         // break using 'q' key
@@ -288,7 +1004,5 @@ void SurveillanceSystem::displayAllCameras() {
         }
     }
 
-    for (const auto &windowName : windowNames) {
-        cv::destroyWindow(windowName);
-    }
+    cv::destroyWindow(windowName);
 }
@@ -0,0 +1,180 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "TemporalDenoiser.h"
+
+
+namespace {
+
+// per byte: |frame - average| > threshold ? frame : average moved 1 / 2^strength
+// of the way to frame. the result goes to both rows. with flip 0xff the
+// bytes are inverted around the averages so they round down instead of up
+void denoiseRow(uchar *average, uchar *frame, int n, int strength, uchar threshold, uchar flip) {
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i t = _mm256_set1_epi8((char)threshold);
+    const __m256i f = _mm256_set1_epi8((char)flip);
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(average + i));
+        __m256i x = _mm256_loadu_si256((const __m256i *)(frame + i));
+        __m256i d = _mm256_or_si256(_mm256_subs_epu8(a, x), _mm256_subs_epu8(x, a));
+        __m256i still = _mm256_cmpeq_epi8(_mm256_subs_epu8(d, t), zero);
+
+        __m256i fa = _mm256_xor_si256(a, f);
+        __m256i b = _mm256_xor_si256(x, f);
+        for (int s = 0; s < strength; s++) {
+            b = _mm256_avg_epu8(fa, b);
+        }
+        b = _mm256_blendv_epi8(x, _mm256_xor_si256(b, f), still);
+
+        _mm256_storeu_si256((__m256i *)(average + i), b);
+        _mm256_storeu_si256((__m256i *)(frame + i), b);
+    }
+#elif defined(__SSE2__)
+    const __m128i t = _mm_set1_epi8((char)threshold);
+    const __m128i f = _mm_set1_epi8((char)flip);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(average + i));
+        __m128i x = _mm_loadu_si128((const __m128i *)(frame + i));
+        __m128i d = _mm_or_si128(_mm_subs_epu8(a, x), _mm_subs_epu8(x, a));
+        __m128i still = _mm_cmpeq_epi8(_mm_subs_epu8(d, t), zero);
+
+        __m128i fa = _mm_xor_si128(a, f);
+        __m128i b = _mm_xor_si128(x, f);
+        for (int s = 0; s < strength; s++) {
+            b = _mm_avg_epu8(fa, b);
+        }
+        b = _mm_xor_si128(b, f);
+        b = _mm_or_si128(_mm_and_si128(still, b), _mm_andnot_si128(still, x));
+
+        _mm_storeu_si128((__m128i *)(average + i), b);
+        _mm_storeu_si128((__m128i *)(frame + i), b);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint8x16_t t = vdupq_n_u8(threshold);
+    const uint8x16_t f = vdupq_n_u8(flip);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t a = vld1q_u8(average + i);
+        uint8x16_t x = vld1q_u8(frame + i);
+        uint8x16_t still = vcleq_u8(vabdq_u8(a, x), t);
+
+        uint8x16_t fa = veorq_u8(a, f);
+        uint8x16_t b = veorq_u8(x, f);
+        for (int s = 0; s < strength; s++) {
+            b = vrhaddq_u8(fa, b);
+        }
+        b = vbslq_u8(still, veorq_u8(b, f), x);
+
+        vst1q_u8(average + i, b);
+        vst1q_u8(frame + i, b);
+    }
+#endif
+
+    for (; i < n; i++) {
+        int a = average[i] ^ flip;
+        int x = frame[i] ^ flip;
+        int d = a > x ? a - x : x - a;
+        if (d <= threshold) {
+            int b = x;
+            for (int s = 0; s < strength; s++) {
+                b = (a + b + 1) >> 1;
+            }
+            frame[i] = (uchar)(b ^ flip);
+        }
+        average[i] = frame[i];
+    }
+}
+
+}   // namespace
+
+
+TemporalDenoiser::TemporalDenoiser(const TemporalDenoiseSettings &settings)
+    : settings(settings), roundDown(false) {
+
+    this->settings.strength = std::max(1, std::min(3, settings.strength));
+    this->settings.noiseThreshold = std::max(0, std::min(255, settings.noiseThreshold));
+    this->settings.motionMargin = std::max(0, settings.motionMargin);
+
+    stats.frames = 0;
+    stats.resets = 0;
+    stats.motionCoverage = 0.0;
+    stats.lastMs = 0.0;
+    stats.avgMs = 0.0;
+}
+
+
+void TemporalDenoiser::process(cv::Mat &frame, const std::vector<cv::Rect> &motion) {
+    if (frame.empty() || frame.depth() != CV_8U) {
+        return;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    // nothing to average against yet
+    if (average.size() != frame.size() || average.type() != frame.type()) {
+        frame.copyTo(average);
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.frames++;
+        stats.resets++;
+        return;
+    }
+
+    // moving pixels restart their average from the frame, which then passes
+    // through the filter unchanged
+    cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    long covered = 0;
+    for (const auto &box : motion) {
+        int m = settings.motionMargin;
+        cv::Rect area = cv::Rect(box.x - m, box.y - m, box.width + 2 * m, box.height + 2 * m) & frameRect;
+        if (area.area() > 0) {
+            cv::Mat dst = average(area);
+            frame(area).copyTo(dst);
+            covered += area.area();
+        }
+    }
+
+    int n = frame.cols * frame.channels();
+    uchar flip = roundDown ? 0xff : 0x00;
+    for (int y = 0; y < frame.rows; y++) {
+        denoiseRow(average.ptr<uchar>(y), frame.ptr<uchar>(y), n, settings.strength,
+                   (uchar)settings.noiseThreshold, flip);
+    }
+    roundDown = !roundDown;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.frames++;
+    stats.motionCoverage = std::min(1.0, (double)covered / frame.total());
+    stats.lastMs = ms;
+    stats.avgMs = stats.frames - stats.resets <= 1 ? ms : 0.9 * stats.avgMs + 0.1 * ms;
+}
+
+
+void TemporalDenoiser::reset() {
+    average.release();
+}
+
+
+TemporalDenoiseSettings TemporalDenoiser::getSettings() const {
+    return settings;
+}
+
+
+TemporalDenoiseStats TemporalDenoiser::getStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
@@ -0,0 +1,310 @@
+#include <iostream>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+#include "TimelapseScheduler.h"
+
+
+namespace {
+
+int64_t wallNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}   // namespace
+
+
+TimelapseScheduler::TimelapseScheduler(SnapshotService &snapshots, int tickMs, size_t slots)
+    : snapshots(snapshots), tickMs(std::max(10, tickMs)), wheel(std::max((size_t)1, slots)),
+      currentTick(0), running(false) {}
+
+
+TimelapseScheduler::~TimelapseScheduler() {
+    stop();
+}
+
+
+bool TimelapseScheduler::addCamera(const std::string &camId, const std::string &directory,
+                                   const TimelapseSettings &settings) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        std::cerr << "Timelapse cameras must be added before start()" << std::endl;
+        return false;
+    }
+
+    if (settings.intervalMs <= 0) {
+        std::cerr << "Invalid timelapse interval for camera: " << camId << std::endl;
+        return false;
+    }
+
+    std::unique_ptr<Entry> entry(new Entry());
+    entry->camId = camId;
+    entry->directory = directory;
+    entry->settings = settings;
+    if (entry->settings.prefix.empty()) {
+        entry->settings.prefix = camId + "_timelapse";
+    }
+    entry->dedup = SnapshotDeduplicator(settings.dedupMaxDistance);
+    if (settings.writeIndex) {
+        entry->indexPath = (directory.empty() ? "" : directory + "/") +
+                           entry->settings.prefix + "_index.csv";
+    }
+    entry->nextDueMs = 0;
+    entry->rounds = 0;
+    entry->pending = 0;
+    entry->stats.scheduled = 0;
+    entry->stats.captured = 0;
+    entry->stats.missed = 0;
+    entry->stats.dropped = 0;
+    entry->stats.skipped = 0;
+
+    entries[camId] = std::move(entry);
+
+    return true;
+}
+
+
+bool TimelapseScheduler::removeCamera(const std::string &camId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        std::cerr << "Timelapse cameras cannot be removed while running" << std::endl;
+        return false;
+    }
+    return entries.erase(camId) > 0;
+}
+
+
+int64_t TimelapseScheduler::firstDue(const TimelapseSettings &settings, int64_t nowMs) const {
+    int64_t interval = settings.intervalMs;
+    if (!settings.alignToWallClock) {
+        return nowMs + interval;
+    }
+
+    // boundaries are counted in local time, so a daily interval lands on
+    // local midnight rather than on midnight UTC
+    time_t t = nowMs / 1000;
+    tm local_tm;
+    localtime_r(&t, &local_tm);
+    int64_t offsetMs = (int64_t)local_tm.tm_gmtoff * 1000;
+
+    return ((nowMs + offsetMs) / interval + 1) * interval - offsetMs;
+}
+
+
+void TimelapseScheduler::schedule(Entry *entry, int64_t nowMs) {
+    int64_t delayMs = std::max((int64_t)0, entry->nextDueMs - nowMs);
+    uint64_t ticks = std::max((int64_t)1, (delayMs + tickMs - 1) / tickMs);
+
+    // the slot comes round every wheel.size() ticks, intervals longer than
+    // one turn wait out the extra rounds
+    entry->rounds = (ticks - 1) / wheel.size();
+    wheel[(currentTick + ticks) % wheel.size()].push_back(entry);
+}
+
+
+void TimelapseScheduler::advance(int64_t nowMs) {
+    currentTick++;
+
+    std::vector<Entry *> &slot = wheel[currentTick % wheel.size()];
+    std::vector<Entry *> due;
+
+    size_t kept = 0;
+    for (Entry *entry : slot) {
+        if (entry->rounds > 0) {
+            entry->rounds--;
+            slot[kept++] = entry;
+        }
+        else {
+            due.push_back(entry);
+        }
+    }
+    slot.resize(kept);
+
+    for (Entry *entry : due) {
+        // the capture loop takes the flag with its next frame. if it is still
+        // raised from last time that firing never got a frame
+        if (entry->pending.exchange(entry->nextDueMs) != 0) {
+            entry->stats.missed++;
+        }
+        entry->stats.scheduled++;
+
+        // follow the schedule rather than the wake-up time so it does not
+        // drift, and skip periods that passed while nothing ran
+        entry->nextDueMs += entry->settings.intervalMs;
+        if (entry->nextDueMs <= nowMs) {
+            entry->nextDueMs = firstDue(entry->settings, nowMs);
+        }
+        schedule(entry, nowMs);
+    }
+}
+
+
+void TimelapseScheduler::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto nextTick = std::chrono::steady_clock::now() + std::chrono::milliseconds(tickMs);
+
+    while (running) {
+        wake.wait_until(lock, nextTick);
+        if (!running) {
+            break;
+        }
+
+        // catch up on ticks lost while the thread was not scheduled
+        auto now = std::chrono::steady_clock::now();
+        while (nextTick <= now) {
+            advance(wallNowMs());
+            nextTick += std::chrono::milliseconds(tickMs);
+        }
+
+        flushIndexes(lock);
+    }
+
+    flushIndexes(lock);
+}
+
+
+void TimelapseScheduler::flushIndexes(std::unique_lock<std::mutex> &lock) {
+    std::vector<std::pair<std::string, std::vector<std::string>>> batches;
+    for (auto &item : entries) {
+        Entry &entry = *item.second;
+        if (!entry.indexLines.empty()) {
+            batches.push_back(std::make_pair(entry.indexPath, std::vector<std::string>()));
+            batches.back().second.swap(entry.indexLines);
+        }
+    }
+
+    if (batches.empty()) {
+        return;
+    }
+
+    // file I/O without the lock, capture threads keep logging meanwhile
+    lock.unlock();
+    for (const auto &batch : batches) {
+        SnapshotDeduplicator::appendIndex(batch.first, batch.second);
+    }
+    lock.lock();
+}
+
+
+bool TimelapseScheduler::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) {
+        return false;
+    }
+
+    for (auto &slot : wheel) {
+        slot.clear();
+    }
+    currentTick = 0;
+
+    int64_t now = wallNowMs();
+    for (auto &item : entries) {
+        Entry *entry = item.second.get();
+        entry->pending = 0;
+        entry->dedup.reset();
+        entry->nextDueMs = firstDue(entry->settings, now);
+        schedule(entry, now);
+    }
+
+    running = true;
+    worker = std::thread(&TimelapseScheduler::workerLoop, this);
+
+    std::cout << "Timelapse scheduler started for " << entries.size() << " cameras" << std::endl;
+
+    return true;
+}
+
+
+void TimelapseScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    wake.notify_all();
+
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+
+bool TimelapseScheduler::offerFrame(const std::string &camId, const cv::Mat &frame) {
+    // entries do not change while running, so no lock for the lookup
+    auto it = entries.find(camId);
+    if (it == entries.end() || frame.empty()) {
+        return false;
+    }
+
+    Entry &entry = *it->second;
+    if (entry.pending.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    int64_t dueMs = entry.pending.exchange(0);
+    if (dueMs == 0) {
+        return false;
+    }
+
+    // an unchanged scene costs the hash and nothing else
+    std::string path = pathFor(entry, dueMs);
+    DedupDecision decision = entry.dedup.check(frame);
+
+    // submit copies the frame, encoding and writing happen on the pool
+    bool queued = !decision.duplicate &&
+                  snapshots.submit(frame, path, entry.settings.jpegQuality, entry.settings.maxSize);
+    if (queued) {
+        entry.dedup.accept(decision, path);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (decision.duplicate) {
+        entry.stats.skipped++;
+    }
+    else if (queued) {
+        entry.stats.captured++;
+    }
+    else {
+        entry.stats.dropped++;
+    }
+
+    if (!entry.indexPath.empty() && (decision.duplicate || queued)) {
+        entry.indexLines.push_back(SnapshotDeduplicator::indexLine(dueMs, path, decision));
+    }
+
+    return queued;
+}
+
+
+bool TimelapseScheduler::getStats(const std::string &camId, TimelapseStats &stats) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(camId);
+    if (it == entries.end()) {
+        return false;
+    }
+
+    stats = it->second->stats;
+    return true;
+}
+
+
+std::string TimelapseScheduler::pathFor(const Entry &entry, int64_t wallMs) {
+    // named after the scheduled time, so aligned captures get regular names
+    time_t t = wallMs / 1000;
+    tm local_tm;
+    localtime_r(&t, &local_tm);
+
+    std::stringstream ss;
+    if (!entry.directory.empty()) {
+        ss << entry.directory << "/";
+    }
+    ss << entry.settings.prefix << "_" << std::put_time(&local_tm, "%Y%m%d_%H%M%S")
+       << "_" << std::setw(3) << std::setfill('0') << wallMs % 1000 << ".jpg";
+
+    return ss.str();
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 
 #include "USBCamera.h"
 
@@ -26,6 +27,9 @@ bool USBCamera::connect() {
     capture.set(cv::CAP_PROP_FRAME_HEIGHT, height);
     capture.set(cv::CAP_PROP_FPS, fps);
 
+    // the driver may pick the nearest mode it supports, keep what it chose
+    readStreamFormat(capture);
+
     isConnected = true;
     std::cout << "USB cam " << name << " connected" << std::endl;
     
@@ -60,6 +64,26 @@ bool USBCamera::isAvailable() const {
 }
 
 
+void USBCamera::setFPS(int fps) {
+    Camera::setFPS(fps);
+
+    // apply to the running stream as well
+    if (isConnected && capture.isOpened()) {
+        capture.set(cv::CAP_PROP_FPS, fps);
+    }
+}
+
+
+bool USBCamera::setCaptureRate(int rate) {
+    if (!isConnected || !capture.isOpened()) {
+        return false;
+    }
+
+    // only the driver's rate changes, fps stays the stream's own
+    return capture.set(cv::CAP_PROP_FPS, std::max(1, std::min(rate, fps)));
+}
+
+
 void USBCamera::setDeviceIndex(int index) {
     deviceIndex = index;
 }
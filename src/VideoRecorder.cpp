@@ -1,88 +1,755 @@
 #include <iostream>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <sys/stat.h>
 
 #include "VideoRecorder.h"
 
 
+namespace {
+
+// a writer that failed to open on the first frame is retried after a
+// growing delay, the same schedule the remuxer reconnects on
+const int kOpenBackoffMs = 500;
+const int kMaxOpenBackoffMs = 10000;
+
+}   // namespace
+
+
 VideoRecorder::VideoRecorder()
-    : isRecording(false), codec(cv::VideoWriter::fourcc('X', 'V', 'I', 'D')),
-      fps(30.0), frameSize(640, 480) {}
-      
+    : backend(RecorderBackend::OPENCV), indexEnabled(true), fileFrames(0),
+      isRecording(false), codec(cv::VideoWriter::fourcc('X', 'V', 'I', 'D')),
+      fps(30.0), frameSize(640, 480), isColor(true), awaitingFormat(false),
+      openBackoffMs(kOpenBackoffMs), queueCapacity(60),
+      overflowPolicy(OverflowPolicy::DROP_NON_KEYFRAME), keyframeInterval(30),
+      submittedFrames(0), stopWriter(false), segmented(false), segmentCount(0) {
+
+    plan.sourceSize = cv::Size(0, 0);
+    plan.sourceType = -1;
+    plan.resize = false;
+    plan.colorCode = -1;
+    plan.resizeFirst = true;
+
+    stats.queueDepth = 0;
+    stats.backlogDepth = 0;
+    stats.queueCapacity = queueCapacity;
+    stats.peakQueueDepth = 0;
+    stats.framesQueued = 0;
+    stats.framesWritten = 0;
+    stats.framesDropped = 0;
+    stats.framesFailed = 0;
+    stats.framesConverted = 0;
+}
+
 
 VideoRecorder::~VideoRecorder() {
     stopRecording();
 }
 
 
+bool VideoRecorder::openWriter(const std::string &filename) {
+    if (backend == RecorderBackend::MJPEG_AVI) {
+        mjpegWriter.open(filename, fps, frameSize);
+    }
+    else {
+        writer.open(filename, codec, fps, frameSize, isColor);
+    }
+
+    if (!writerOpened()) {
+        std::cerr << "Failed to open video writer: " << filename << std::endl;
+        return false;
+    }
+
+    fileFrames = 0;
+    if (indexEnabled) {
+        // only the MJPEG writer knows where a frame lands, and every MJPEG
+        // frame is a keyframe. OpenCV's writer tells neither
+        uint32_t contents = backend == RecorderBackend::MJPEG_AVI
+                          ? INDEX_HAS_OFFSETS | INDEX_HAS_KEYFRAMES : 0;
+        frameIndex.open(FrameIndexReader::indexPathFor(filename), fps, frameSize, contents);
+    }
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    outputPath = filename;
+
+    return true;
+}
+
+
+bool VideoRecorder::writerOpened() const {
+    return backend == RecorderBackend::MJPEG_AVI ? mjpegWriter.isOpened() : writer.isOpened();
+}
+
+
+void VideoRecorder::releaseWriter() {
+    frameIndex.close();
+
+    if (backend == RecorderBackend::MJPEG_AVI) {
+        mjpegWriter.close();
+    }
+    else {
+        writer.release();
+    }
+}
+
+
+bool VideoRecorder::writeToBackend(const cv::Mat &frame) {
+    if (backend == RecorderBackend::MJPEG_AVI) {
+        return mjpegWriter.write(frame);
+    }
+
+    if (!writer.isOpened()) {
+        return false;
+    }
+    writer.write(frame);
+
+    return true;
+}
+
+
+void VideoRecorder::indexFrame(Clock::time_point captured, bool motion) {
+    FrameIndexEntry entry;
+    entry.elapsedMs = frameIndex.elapsedMs(captured);
+    entry.frameNumber = fileFrames++;
+    entry.flags = motion ? FRAME_MOTION : 0;
+
+    // other backends are seeked by frame number, see FrameIndexContents
+    if (backend == RecorderBackend::MJPEG_AVI) {
+        entry.offset = mjpegWriter.getLastFrameOffset();
+        entry.flags |= FRAME_KEYFRAME;
+    }
+    else {
+        entry.offset = FRAME_OFFSET_UNKNOWN;
+    }
+
+    frameIndex.append(entry);
+}
+
+
+bool VideoRecorder::startWriter() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.clear();
+        backlog.clear();
+        submittedFrames = 0;
+        stopWriter = false;
+    }
+
+    isRecording = true;
+    writerThread = std::thread(&VideoRecorder::writerLoop, this);
+
+    return true;
+}
+
+
+bool VideoRecorder::negotiate(const StreamFormat &source, const std::string &filename) {
+    fps = source.fps > 0 ? source.fps : 30.0;
+
+    if (!source.known()) {
+        // nothing to go on yet, the writer thread opens on the first frame
+        awaitingFormat = true;
+        pendingPath = filename;
+        openRetryAt = Clock::time_point();
+        openBackoffMs = kOpenBackoffMs;
+        return true;
+    }
+
+    // write at whatever the source delivers, grey stays grey
+    awaitingFormat = false;
+    frameSize = source.size;
+    isColor = CV_MAT_CN(source.type) != 1;
+    buildPlan(source.size, source.type);
+
+    return openWriter(filename);
+}
+
+
+bool VideoRecorder::negotiateFromFrame(const cv::Mat &frame) {
+    frameSize = frame.size();
+    isColor = frame.channels() != 1;
+    buildPlan(frame.size(), frame.type());
+
+    std::string filename = segmented ? timestampedPath(segmentDir, segmentPrefix) : pendingPath;
+    if (!openWriter(filename)) {
+        // frames are dropped until the next attempt
+        std::cerr << "Retrying in " << openBackoffMs << " ms" << std::endl;
+        openRetryAt = Clock::now() + std::chrono::milliseconds(openBackoffMs);
+        openBackoffMs = std::min(openBackoffMs * 2, kMaxOpenBackoffMs);
+        return false;
+    }
+    awaitingFormat = false;
+
+    std::cout << "Recording format: " << frameSize.width << "x" << frameSize.height
+              << " @ " << fps << " fps" << std::endl;
+
+    if (segmented) {
+        segmentStart = Clock::now();
+        std::lock_guard<std::mutex> lock(queueMutex);
+        segmentCount = 1;
+    }
+
+    return true;
+}
+
+
+void VideoRecorder::buildPlan(const cv::Size &size, int type) {
+    plan.sourceSize = size;
+    plan.sourceType = type;
+    plan.resize = size != frameSize;
+
+    int channels = CV_MAT_CN(type);
+    int wanted = isColor ? 3 : 1;
+    if (backend == RecorderBackend::MJPEG_AVI && channels != 2) {
+        wanted = channels;          // libjpeg takes grey, BGR and BGRA as they are
+    }
+    plan.colorCode = -1;
+    if (channels != wanted) {
+        if (channels == 1) {
+            plan.colorCode = cv::COLOR_GRAY2BGR;
+        }
+        else if (wanted == 1) {
+            plan.colorCode = channels == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY;
+        }
+        else {
+            plan.colorCode = cv::COLOR_BGRA2BGR;
+        }
+    }
+
+    // fewer pixels go through the second step
+    plan.resizeFirst = frameSize.area() <= size.area();
+
+    // allocate once, later frames are written into the same buffers
+    int outType = CV_8UC(wanted);
+    if (plan.resizeFirst) {
+        plan.stage1.create(frameSize, type);
+        plan.stage2.create(frameSize, outType);
+    }
+    else {
+        plan.stage1.create(size, outType);
+        plan.stage2.create(frameSize, outType);
+    }
+
+    if (plan.resize || plan.colorCode >= 0) {
+        std::cout << "Recording needs conversion: " << size.width << "x" << size.height
+                  << " (" << channels << " ch) -> " << frameSize.width << "x"
+                  << frameSize.height << " (" << wanted << " ch)" << std::endl;
+    }
+}
+
+
 bool VideoRecorder::startRecording(const std::string &filename, int fps,
-                                   const cv::Size &framesize, int codec) {
+                                   const cv::Size &frameSize, int codec) {
     if (isRecording) {
         std::cerr << "Already recording. Stop current recording first." << std::endl;
         return false;
     }
 
-    this->outputPath = filename;
     this->fps = fps;
     this->frameSize = frameSize;
     this->codec = codec;
+    this->segmented = false;
+    this->isColor = true;
+    this->awaitingFormat = false;
+    plan.sourceType = -1;       // planned from the first frame
 
     // open video writer
-    writer.open(filename, codec, fps, frameSize, true);
+    if (!openWriter(filename)) {
+        return false;
+    }
 
-    if (!writer.isOpened()) {
-        std::cerr << "Failed to open video writer: " << filename << std::endl;
+    startWriter();
+    std::cout << "Started recording to: " << filename << std::endl;
+
+    return true;
+}
+
+
+bool VideoRecorder::startRecording(const std::string &filename, const StreamFormat &source,
+                                   int codec) {
+    if (isRecording) {
+        std::cerr << "Already recording. Stop current recording first." << std::endl;
         return false;
     }
 
-    isRecording = true;
+    this->codec = codec;
+    this->segmented = false;
+
+    if (!negotiate(source, filename)) {
+        return false;
+    }
+
+    startWriter();
     std::cout << "Started recording to: " << filename << std::endl;
 
     return true;
 }
 
 
+bool VideoRecorder::startSegmentedRecording(const std::string &directory, const std::string &prefix,
+                                            int fps, const cv::Size &frameSize,
+                                            const SegmentSettings &settings, int codec) {
+    if (isRecording) {
+        std::cerr << "Already recording. Stop current recording first." << std::endl;
+        return false;
+    }
+
+    this->fps = fps;
+    this->frameSize = frameSize;
+    this->codec = codec;
+    this->segmented = true;
+    this->segmentDir = directory;
+    this->segmentPrefix = prefix;
+    this->segmentSettings = settings;
+    this->isColor = true;
+    this->awaitingFormat = false;
+    plan.sourceType = -1;
+
+    if (!openWriter(timestampedPath(directory, prefix))) {
+        return false;
+    }
+    segmentStart = Clock::now();
+    segmentCount = 1;
+
+    startWriter();
+    std::cout << "Started segmented recording to: " << directory << "/" << prefix
+              << "_*.avi" << std::endl;
+
+    return true;
+}
+
+
+bool VideoRecorder::startSegmentedRecording(const std::string &directory, const std::string &prefix,
+                                            const StreamFormat &source,
+                                            const SegmentSettings &settings, int codec) {
+    if (isRecording) {
+        std::cerr << "Already recording. Stop current recording first." << std::endl;
+        return false;
+    }
+
+    this->codec = codec;
+    this->segmented = true;
+    this->segmentDir = directory;
+    this->segmentPrefix = prefix;
+    this->segmentSettings = settings;
+    segmentCount = 0;
+
+    if (!negotiate(source, timestampedPath(directory, prefix))) {
+        return false;
+    }
+    if (!awaitingFormat) {
+        segmentStart = Clock::now();
+        segmentCount = 1;
+    }
+
+    startWriter();
+    std::cout << "Started segmented recording to: " << directory << "/" << prefix
+              << "_*.avi" << std::endl;
+
+    return true;
+}
+
+
+void VideoRecorder::closeFile() {
+    bool wasOpen = writerOpened();
+    releaseWriter();
+
+    if (wasOpen && fileClosedCallback) {
+        fileClosedCallback(getOutputPath());
+    }
+}
+
+
 bool VideoRecorder::stopRecording() {
-    if (!isRecording) {
+    // only one caller gets to join the writer, a concurrent stop returns
+    if (!isRecording.exchange(false)) {
         return true;
     }
 
-    writer.release();
-    isRecording = false;
-    std::cout << "Stopped recording: " << outputPath << std::endl;
+    // let the writer drain what is already queued, then close the file
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopWriter = true;
+    }
+    frameReady.notify_all();
+    spaceReady.notify_all();
+
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+
+    closeFile();
+    std::cout << "Stopped recording: " << getOutputPath() << " (" << stats.framesWritten
+              << " written, " << stats.framesDropped << " dropped, " << stats.framesFailed
+              << " failed)" << std::endl;
 
     return true;
 }
 
 
-bool VideoRecorder::writeFrame(const cv::Mat &frame) {
-    if (!isRecording || !writer.isOpened() || frame.empty()) {
+bool VideoRecorder::segmentDue() const {
+    if (!segmented) {
         return false;
     }
 
-    // resize frame is necessary
-    cv::Mat frameToWrite = frame;
-    if (frame.size() != frameSize) {
-        cv::resize(frame, frameToWrite, frameSize);
+    if (segmentSettings.segmentSeconds > 0) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - segmentStart);
+        if (elapsed.count() >= segmentSettings.segmentSeconds) {
+            return true;
+        }
+    }
+
+    if (segmentSettings.segmentBytes > 0 && backend == RecorderBackend::MJPEG_AVI) {
+        return mjpegWriter.getBytesWritten() >= segmentSettings.segmentBytes;
+    }
+
+    // only checked at keyframes, so one stat() every keyframe interval
+    if (segmentSettings.segmentBytes > 0) {
+        struct stat info;
+        if (stat(outputPath.c_str(), &info) == 0 &&
+            (uint64_t)info.st_size >= segmentSettings.segmentBytes) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void VideoRecorder::rotateSegment() {
+    closeFile();
+
+    std::string filename = timestampedPath(segmentDir, segmentPrefix);
+    if (!openWriter(filename)) {
+        // frames are dropped by the closed writer until the next keyframe retries
+        return;
+    }
+
+    segmentStart = Clock::now();
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    segmentCount++;
+}
+
+
+bool VideoRecorder::makeRoom(std::unique_lock<std::mutex> &lock, bool keyframe) {
+    if (queue.size() < queueCapacity) {
+        return true;
+    }
+
+    switch (overflowPolicy) {
+    case OverflowPolicy::BLOCK:
+        spaceReady.wait(lock, [this] { return queue.size() < queueCapacity || stopWriter; });
+        return !stopWriter;
+
+    case OverflowPolicy::DROP_OLDEST:
+        queue.pop_front();
+        stats.framesDropped++;
+        return true;
+
+    case OverflowPolicy::DROP_NON_KEYFRAME:
+        if (!keyframe) {
+            stats.framesDropped++;
+            return false;
+        }
+
+        // make room for a keyframe by evicting the oldest non-keyframe
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (!it->keyframe) {
+                queue.erase(it);
+                stats.framesDropped++;
+                return true;
+            }
+        }
+        queue.pop_front();
+        stats.framesDropped++;
+        return true;
+    }
+
+    return false;
+}
+
+
+bool VideoRecorder::writeFrame(const cv::Mat &frame, bool keyframe, bool motion) {
+    if (!isRecording || frame.empty()) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    if (stopWriter) {
+        return false;
+    }
+
+    // a regular keyframe cadence keeps the recording seekable under pressure
+    if (keyframeInterval > 0 && submittedFrames % keyframeInterval == 0) {
+        keyframe = true;
+    }
+    submittedFrames++;
+
+    if (!makeRoom(lock, keyframe)) {
+        return false;
     }
 
-    // convert to 3-channel if needed
-    if (frameToWrite.channels() == 1) {
-        cv::cvtColor(frameToWrite, frameToWrite, cv::COLOR_GRAY2BGR);
+    QueuedFrame item;
+    item.frame = frame;     // shares the pixel buffer, no copy
+    item.keyframe = keyframe;
+    item.motion = motion;
+    item.timestamp = Clock::now();
+    queue.push_back(item);
+
+    stats.framesQueued++;
+    stats.peakQueueDepth = std::max(stats.peakQueueDepth, queue.size());
+
+    lock.unlock();
+    frameReady.notify_one();
+
+    return true;
+}
+
+
+bool VideoRecorder::writeEncodedFrames(std::deque<EncodedFrame> &frames) {
+    if (!isRecording) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(queueMutex);
+    if (stopWriter) {
+        return false;
     }
-    else if(frameToWrite.channels() == 4) {
-        cv::cvtColor(frameToWrite, frameToWrite, cv::COLOR_BGRA2BGR);
+
+    stats.framesQueued += frames.size();
+    while (!frames.empty()) {
+        backlog.push_back(std::move(frames.front()));
+        frames.pop_front();
     }
 
-    writer.write(frameToWrite);
+    lock.unlock();
+    frameReady.notify_one();
 
     return true;
 }
 
 
+void VideoRecorder::writerLoop() {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    std::vector<uchar> encoded;
+
+    while (true) {
+        frameReady.wait(lock, [this] {
+            return !queue.empty() || !backlog.empty() || stopWriter;
+        });
+        if (queue.empty() && backlog.empty()) {
+            break;      // stopping and fully drained
+        }
+
+        cv::Mat frame;
+        bool keyframe = false;
+        bool motion = false;
+        Clock::time_point timestamp;
+        encoded.clear();
+        if (!backlog.empty()) {
+            timestamp = backlog.front().timestamp;
+            encoded.swap(backlog.front().data);
+            backlog.pop_front();
+            lock.unlock();
+        }
+        else {
+            frame = queue.front().frame;
+            keyframe = queue.front().keyframe;
+            motion = queue.front().motion;
+            timestamp = queue.front().timestamp;
+            queue.pop_front();
+            lock.unlock();
+            spaceReady.notify_one();
+        }
+
+        if (!encoded.empty()) {
+            frame = cv::imdecode(encoded, cv::IMREAD_COLOR);
+        }
+        if (frame.empty()) {
+            lock.lock();
+            continue;
+        }
+
+        // the first frame settles the output format when the source could not.
+        // until the writer opens, frames are dropped
+        if (awaitingFormat) {
+            if (Clock::now() < openRetryAt || !negotiateFromFrame(frame)) {
+                lock.lock();
+                stats.framesDropped++;
+                continue;
+            }
+        }
+
+        // segments always start on a keyframe. a writer that failed to
+        // reopen is retried at the next one
+        else if (keyframe && (segmentDue() || (segmented && !writerOpened()))) {
+            rotateSegment();
+        }
+
+        bool converted = false;
+        bool written = encodeFrame(frame, converted);
+        if (written && frameIndex.isOpen()) {
+            indexFrame(timestamp, motion);
+        }
+
+        lock.lock();
+        if (written) {
+            stats.framesWritten++;
+        }
+        else {
+            stats.framesFailed++;
+        }
+        if (converted) {
+            stats.framesConverted++;
+        }
+    }
+}
+
+
+bool VideoRecorder::encodeFrame(const cv::Mat &frame, bool &converted) {
+    // re-plan only when the source format changes
+    if (frame.size() != plan.sourceSize || frame.type() != plan.sourceType) {
+        buildPlan(frame.size(), frame.type());
+    }
+
+    converted = plan.resize || plan.colorCode >= 0;
+    if (!converted) {
+        return writeToBackend(frame);
+    }
+
+    int interpolation = plan.resizeFirst ? cv::INTER_AREA : cv::INTER_LINEAR;
+    cv::Mat frameToWrite = frame;
+
+    if (plan.resizeFirst) {
+        if (plan.resize) {
+            cv::resize(frameToWrite, plan.stage1, frameSize, 0, 0, interpolation);
+            frameToWrite = plan.stage1;
+        }
+        if (plan.colorCode >= 0) {
+            cv::cvtColor(frameToWrite, plan.stage2, plan.colorCode);
+            frameToWrite = plan.stage2;
+        }
+    }
+    else {
+        if (plan.colorCode >= 0) {
+            cv::cvtColor(frameToWrite, plan.stage1, plan.colorCode);
+            frameToWrite = plan.stage1;
+        }
+        if (plan.resize) {
+            cv::resize(frameToWrite, plan.stage2, frameSize, 0, 0, interpolation);
+            frameToWrite = plan.stage2;
+        }
+    }
+
+    return writeToBackend(frameToWrite);
+}
+
+
+void VideoRecorder::setFileClosedCallback(const std::function<void(const std::string &)> &callback) {
+    if (isRecording) {
+        std::cerr << "File callback must be set before recording starts" << std::endl;
+        return;
+    }
+    fileClosedCallback = callback;
+}
+
+
+void VideoRecorder::setBackend(RecorderBackend backend, const MjpegWriterSettings &settings) {
+    if (isRecording) {
+        std::cerr << "Recorder backend must be set before recording starts" << std::endl;
+        return;
+    }
+
+    this->backend = backend;
+    mjpegWriter.setSettings(settings);
+}
+
+
+void VideoRecorder::setFrameIndexEnabled(bool enable) {
+    if (isRecording) {
+        std::cerr << "Frame index must be configured before recording starts" << std::endl;
+        return;
+    }
+    indexEnabled = enable;
+}
+
+
+void VideoRecorder::setQueueCapacity(size_t frames) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    queueCapacity = std::max((size_t)1, frames);
+    stats.queueCapacity = queueCapacity;
+}
+
+
+void VideoRecorder::setOverflowPolicy(OverflowPolicy policy) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    overflowPolicy = policy;
+}
+
+
+void VideoRecorder::setKeyframeInterval(int frames) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    keyframeInterval = std::max(0, frames);
+}
+
+
 bool VideoRecorder::getRecordingStatus() const {
     return isRecording;
 }
 
 
 std::string VideoRecorder::getOutputPath() const {
+    std::lock_guard<std::mutex> lock(queueMutex);
     return outputPath;
-}
\ No newline at end of file
+}
+
+
+size_t VideoRecorder::getQueueDepth() const {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return queue.size();
+}
+
+
+uint64_t VideoRecorder::getDroppedFrames() const {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return stats.framesDropped;
+}
+
+
+int VideoRecorder::getSegmentCount() const {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return segmented ? segmentCount : 0;
+}
+
+
+RecorderStats VideoRecorder::getStats() const {
+    std::lock_guard<std::mutex> lock(queueMutex);
+
+    RecorderStats current = stats;
+    current.queueDepth = queue.size();
+    current.backlogDepth = backlog.size();
+
+    return current;
+}
+
+
+std::string VideoRecorder::timestampedPath(const std::string &directory, const std::string &prefix,
+                                           const std::string &extension) {
+    auto now = std::chrono::system_clock::now();
+    time_t t = std::chrono::system_clock::to_time_t(now);
+    tm local_tm;
+    localtime_r(&t, &local_tm);
+
+    // milliseconds keep size-based segments from colliding within a second
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+
+    std::stringstream ss;
+    if (!directory.empty()) {
+        ss << directory << "/";
+    }
+    ss << prefix << "_" << std::put_time(&local_tm, "%Y%m%d_%H%M%S")
+       << "_" << std::setw(3) << std::setfill('0') << ms << extension;
+
+    return ss.str();
+}
@@ -1,198 +1,645 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <setjmp.h>
 #include <jpeglib.h>
+#ifdef HAVE_LIBPNG
 #include <png.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FILTER_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FILTER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FILTER_NEON
+#endif
+
+#include "filters.h"
+#include "yuv_jpeg.h"
+
+#define HORIZONTAL_SCALE 256        // 8 fractional bits, u8 * weight still fits 16 bits
+#define VERTICAL_SCALE 32768        // 15 fractional bits, used through a 16x16 high multiply
+#define MIN_ROWS_PER_THREAD 16
+
+
+// round the weights to fixed point so they sum exactly to scale, the
+// rounding error goes to the centre tap
+static void quantiseWeights(const double *weights, int size, int scale, uint16_t *out) {
+    int sum = 0;
+    for (int i = 0; i < size; ++i) {
+        out[i] = (uint16_t)lround(weights[i] * scale);
+        sum += out[i];
+    }
+    out[size / 2] = (uint16_t)(out[size / 2] + scale - sum);
+}
 
-#define PI 3.14159265369
 
-typedef struct {
-    int width;
-    int height;
-    int channels;
-    unsigned char *data;
-} Image;
-
-float **createGaussianKernel(int size, float sigma) {
-    if (size & 1 == 0) {
+GaussianKernel *createGaussianKernel(int size, float sigma) {
+    if (size <= 0 && sigma <= 0) {
+        fprintf(stderr, "kernel needs a size or a sigma.\n");
+        return NULL;
+    }
+
+    if (size <= 0) {
+        size = (int)lround(sigma * 6 + 1) | 1;
+    }
+    if ((size & 1) == 0) {
         fprintf(stderr, "kernel size must be odd.\n");
         return NULL;
     }
+    if (sigma <= 0) {
+        sigma = 0.3f * ((size - 1) * 0.5f - 1) + 0.8f;
+    }
 
-    float **kernel = (float**)malloc(size * sizeof(float*));
-    if (!kernel) return NULL;
+    GaussianKernel *kernel = (GaussianKernel*)calloc(1, sizeof(GaussianKernel));
+    double *weights = (double*)malloc(size * sizeof(double));
+    if (!kernel || !weights) {
+        free(kernel);
+        free(weights);
+        return NULL;
+    }
 
-    // allocate memory
-    for (int i = 0; i < size; ++i) {
-        kernel[i] = (float*)malloc(size * sizeof(float));
-        if (!kernel[i]) {
-            // clean up allocated rows
-            for (int j = 0; j < i; ++j) free(kernel[j]);
-            free(kernel);
-            return NULL;
-        }
+    kernel->size = size;
+    kernel->sigma = sigma;
+    kernel->horizontal = (uint16_t*)malloc(size * sizeof(uint16_t));
+    kernel->vertical = (uint16_t*)malloc(size * sizeof(uint16_t));
+    if (!kernel->horizontal || !kernel->vertical) {
+        freeKernel(kernel);
+        free(weights);
+        return NULL;
     }
 
-    float sum = 0.0;
+    double sum = 0.0;
     int center = size / 2;
-    
     for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < size; ++j) {
-            float x = i - center;
-            float y = j - center;
-            kernel[i][j] = (1.0 / (2.0 * PI * sigma * sigma)) * exp(-(x*x + y*y) / (2.0 *                           sigma * sigma));
-            sum += kernel[i][j];
-        }
+        double x = i - center;
+        weights[i] = exp(-(x * x) / (2.0 * sigma * sigma));
+        sum += weights[i];
     }
 
     // normalize the kernel so the sum of its element is 1
     for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < size; ++j) {
-            kernel[i][j] /= sum;
-        }
+        weights[i] /= sum;
     }
+
+    quantiseWeights(weights, size, HORIZONTAL_SCALE, kernel->horizontal);
+    quantiseWeights(weights, size, VERTICAL_SCALE, kernel->vertical);
+    free(weights);
+
+    return kernel;
 }
 
+
 // free the memory for the kernel
-// todo: free all types of memory
-void freeKernel(float **kernel, int size) {
+void freeKernel(GaussianKernel *kernel) {
     if (kernel) {
-        for (int i = 0; i < size; ++i) {
-            if (kernel[i]) {
-                free(kernel[i]);
+        free(kernel->horizontal);
+        free(kernel->vertical);
+        free(kernel);
+    }
+}
+
+
+// index of the sample that stands in for position i of a line of n samples
+static int borderIndex(int i, int n, FilterBorder border) {
+    if (i >= 0 && i < n) {
+        return i;
+    }
+    if (border == FILTER_BORDER_REPLICATE || n == 1) {
+        return i < 0 ? 0 : n - 1;
+    }
+
+    // reflect without repeating the edge, again if the kernel is wider than the image
+    while (i < 0 || i >= n) {
+        if (i < 0) i = -i;
+        if (i >= n) i = 2 * (n - 1) - i;
+    }
+    return i;
+}
+
+
+// one row through the horizontal taps into 8.8 fixed point. padded holds the
+// row with radius pixels of border on each side, so tap k of sample i is at
+// i + k * channels. the sums are exact: weights add up to 256
+static void horizontalRow(const unsigned char *padded, uint16_t *out, int count, int channels,
+                          const uint16_t *weights, int size) {
+    int i = 0;
+
+#if defined(FILTER_AVX2)
+    for (; i + 16 <= count; i += 16) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int k = 0; k < size; ++k) {
+            __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(padded + i + k * channels)));
+            acc = _mm256_add_epi16(acc, _mm256_mullo_epi16(v, _mm256_set1_epi16(weights[k])));
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), acc);
+    }
+#elif defined(FILTER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        for (int k = 0; k < size; ++k) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(padded + i + k * channels));
+            __m128i w = _mm_set1_epi16(weights[k]);
+            lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), w));
+            hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), w));
+        }
+        _mm_storeu_si128((__m128i*)(out + i), lo);
+        _mm_storeu_si128((__m128i*)(out + i + 8), hi);
+    }
+#elif defined(FILTER_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint16x8_t lo = vdupq_n_u16(0);
+        uint16x8_t hi = vdupq_n_u16(0);
+        for (int k = 0; k < size; ++k) {
+            uint8x16_t v = vld1q_u8(padded + i + k * channels);
+            lo = vmlaq_n_u16(lo, vmovl_u8(vget_low_u8(v)), weights[k]);
+            hi = vmlaq_n_u16(hi, vmovl_u8(vget_high_u8(v)), weights[k]);
+        }
+        vst1q_u16(out + i, lo);
+        vst1q_u16(out + i + 8, hi);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        unsigned int sum = 0;
+        for (int k = 0; k < size; ++k) {
+            sum += weights[k] * padded[i + k * channels];
+        }
+        out[i] = (uint16_t)sum;
+    }
+}
+
+
+// combines the horizontal results of the rows under the kernel into one
+// output row. each tap is a 16x16 high multiply, (row * weight) >> 16, so the
+// sum carries 7 fractional bits and fits 16 bits
+static void verticalRow(const uint16_t **rows, unsigned char *out, int count,
+                        const uint16_t *weights, int size) {
+    int i = 0;
+
+#if defined(FILTER_AVX2)
+    const __m256i round = _mm256_set1_epi16(64);
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_setzero_si256();
+        __m256i b = _mm256_setzero_si256();
+        for (int k = 0; k < size; ++k) {
+            __m256i w = _mm256_set1_epi16(weights[k]);
+            a = _mm256_add_epi16(a, _mm256_mulhi_epu16(_mm256_loadu_si256((const __m256i*)(rows[k] + i)), w));
+            b = _mm256_add_epi16(b, _mm256_mulhi_epu16(_mm256_loadu_si256((const __m256i*)(rows[k] + i + 16)), w));
+        }
+        a = _mm256_srli_epi16(_mm256_add_epi16(a, round), 7);
+        b = _mm256_srli_epi16(_mm256_add_epi16(b, round), 7);
+
+        // packus works within 128-bit lanes, put the quarters back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + i), packed);
+    }
+#elif defined(FILTER_SSE2)
+    const __m128i round = _mm_set1_epi16(64);
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_setzero_si128();
+        __m128i b = _mm_setzero_si128();
+        for (int k = 0; k < size; ++k) {
+            __m128i w = _mm_set1_epi16(weights[k]);
+            a = _mm_add_epi16(a, _mm_mulhi_epu16(_mm_loadu_si128((const __m128i*)(rows[k] + i)), w));
+            b = _mm_add_epi16(b, _mm_mulhi_epu16(_mm_loadu_si128((const __m128i*)(rows[k] + i + 8)), w));
+        }
+        a = _mm_srli_epi16(_mm_add_epi16(a, round), 7);
+        b = _mm_srli_epi16(_mm_add_epi16(b, round), 7);
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(FILTER_NEON)
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t acc = vdupq_n_u16(0);
+        for (int k = 0; k < size; ++k) {
+            uint16x8_t v = vld1q_u16(rows[k] + i);
+            uint16x4_t lo = vshrn_n_u32(vmull_n_u16(vget_low_u16(v), weights[k]), 16);
+            uint16x4_t hi = vshrn_n_u32(vmull_n_u16(vget_high_u16(v), weights[k]), 16);
+            acc = vaddq_u16(acc, vcombine_u16(lo, hi));
+        }
+        vst1_u8(out + i, vqmovn_u16(vrshrq_n_u16(acc, 7)));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        unsigned int sum = 0;
+        for (int k = 0; k < size; ++k) {
+            sum += ((unsigned int)rows[k][i] * weights[k]) >> 16;
+        }
+        sum = (sum + 64) >> 7;
+        out[i] = (unsigned char)(sum > 255 ? 255 : sum);
+    }
+}
+
+
+typedef struct {
+    const ImageBuffer *input;
+    ImageBuffer *output;
+    const GaussianKernel *kernel;
+    FilterBorder border;
+    int y0;
+    int y1;
+    int failed;
+} FilterJob;
+
+
+// filters rows [y0, y1). the horizontal results of the rows under the kernel
+// are kept in a ring, so every source row is filtered horizontally once per
+// block and nothing frame-sized is allocated
+static void *filterRows(void *arg) {
+    FilterJob *job = (FilterJob*)arg;
+    const ImageBuffer *input = job->input;
+    int size = job->kernel->size;
+    int radius = size / 2;
+    int channels = pixelFormatBytes(input->format);
+    int count = input->width * channels;
+
+    unsigned char *padded = (unsigned char*)malloc((size_t)(input->width + 2 * radius) * channels);
+    uint16_t *ring = (uint16_t*)malloc((size_t)size * count * sizeof(uint16_t));
+    int *ringRow = (int*)malloc(size * sizeof(int));
+    const uint16_t **rows = (const uint16_t**)malloc(size * sizeof(uint16_t*));
+    if (!padded || !ring || !ringRow || !rows) {
+        job->failed = 1;
+        goto done;
+    }
+
+    for (int k = 0; k < size; ++k) {
+        ringRow[k] = -1;
+    }
+
+    for (int y = job->y0; y < job->y1; ++y) {
+        for (int k = 0; k < size; ++k) {
+            // the rows under the kernel span at most `size` consecutive source
+            // rows, so they never share a ring slot
+            int src = borderIndex(y + k - radius, input->height, job->border);
+            int slot = src % size;
+
+            if (ringRow[slot] != src) {
+                const unsigned char *line = imageBufferRow(input, 0, src);
+                memcpy(padded + radius * channels, line, count);
+                for (int x = 1; x <= radius; ++x) {
+                    int left = borderIndex(-x, input->width, job->border);
+                    int right = borderIndex(input->width - 1 + x, input->width, job->border);
+                    memcpy(padded + (radius - x) * channels, line + left * channels, channels);
+                    memcpy(padded + (radius + input->width - 1 + x) * channels, line + right * channels, channels);
+                }
+
+                horizontalRow(padded, ring + (size_t)slot * count, count, channels,
+                              job->kernel->horizontal, size);
+                ringRow[slot] = src;
             }
+            rows[k] = ring + (size_t)slot * count;
         }
-        free(kernel);
+
+        verticalRow(rows, imageBufferRow(job->output, 0, y), count, job->kernel->vertical, size);
     }
+
+done:
+    free(padded);
+    free(ring);
+    free(ringRow);
+    free(rows);
+    return NULL;
 }
 
 
 // apply Gaussian filter on colored image
-void applyGaussianfilter(Image input, Image output, float kernel, int kernel_size) {
-    if (!input || !output || !kernel) {
+int applyGaussianFilter(const ImageBuffer *input, ImageBuffer *output,
+                        const GaussianKernel *kernel, FilterBorder border, int threads) {
+    if (!input || !output || !kernel || !input->data[0] || !output->data[0]) {
         fprintf(stderr, "Invalid input\n");
-        return;
+        return -1;
     }
 
-    if (input->channels != output->channels) {
-        fprintf(stderr, "Input and output should have the same numbers of channels\n");
-        return;
+    if (input->width != output->width || input->height != output->height ||
+        input->format != output->format) {
+        fprintf(stderr, "Input and output should have the same size and pixel format\n");
+        return -1;
     }
 
-    int center = kernel_size / 2;
+    // neighbouring YUYV bytes are different components, planar chroma would
+    // need a kernel of its own
+    if (input->format == PIXEL_FORMAT_YUYV || pixelFormatIsPlanar(input->format)) {
+        fprintf(stderr, "Gaussian filter needs an interleaved image\n");
+        return -1;
+    }
 
-    // iterate through each color channel
-    for (int c = 0; c < input->channels; ++c) {
-        for (int y = 0; y < input->height; ++y) {
-            for (int x = 0; x < input->width; ++x) {
-                float sum = 0.0;
+    if (input->data[0] == output->data[0]) {
+        fprintf(stderr, "Input and output should not share their data\n");
+        return -1;
+    }
 
-                // convolution
-                for (int ky = 0; ky < kernel_size; ++ky) {
-                    for (int kx = 0; kx < kernel_size; ++kx) {
-                        int imgX = x - center + kx;
-                        int imgY = y - center + ky;
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    int maxThreads = input->height / MIN_ROWS_PER_THREAD;
+    if (threads > maxThreads) threads = maxThreads;
+    if (threads < 1) threads = 1;
+
+    FilterJob *jobs = (FilterJob*)calloc(threads, sizeof(FilterJob));
+    pthread_t *workers = (pthread_t*)calloc(threads, sizeof(pthread_t));
+    if (!jobs || !workers) {
+        free(jobs);
+        free(workers);
+        return -1;
+    }
 
-                        // boundary handling
-                        if (imgX < 0) imgX = 0;
-                        if (imgX >= input->width) imgX = input->width - 1;
-                        if (imgY < 0) imgY = 0;
-                        if (imgX >= input->height) imgY = input->height - 1;
+    for (int t = 0; t < threads; ++t) {
+        jobs[t].input = input;
+        jobs[t].output = output;
+        jobs[t].kernel = kernel;
+        jobs[t].border = border;
+        jobs[t].y0 = (int)((long)input->height * t / threads);
+        jobs[t].y1 = (int)((long)input->height * (t + 1) / threads);
+    }
 
-                        unsigned char pixelVal = input->data[(imgY * input->width + imgX) *
-                                                input->channels + c];
-                        sum += pixelVal * kernel[kx][ky];
-                    }
-                }
+    // the calling thread takes the first block itself
+    int started = 1;
+    for (int t = 1; t < threads; ++t, ++started) {
+        if (pthread_create(&workers[t], NULL, filterRows, &jobs[t]) != 0) {
+            break;
+        }
+    }
+    filterRows(&jobs[0]);
+
+    int failed = jobs[0].failed;
+    for (int t = 1; t < started; ++t) {
+        pthread_join(workers[t], NULL);
+        failed |= jobs[t].failed;
+    }
 
-                sum = sum > 255 ? 255 : (sum < 0 ? 0 : sum);
-                output->data[(y * output->width + x) * output->channel + c] = (unsigned char)sum;
+    // blocks whose thread could not be started run here
+    for (int t = started; t < threads; ++t) {
+        filterRows(&jobs[t]);
+        failed |= jobs[t].failed;
+    }
+
+    free(jobs);
+    free(workers);
+
+    return failed ? -1 : 0;
+}
+
+
+const char *filterSimdPath(void) {
+#if defined(FILTER_AVX2)
+    return "avx2";
+#elif defined(FILTER_SSE2)
+    return "sse2";
+#elif defined(FILTER_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+
+// YUV frames go to libjpeg as raw planes, the way the capture path does it
+static int save_yuv_jpeg(const char* filename, const ImageBuffer* img, int quality) {
+    yuv_format format = img->format == PIXEL_FORMAT_YUYV ? YUV_FORMAT_YUYV :
+                        img->format == PIXEL_FORMAT_NV12 ? YUV_FORMAT_NV12 : YUV_FORMAT_I420;
+
+    yuv_jpeg_encoder *enc = yuv_jpeg_create();
+    if (!enc) {
+        return -1;
+    }
+
+    const unsigned char *jpeg;
+    unsigned long jpeg_size;
+    int result = yuv_jpeg_encode(enc, img->data[0], img->width, img->height, img->stride[0],
+                                 format, quality, &jpeg, &jpeg_size);
+
+    if (result == 0) {
+        FILE *outfile = fopen(filename, "wb");
+        if (!outfile) {
+            fprintf(stderr, "Error: could not open %s\n", filename);
+            result = -1;
+        }
+        else {
+            if (fwrite(jpeg, 1, jpeg_size, outfile) != jpeg_size) {
+                result = -1;
+            }
+            if (fclose(outfile) != 0) {
+                result = -1;
             }
         }
     }
+
+    yuv_jpeg_destroy(enc);
+    return result;
+}
+
+
+// libjpeg reports fatal errors through error_exit, which would exit() by default
+struct save_jpeg_error {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+
+static void save_jpeg_error_exit(j_common_ptr cinfo) {
+    struct save_jpeg_error *err = (struct save_jpeg_error *)cinfo->err;
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    fprintf(stderr, "JPEG encode failed: %s\n", message);
+    longjmp(err->jump, 1);
+}
+
+
+// runs the compressor, kept apart from save_jpeg so nothing it changes is
+// live across the setjmp. rgb_row is a row of width * 3 bytes, only used
+// when libjpeg cannot take BGR itself
+static int compress_file(struct jpeg_compress_struct *cinfo, struct save_jpeg_error *err,
+                         FILE *outfile, const ImageBuffer *img, int quality,
+                         unsigned char *rgb_row) {
+    JSAMPROW row_pointer[1];
+    int channels = pixelFormatBytes(img->format);
+    int swap = 0;
+
+    if (setjmp(err->jump)) {
+        return -1;
+    }
+
+    jpeg_stdio_dest(cinfo, outfile);
+
+    cinfo->image_width = img->width;
+    cinfo->image_height = img->height;
+    cinfo->input_components = channels;
+    switch (img->format) {
+#ifdef JCS_EXTENSIONS
+    case PIXEL_FORMAT_BGR24:  cinfo->in_color_space = JCS_EXT_BGR; break;
+    case PIXEL_FORMAT_BGRA32: cinfo->in_color_space = JCS_EXT_BGRX; break;
+#else
+    // plain libjpeg only takes RGB, rows are swapped into rgb_row
+    case PIXEL_FORMAT_BGR24:
+    case PIXEL_FORMAT_BGRA32:
+        cinfo->in_color_space = JCS_RGB;
+        cinfo->input_components = 3;
+        swap = 1;
+        break;
+#endif
+    case PIXEL_FORMAT_RGB24:  cinfo->in_color_space = JCS_RGB; break;
+    default:                  cinfo->in_color_space = JCS_GRAYSCALE; break;
+    }
+
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality, TRUE);
+    jpeg_start_compress(cinfo, TRUE);
+
+    while (cinfo->next_scanline < cinfo->image_height) {
+        const unsigned char *src = imageBufferRow(img, 0, cinfo->next_scanline);
+        if (swap) {
+            for (int x = 0; x < img->width; ++x) {
+                rgb_row[x * 3] = src[x * channels + 2];
+                rgb_row[x * 3 + 1] = src[x * channels + 1];
+                rgb_row[x * 3 + 2] = src[x * channels];
+            }
+            row_pointer[0] = rgb_row;
+        }
+        else {
+            row_pointer[0] = (JSAMPROW)src;
+        }
+        jpeg_write_scanlines(cinfo, row_pointer, 1);
+    }
+
+    jpeg_finish_compress(cinfo);
+    return 0;
 }
 
 
 // Save image in JPEG
-void save_jpeg(const char* filename, Image* img, int quality) {
+int save_jpeg(const char* filename, const ImageBuffer* img, int quality) {
     struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr       jerr;
+    struct save_jpeg_error      jerr;
     FILE                        *outfile;
-    JSAMPROW                    row_pointer[1];
+    unsigned char               *rgb_row = NULL;
+    int                         result;
 
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
+    if (!img || !img->data[0]) {
+        fprintf(stderr, "Invalid image\n");
+        return -1;
+    }
+
+    if (img->format == PIXEL_FORMAT_YUYV || pixelFormatIsPlanar(img->format)) {
+        if (save_yuv_jpeg(filename, img, quality) != 0) {
+            fprintf(stderr, "Error: could not write %s\n", filename);
+            return -1;
+        }
+        printf("Image saved to %s\n", filename);
+        return 0;
+    }
+
+#ifndef JCS_EXTENSIONS
+    if (img->format == PIXEL_FORMAT_BGR24 || img->format == PIXEL_FORMAT_BGRA32) {
+        rgb_row = malloc((size_t)img->width * 3);
+        if (!rgb_row) {
+            return -1;
+        }
+    }
+#endif
 
     if ((outfile = fopen(filename, "wb")) == NULL) {
         fprintf(stderr, "Error: could not open %s\n", filename);
-        return;
+        free(rgb_row);
+        return -1;
     }
 
-    jpeg_stdio_dest(&cinfo, outfile);
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = save_jpeg_error_exit;
+    jpeg_create_compress(&cinfo);
 
-    cinfo.image_width = img->width;
-    cinfo.image_height = img->height;
-    cinfo.input_components = img->channels;
-    cinfo.in_color_space = (img->channels == 3) ? JCS_RGB : JCB_GRAYSCALE;
+    result = compress_file(&cinfo, &jerr, outfile, img, quality, rgb_row);
 
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, quality, TRUE);
-    jpeg_start_compress(&cinfo, TRUE);
+    jpeg_destroy_compress(&cinfo);
+    free(rgb_row);
+    if (fclose(outfile) != 0) {
+        result = -1;
+    }
 
-    while (cinfo.next_scanline < cinfo.image_height) {
-        row_pointer[0] = &img->data[cinfo.next_scanline * img->widh * img->channels];
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    // no half-written file left behind
+    if (result != 0) {
+        fprintf(stderr, "Error: could not write %s\n", filename);
+        remove(filename);
+        return -1;
     }
 
-    jpeg_finish_compress(&cinfo);
-    fclose(outfile);
-    jpeg_destroy_compress(&cinfo);
     printf("Image saved to %s\n", filename);
+    return 0;
 }
 
 
+#ifdef HAVE_LIBPNG
 // Save image to PNG
-void save_png(const char* filename, Image* img) {
+int save_png(const char* filename, const ImageBuffer* img) {
     FILE *fp;
     png_structp png_ptr = NULL;
     png_infop   info_ptr = NULL;
+    int         color_type;
+
+    if (!img || !img->data[0]) {
+        fprintf(stderr, "Invalid image\n");
+        return -1;
+    }
+
+    switch (img->format) {
+    case PIXEL_FORMAT_GRAY8:  color_type = PNG_COLOR_TYPE_GRAY; break;
+    case PIXEL_FORMAT_BGR24:
+    case PIXEL_FORMAT_RGB24:  color_type = PNG_COLOR_TYPE_RGB; break;
+    case PIXEL_FORMAT_BGRA32: color_type = PNG_COLOR_TYPE_RGB_ALPHA; break;
+    default:
+        fprintf(stderr, "PNG output needs an interleaved image\n");
+        return -1;
+    }
 
     fp = fopen(filename, "wb");
     if (!fp) {
         fprintf(stderr, "Error: could not open %s\n", filename);
-        return;
+        return -1;
     }
 
     png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png_ptr) {
         fclose(fp);
-        return;
+        return -1;
     }
 
     info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr) {
         png_destroy_write_struct(&png_ptr, NULL);
         fclose(fp);
-        return;
+        return -1;
     }
 
     if (setjmp(png_jmpbuf(png_ptr))) {
         png_destroy_write_struct(&png_ptr, &info_ptr);
         fclose(fp);
-        return;
+        return -1;
     }
 
     png_init_io(png_ptr, fp);
 
-    png_set_IHDR(png_ptr, info_ptr, img->width, img->height, 8,
-                (img->channels == 3) ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_GRAY,
-                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, 
+    png_set_IHDR(png_ptr, info_ptr, img->width, img->height, 8, color_type,
+                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
                 PNG_FILTER_TYPE_DEFAULT);
-    
+
     png_write_info(png_ptr, info_ptr);
 
+    // libpng swaps blue and red on the way out, no converted copy needed
+    if (img->format == PIXEL_FORMAT_BGR24 || img->format == PIXEL_FORMAT_BGRA32) {
+        png_set_bgr(png_ptr);
+    }
+
     for (int y = 0; y < img->height; y++) {
-        png_bytep row_pointer = (png_bytep)&img->data[y * img->width * img->channels];
+        png_bytep row_pointer = (png_bytep)imageBufferRow(img, 0, y);
         png_write_rows(png_ptr, &row_pointer, 1);
     }
 
@@ -201,31 +648,7 @@ void save_png(const char* filename, Image* img) {
     png_destroy_write_struct(&png_ptr, &info_ptr);
     fclose(fp);
     printf("Image saved to %s\n", filename);
-}
-
-
-
-int main() {
 
     return 0;
-
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
+#endif
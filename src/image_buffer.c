@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "image_buffer.h"
+
+struct ImagePool {
+    int width;
+    int height;
+    PixelFormat format;
+    size_t stride;
+    size_t bufferSize;          // one image, rounded up to IMAGE_ALIGNMENT
+    int slabBuffers;
+    int maxBuffers;
+
+    pthread_mutex_t mutex;
+    void **slabs;
+    int slabCount;
+    void **available;           // free images, used as a stack
+    int availableCount;
+    int total;
+};
+
+
+static size_t alignUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+
+int pixelFormatBytes(PixelFormat format) {
+    switch (format) {
+    case PIXEL_FORMAT_BGR24:
+    case PIXEL_FORMAT_RGB24:
+        return 3;
+    case PIXEL_FORMAT_BGRA32:
+        return 4;
+    case PIXEL_FORMAT_YUYV:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+
+int pixelFormatIsPlanar(PixelFormat format) {
+    return format == PIXEL_FORMAT_NV12 || format == PIXEL_FORMAT_I420;
+}
+
+
+// offsets and strides of the planes of an image with the given first-plane
+// stride (0 for packed rows). returns the bytes it covers, 0 when the
+// dimensions do not suit the format
+static size_t planeLayout(int width, int height, PixelFormat format, size_t stride,
+                          int *planes, size_t offsets[IMAGE_MAX_PLANES],
+                          size_t strides[IMAGE_MAX_PLANES]) {
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+
+    // chroma is subsampled horizontally for these, and vertically for planar
+    if ((format == PIXEL_FORMAT_YUYV || pixelFormatIsPlanar(format)) && (width & 1)) {
+        return 0;
+    }
+    if (pixelFormatIsPlanar(format) && (height & 1)) {
+        return 0;
+    }
+
+    size_t minStride = (size_t)width * pixelFormatBytes(format);
+    if (stride == 0) {
+        stride = minStride;
+    }
+    if (stride < minStride || (format == PIXEL_FORMAT_I420 && (stride & 1))) {
+        return 0;
+    }
+
+    *planes = 1;
+    offsets[0] = 0;
+    strides[0] = stride;
+    size_t size = stride * height;
+
+    if (format == PIXEL_FORMAT_NV12) {
+        *planes = 2;
+        offsets[1] = size;
+        strides[1] = stride;
+        size += stride * (height / 2);
+    }
+    else if (format == PIXEL_FORMAT_I420) {
+        *planes = 3;
+        for (int p = 1; p < 3; ++p) {
+            offsets[p] = size;
+            strides[p] = stride / 2;
+            size += stride / 2 * (height / 2);
+        }
+    }
+
+    return size;
+}
+
+
+// points image at memory laid out by planeLayout
+static void setPlanes(ImageBuffer *image, unsigned char *data, int width, int height,
+                      PixelFormat format, int planes, const size_t *offsets, const size_t *strides) {
+    memset(image, 0, sizeof(*image));
+    image->width = width;
+    image->height = height;
+    image->format = format;
+    image->planes = planes;
+    for (int p = 0; p < planes; ++p) {
+        image->data[p] = data + offsets[p];
+        image->stride[p] = strides[p];
+    }
+}
+
+
+int imageBufferAlloc(ImageBuffer *image, int width, int height, PixelFormat format) {
+    int planes;
+    size_t offsets[IMAGE_MAX_PLANES];
+    size_t strides[IMAGE_MAX_PLANES];
+    size_t stride = alignUp((size_t)width * pixelFormatBytes(format), IMAGE_ALIGNMENT);
+
+    size_t size = planeLayout(width, height, format, stride, &planes, offsets, strides);
+    if (size == 0) {
+        fprintf(stderr, "Invalid image size %dx%d for its pixel format\n", width, height);
+        return -1;
+    }
+
+    void *memory;
+    if (posix_memalign(&memory, IMAGE_ALIGNMENT, alignUp(size, IMAGE_ALIGNMENT)) != 0) {
+        fprintf(stderr, "Failed to allocate a %dx%d image\n", width, height);
+        return -1;
+    }
+
+    setPlanes(image, (unsigned char*)memory, width, height, format, planes, offsets, strides);
+    image->allocation = memory;
+
+    return 0;
+}
+
+
+int imageBufferWrap(ImageBuffer *image, unsigned char *data, int width, int height,
+                    PixelFormat format, size_t stride) {
+    int planes;
+    size_t offsets[IMAGE_MAX_PLANES];
+    size_t strides[IMAGE_MAX_PLANES];
+
+    if (!data || planeLayout(width, height, format, stride, &planes, offsets, strides) == 0) {
+        fprintf(stderr, "Invalid image to wrap: %dx%d\n", width, height);
+        return -1;
+    }
+
+    setPlanes(image, data, width, height, format, planes, offsets, strides);
+
+    return 0;
+}
+
+
+void imageBufferRelease(ImageBuffer *image) {
+    if (!image) {
+        return;
+    }
+
+    if (image->pool && image->allocation) {
+        ImagePool *pool = image->pool;
+        pthread_mutex_lock(&pool->mutex);
+        pool->available[pool->availableCount++] = image->allocation;
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    else {
+        free(image->allocation);
+    }
+
+    memset(image, 0, sizeof(*image));
+}
+
+
+// adds a slab of up to slabBuffers images, called with the mutex held
+static int growPool(ImagePool *pool) {
+    int count = pool->slabBuffers;
+    if (pool->maxBuffers > 0 && pool->total + count > pool->maxBuffers) {
+        count = pool->maxBuffers - pool->total;
+    }
+    if (count <= 0) {
+        return -1;
+    }
+
+    void **slabs = (void**)realloc(pool->slabs, (pool->slabCount + 1) * sizeof(void*));
+    if (!slabs) {
+        return -1;
+    }
+    pool->slabs = slabs;
+
+    void **available = (void**)realloc(pool->available, (pool->total + count) * sizeof(void*));
+    if (!available) {
+        return -1;
+    }
+    pool->available = available;
+
+    void *slab;
+    if (posix_memalign(&slab, IMAGE_ALIGNMENT, pool->bufferSize * count) != 0) {
+        fprintf(stderr, "Failed to allocate an image slab of %d buffers\n", count);
+        return -1;
+    }
+    pool->slabs[pool->slabCount++] = slab;
+
+    for (int i = 0; i < count; ++i) {
+        pool->available[pool->availableCount++] = (unsigned char*)slab + pool->bufferSize * i;
+    }
+    pool->total += count;
+
+    return 0;
+}
+
+
+ImagePool *imagePoolCreate(int width, int height, PixelFormat format, int slabBuffers,
+                           int maxBuffers) {
+    int planes;
+    size_t offsets[IMAGE_MAX_PLANES];
+    size_t strides[IMAGE_MAX_PLANES];
+    size_t stride = alignUp((size_t)width * pixelFormatBytes(format), IMAGE_ALIGNMENT);
+
+    size_t size = planeLayout(width, height, format, stride, &planes, offsets, strides);
+    if (size == 0) {
+        fprintf(stderr, "Invalid image size %dx%d for its pixel format\n", width, height);
+        return NULL;
+    }
+
+    ImagePool *pool = (ImagePool*)calloc(1, sizeof(ImagePool));
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->width = width;
+    pool->height = height;
+    pool->format = format;
+    pool->stride = stride;
+    pool->bufferSize = alignUp(size, IMAGE_ALIGNMENT);
+    pool->slabBuffers = slabBuffers > 0 ? slabBuffers : 4;
+    pool->maxBuffers = maxBuffers > 0 ? maxBuffers : 0;
+    pthread_mutex_init(&pool->mutex, NULL);
+
+    // the first slab up front, so steady-state capture does not allocate
+    if (growPool(pool) != 0) {
+        imagePoolDestroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+
+void imagePoolDestroy(ImagePool *pool) {
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    int inUse = pool->total - pool->availableCount;
+    pthread_mutex_unlock(&pool->mutex);
+
+    // freeing now would leave the holders with dangling planes
+    if (inUse > 0) {
+        fprintf(stderr, "Image pool destroyed with %d buffers in use, leaking it\n", inUse);
+        return;
+    }
+
+    for (int i = 0; i < pool->slabCount; ++i) {
+        free(pool->slabs[i]);
+    }
+    free(pool->slabs);
+    free(pool->available);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+
+int imagePoolAcquire(ImagePool *pool, ImageBuffer *image) {
+    if (!pool || !image) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->availableCount == 0 && growPool(pool) != 0) {
+        pthread_mutex_unlock(&pool->mutex);
+        return -1;
+    }
+    void *memory = pool->available[--pool->availableCount];
+    pthread_mutex_unlock(&pool->mutex);
+
+    int planes;
+    size_t offsets[IMAGE_MAX_PLANES];
+    size_t strides[IMAGE_MAX_PLANES];
+    planeLayout(pool->width, pool->height, pool->format, pool->stride, &planes, offsets, strides);
+
+    setPlanes(image, (unsigned char*)memory, pool->width, pool->height, pool->format,
+              planes, offsets, strides);
+    image->pool = pool;
+    image->allocation = memory;
+
+    return 0;
+}
+
+
+void imagePoolStats(ImagePool *pool, int *total, int *available) {
+    pthread_mutex_lock(&pool->mutex);
+    if (total) *total = pool->total;
+    if (available) *available = pool->availableCount;
+    pthread_mutex_unlock(&pool->mutex);
+}
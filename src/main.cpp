@@ -21,6 +21,9 @@ int main() {
     system.startRecording("front", "front_door.avi");
     // system.startRecording("back", "backyard.avi");
 
+    // Serve MJPEG streams on http://127.0.0.1:8080/ for headless boxes
+    // system.enableLiveView();
+
     // Start surveillance
     system.start();
 
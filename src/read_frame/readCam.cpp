@@ -6,6 +6,8 @@
 #include <iomanip>
 #include <sstream>
 
+#include "SnapshotService.h"
+
 using namespace std;
 using namespace cv;
 
@@ -14,6 +16,7 @@ private:
     string source;
     string windowName;
     VideoCapture cap;
+    SnapshotService &snapshots;
     int time_sleep = 10;
     float motion_thresh = 3;    // in percentage
     bool running;
@@ -74,8 +77,8 @@ private:
 
 
 public:
-    Camera(const string& src, const string& winName)
-        : source(src), windowName(winName), running(false) {}
+    Camera(const string& src, const string& winName, SnapshotService &snapshotService)
+        : source(src), windowName(winName), snapshots(snapshotService), running(false) {}
 
     bool open() {
         if (isdigit(source[0]) && source.size() == 1)
@@ -119,8 +122,9 @@ public:
                 else
                     cerr << "Error: wrong camera type, only USB or IP" << endl;
 
-                if (!imwrite(filename, frame)) {
-                    cerr << "Error: failed to write image: " << filename << endl;
+                // encoded and written off this thread
+                if (!snapshots.submit(frame, filename)) {
+                    cerr << "Error: snapshot queue full, dropped: " << filename << endl;
                 }
                 else {
                     cout << "Save: " << filename << endl;
@@ -152,8 +156,12 @@ int main() {
     string ipCamURL = "rtsp://your.IP.CAM.address";
     string usbCamIdx = "0";
 
-    Camera ipCam(ipCamURL, "IP Cam");
-    Camera usbCam(usbCamIdx, "USB Cam");
+    // one encoder pool shared by both capture threads
+    SnapshotService snapshots;
+    snapshots.start();
+
+    Camera ipCam(ipCamURL, "IP Cam", snapshots);
+    Camera usbCam(usbCamIdx, "USB Cam", snapshots);
 
     if (!ipCam.open() || !usbCam.open()) {
         cerr << "Failed to open cameras." << endl;
@@ -165,6 +173,7 @@ int main() {
 
     t1.join();
     t2.join();
+    snapshots.stop();
 
     return 0;
 }
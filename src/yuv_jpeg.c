@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <jerror.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YUV_JPEG_NEON
+#endif
+
+#include "yuv_jpeg.h"
+
+
+// libjpeg reports fatal errors through error_exit, which would exit() by default
+struct yuv_jpeg_error {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+// compresses into the encoder's own buffer rather than jpeg_mem_dest's,
+// whose allocated size libjpeg never reports
+struct yuv_jpeg_dest {
+    struct jpeg_destination_mgr pub;
+    struct yuv_jpeg_encoder *enc;
+};
+
+// smallest output buffer, doubled whenever a frame does not fit
+#define YUV_JPEG_MIN_OUT 65536
+
+struct yuv_jpeg_encoder {
+    struct jpeg_compress_struct cinfo;
+    struct yuv_jpeg_error err;
+    struct yuv_jpeg_dest dest;
+    unsigned char *out;             // jpeg output, kept between frames
+    unsigned long out_capacity;     // bytes allocated at out
+    unsigned char *strip;           // padded rows of one MCU row, all three components
+    size_t strip_capacity;
+};
+
+
+static void error_exit(j_common_ptr cinfo) {
+    struct yuv_jpeg_error *err = (struct yuv_jpeg_error *)cinfo->err;
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    fprintf(stderr, "JPEG encode failed: %s\n", message);
+    longjmp(err->jump, 1);
+}
+
+
+static void init_destination(j_compress_ptr cinfo) {
+    struct yuv_jpeg_encoder *enc = ((struct yuv_jpeg_dest *)cinfo->dest)->enc;
+
+    if (enc->out_capacity < YUV_JPEG_MIN_OUT) {
+        unsigned char *out = realloc(enc->out, YUV_JPEG_MIN_OUT);
+        if (!out) {
+            ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+        }
+        enc->out = out;
+        enc->out_capacity = YUV_JPEG_MIN_OUT;
+    }
+
+    cinfo->dest->next_output_byte = enc->out;
+    cinfo->dest->free_in_buffer = enc->out_capacity;
+}
+
+
+// called with the whole buffer full
+static boolean empty_output_buffer(j_compress_ptr cinfo) {
+    struct yuv_jpeg_encoder *enc = ((struct yuv_jpeg_dest *)cinfo->dest)->enc;
+    unsigned long used = enc->out_capacity;
+
+    unsigned char *out = realloc(enc->out, used * 2);
+    if (!out) {
+        ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+    }
+    enc->out = out;
+    enc->out_capacity = used * 2;
+
+    cinfo->dest->next_output_byte = out + used;
+    cinfo->dest->free_in_buffer = enc->out_capacity - used;
+    return TRUE;
+}
+
+
+static void term_destination(j_compress_ptr cinfo) {
+    (void)cinfo;
+}
+
+
+yuv_jpeg_encoder *yuv_jpeg_create(void) {
+    yuv_jpeg_encoder *enc = calloc(1, sizeof(*enc));
+    if (!enc) {
+        return NULL;
+    }
+
+    // creation only fails on a libjpeg version mismatch, which the default
+    // handler reports before exiting. encode errors come back to the caller
+    enc->cinfo.err = jpeg_std_error(&enc->err.pub);
+    jpeg_create_compress(&enc->cinfo);
+    enc->err.pub.error_exit = error_exit;
+
+    enc->dest.pub.init_destination = init_destination;
+    enc->dest.pub.empty_output_buffer = empty_output_buffer;
+    enc->dest.pub.term_destination = term_destination;
+    enc->dest.enc = enc;
+    enc->cinfo.dest = &enc->dest.pub;
+
+    return enc;
+}
+
+
+void yuv_jpeg_destroy(yuv_jpeg_encoder *enc) {
+    if (!enc) {
+        return;
+    }
+
+    jpeg_destroy_compress(&enc->cinfo);
+    free(enc->out);
+    free(enc->strip);
+    free(enc);
+}
+
+
+// one YUYV row into separate Y, U and V rows. width is even
+static void split_yuyv(const unsigned char *src, unsigned char *y, unsigned char *u,
+                       unsigned char *v, int width) {
+    int x = 0;
+
+#if defined(__SSE2__)
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= width; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 16));
+
+        // even bytes are luma, odd bytes alternate U and V
+        __m128i luma = _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low));
+        __m128i chroma = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        __m128i cb = _mm_packus_epi16(_mm_and_si128(chroma, low), zero);
+        __m128i cr = _mm_packus_epi16(_mm_srli_epi16(chroma, 8), zero);
+
+        _mm_storeu_si128((__m128i *)(y + x), luma);
+        _mm_storel_epi64((__m128i *)(u + x / 2), cb);
+        _mm_storel_epi64((__m128i *)(v + x / 2), cr);
+    }
+#elif defined(YUV_JPEG_NEON)
+    for (; x + 16 <= width; x += 16) {
+        uint8x8x4_t p = vld4_u8(src + 2 * x);     // Y0, U, Y1, V lanes
+        uint8x8x2_t luma;
+        luma.val[0] = p.val[0];
+        luma.val[1] = p.val[2];
+
+        vst2_u8(y + x, luma);
+        vst1_u8(u + x / 2, p.val[1]);
+        vst1_u8(v + x / 2, p.val[3]);
+    }
+#endif
+
+    for (; x < width; x += 2) {
+        const unsigned char *p = src + 2 * x;
+        y[x] = p[0];
+        y[x + 1] = p[2];
+        u[x / 2] = p[1];
+        v[x / 2] = p[3];
+    }
+}
+
+
+// one interleaved NV12 chroma row into U and V rows of count samples
+static void split_uv(const unsigned char *src, unsigned char *u, unsigned char *v, int count) {
+    int x = 0;
+
+#if defined(__SSE2__)
+    const __m128i low = _mm_set1_epi16(0x00ff);
+    for (; x + 16 <= count; x += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * x));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * x + 16));
+
+        _mm_storeu_si128((__m128i *)(u + x), _mm_packus_epi16(_mm_and_si128(a, low), _mm_and_si128(b, low)));
+        _mm_storeu_si128((__m128i *)(v + x), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#elif defined(YUV_JPEG_NEON)
+    for (; x + 16 <= count; x += 16) {
+        uint8x16x2_t p = vld2q_u8(src + 2 * x);
+        vst1q_u8(u + x, p.val[0]);
+        vst1q_u8(v + x, p.val[1]);
+    }
+#endif
+
+    for (; x < count; x++) {
+        u[x] = src[2 * x];
+        v[x] = src[2 * x + 1];
+    }
+}
+
+
+// libjpeg reads whole DCT blocks, repeat the edge sample into the padding
+static void pad_row(unsigned char *row, size_t width, size_t padded) {
+    if (padded > width) {
+        memset(row + width, row[width - 1], padded - width);
+    }
+}
+
+
+// feeds the frame to a started compressor one MCU row at a time
+static void write_rows(struct jpeg_compress_struct *cinfo, unsigned char *strip,
+                       const unsigned char *data, int width, int height, size_t stride,
+                       yuv_format format) {
+    int chroma_w = (width + 1) / 2;
+    int chroma_h = format == YUV_FORMAT_YUYV ? height : (height + 1) / 2;
+    size_t chroma_stride = format == YUV_FORMAT_I420 ? stride / 2 : stride;
+
+    const unsigned char *y_plane = data;
+    const unsigned char *u_plane = data + stride * height;     // UV for NV12
+    const unsigned char *v_plane = u_plane + chroma_stride * chroma_h;
+
+    // row lengths libjpeg reads: luma in 8-sample blocks, chroma at half width
+    size_t y_pad = (size_t)(width + 7) / 8 * 8;
+    size_t c_pad = (size_t)(width + 15) / 16 * 8;
+    int y_rows = cinfo->comp_info[0].v_samp_factor * DCTSIZE;
+    int c_rows = DCTSIZE;
+
+    unsigned char *y_strip = strip;
+    unsigned char *u_strip = y_strip + y_pad * y_rows;
+    unsigned char *v_strip = u_strip + c_pad * c_rows;
+
+    JSAMPROW y_ptrs[2 * DCTSIZE];
+    JSAMPROW u_ptrs[DCTSIZE];
+    JSAMPROW v_ptrs[DCTSIZE];
+    JSAMPARRAY planes[3] = {y_ptrs, u_ptrs, v_ptrs};
+
+    // planar luma is read in place when its stride already covers the padding
+    int y_in_place = format != YUV_FORMAT_YUYV && stride >= y_pad;
+
+    while (cinfo->next_scanline < cinfo->image_height) {
+        int top = cinfo->next_scanline;
+
+        // rows past the bottom edge repeat the last one
+        for (int r = 0; r < y_rows; r++) {
+            int row = top + r;
+            if (row >= height) {
+                y_ptrs[r] = y_ptrs[r - 1];
+                if (format == YUV_FORMAT_YUYV) {
+                    u_ptrs[r] = u_ptrs[r - 1];
+                    v_ptrs[r] = v_ptrs[r - 1];
+                }
+                continue;
+            }
+
+            if (format == YUV_FORMAT_YUYV) {
+                y_ptrs[r] = y_strip + r * y_pad;
+                u_ptrs[r] = u_strip + r * c_pad;
+                v_ptrs[r] = v_strip + r * c_pad;
+                split_yuyv(y_plane + row * stride, y_ptrs[r], u_ptrs[r], v_ptrs[r], width);
+                pad_row(u_ptrs[r], chroma_w, c_pad);
+                pad_row(v_ptrs[r], chroma_w, c_pad);
+            }
+            else if (y_in_place) {
+                y_ptrs[r] = (JSAMPROW)(y_plane + row * stride);
+                continue;
+            }
+            else {
+                y_ptrs[r] = y_strip + r * y_pad;
+                memcpy(y_ptrs[r], y_plane + row * stride, width);
+            }
+            pad_row(y_ptrs[r], width, y_pad);
+        }
+
+        for (int r = 0; format != YUV_FORMAT_YUYV && r < c_rows; r++) {
+            int row = top / 2 + r;
+            if (row >= chroma_h) {
+                u_ptrs[r] = u_ptrs[r - 1];
+                v_ptrs[r] = v_ptrs[r - 1];
+                continue;
+            }
+
+            u_ptrs[r] = u_strip + r * c_pad;
+            v_ptrs[r] = v_strip + r * c_pad;
+            if (format == YUV_FORMAT_NV12) {
+                split_uv(u_plane + row * chroma_stride, u_ptrs[r], v_ptrs[r], chroma_w);
+            }
+            else {
+                memcpy(u_ptrs[r], u_plane + row * chroma_stride, chroma_w);
+                memcpy(v_ptrs[r], v_plane + row * chroma_stride, chroma_w);
+            }
+            pad_row(u_ptrs[r], chroma_w, c_pad);
+            pad_row(v_ptrs[r], chroma_w, c_pad);
+        }
+
+        jpeg_write_raw_data(cinfo, planes, y_rows);
+    }
+}
+
+
+// runs the compressor, kept apart from yuv_jpeg_encode so nothing it
+// changes is live across the setjmp
+static int compress_frame(yuv_jpeg_encoder *enc, const unsigned char *data, int width, int height,
+                          size_t stride, yuv_format format, int quality) {
+    struct jpeg_compress_struct *cinfo = &enc->cinfo;
+
+    if (setjmp(enc->err.jump)) {
+        // resets the compressor so the next frame can use it again
+        jpeg_abort_compress(cinfo);
+        return -1;
+    }
+
+    cinfo->image_width = width;
+    cinfo->image_height = height;
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_YCbCr;
+
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality < 1 ? 1 : (quality > 100 ? 100 : quality), TRUE);
+    cinfo->dct_method = JDCT_IFAST;
+    cinfo->raw_data_in = TRUE;
+#if JPEG_LIB_VERSION >= 70
+    cinfo->do_fancy_downsampling = FALSE;
+#endif
+
+    // the sampling factors are those of the source, nothing is resampled:
+    // 4:2:2 for YUYV, 4:2:0 for the planar formats
+    cinfo->comp_info[0].h_samp_factor = 2;
+    cinfo->comp_info[0].v_samp_factor = format == YUV_FORMAT_YUYV ? 1 : 2;
+    cinfo->comp_info[1].h_samp_factor = 1;
+    cinfo->comp_info[1].v_samp_factor = 1;
+    cinfo->comp_info[2].h_samp_factor = 1;
+    cinfo->comp_info[2].v_samp_factor = 1;
+
+    jpeg_start_compress(cinfo, TRUE);
+    write_rows(cinfo, enc->strip, data, width, height, stride, format);
+    jpeg_finish_compress(cinfo);
+
+    return 0;
+}
+
+
+int yuv_jpeg_encode(yuv_jpeg_encoder *enc, const unsigned char *data, int width, int height,
+                    size_t stride, yuv_format format, int quality,
+                    const unsigned char **out, unsigned long *out_size) {
+    if (!enc || !data || !out || !out_size || width <= 0 || height <= 0) {
+        return -1;
+    }
+
+    if (format == YUV_FORMAT_YUYV && (width & 1)) {
+        fprintf(stderr, "YUYV frames need an even width\n");
+        return -1;
+    }
+
+    size_t min_stride = format == YUV_FORMAT_YUYV ? (size_t)width * 2 : (size_t)width;
+    if (stride == 0) {
+        stride = min_stride;
+    }
+    else if (stride < min_stride) {
+        fprintf(stderr, "YUV stride is shorter than a row\n");
+        return -1;
+    }
+
+    // strip buffers for one MCU row: 8 or 16 luma rows and 8 rows per chroma plane
+    int y_rows = format == YUV_FORMAT_YUYV ? DCTSIZE : 2 * DCTSIZE;
+    size_t y_pad = (size_t)(width + 7) / 8 * 8;
+    size_t c_pad = (size_t)(width + 15) / 16 * 8;
+    size_t strip_size = y_pad * y_rows + 2 * c_pad * DCTSIZE;
+
+    if (strip_size > enc->strip_capacity) {
+        unsigned char *strip = realloc(enc->strip, strip_size);
+        if (!strip) {
+            perror("realloc");
+            return -1;
+        }
+        enc->strip = strip;
+        enc->strip_capacity = strip_size;
+    }
+
+    // the output buffer grows to the largest frame and stays
+    if (compress_frame(enc, data, width, height, stride, format, quality) != 0) {
+        return -1;
+    }
+
+    *out = enc->out;
+    *out_size = enc->out_capacity - enc->dest.pub.free_in_buffer;
+
+    return 0;
+}
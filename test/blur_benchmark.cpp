@@ -0,0 +1,96 @@
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+#include "BlurEngine.h"
+
+
+namespace {
+
+// average milliseconds per call over iterations
+template <typename Fn>
+double timeMs(int iterations, Fn fn) {
+    fn();       // warm up caches and the scratch buffers
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+}
+
+
+// mean absolute difference away from the borders, where the methods
+// extrapolate differently
+double meanError(const cv::Mat &a, const cv::Mat &b, int border) {
+    cv::Rect inner(border, border, a.cols - 2 * border, a.rows - 2 * border);
+    cv::Mat diff;
+    cv::absdiff(a(inner), b(inner), diff);
+    return cv::mean(diff)[0];
+}
+
+}   // namespace
+
+
+// times the three BlurEngine methods on a 1080p grey frame as sigma grows,
+// the motion detector's use. the recursive and stacked-box costs should stay
+// flat while the Gaussian one grows with the kernel. also checks that the
+// approximations stay close to the exact blur and that the output buffer is
+// reused. usage: blur_benchmark [iterations]
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 10;
+
+    cv::Mat src(1080, 1920, CV_8UC1);
+    cv::randu(src, cv::Scalar::all(0), cv::Scalar::all(64));
+    for (int y = 0; y < src.rows; y++) {
+        uchar *row = src.ptr<uchar>(y);
+        for (int x = 0; x < src.cols; x++) {
+            row[x] = cv::saturate_cast<uchar>(row[x] + (x + y) % 192);
+        }
+    }
+
+    const BlurMethod methods[] = {BlurMethod::GAUSSIAN, BlurMethod::RECURSIVE, BlurMethod::STACKED_BOX};
+    const double maxError[] = {0.0, 1.5, 1.5};
+    const double sigmas[] = {3, 6, 12, 24};
+
+    bool ok = true;
+    for (int m = 0; m < 3; m++) {
+        BlurEngine engine(methods[m]);
+        cv::Mat dst;
+        double firstMs = 0;
+        double lastMs = 0;
+
+        for (double sigma : sigmas) {
+            double ms = timeMs(iterations, [&] { engine.blur(src, dst, 0, sigma); });
+            const uchar *data = dst.data;
+            engine.blur(src, dst, 0, sigma);
+            if (dst.data != data) {
+                std::cerr << BlurEngine::methodName(methods[m]) << ": output reallocated" << std::endl;
+                ok = false;
+            }
+
+            cv::Mat exact;
+            cv::GaussianBlur(src, exact, cv::Size(0, 0), sigma);
+            double error = meanError(dst, exact, (int)(3 * sigma) + 1);
+
+            std::cout << BlurEngine::methodName(methods[m]) << " sigma " << sigma << ": "
+                      << ms << " ms, mean error " << error << std::endl;
+
+            if (error > maxError[m]) {
+                std::cerr << "  too far from the exact blur" << std::endl;
+                ok = false;
+            }
+
+            if (firstMs == 0) {
+                firstMs = ms;
+            }
+            lastMs = ms;
+        }
+
+        std::cout << "  sigma " << sigmas[3] << " costs " << lastMs / firstMs << "x sigma "
+                  << sigmas[0] << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -8,77 +8,38 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <linux/videodev2.h>
-#include <jpeglib.h>
+
+#include "yuv_jpeg.h"
+
+// gcc -std=gnu99 -Iinclude test/capture_jpeg.c src/yuv_jpeg.c -ljpeg -o capture_jpeg
 
 struct buffer {
     void   *start;
     size_t  length;
 };
 
-static void yuyv_to_jpeg(unsigned char *yuyv, int width, int height, const char *filename) {
-    FILE *outfile = fopen(filename, "wb");
-    if (!outfile) {
-        perror("fopen");
-        return;
-    }
+static void yuyv_to_jpeg(yuv_jpeg_encoder *enc, unsigned char *yuyv, int width, int height,
+                         size_t stride, const char *filename) {
+    const unsigned char *jpeg;
+    unsigned long jpeg_size;
 
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    JSAMPROW row_pointer[1];
-    unsigned char *rgb = malloc(width * height * 3);
-    if (!rgb) {
-        perror("malloc");
-        fclose(outfile);
+    // YUYV goes to libjpeg as is, no RGB round trip and no frame-sized buffer
+    if (yuv_jpeg_encode(enc, yuyv, width, height, stride, YUV_FORMAT_YUYV, 90,
+                        &jpeg, &jpeg_size) != 0) {
+        fprintf(stderr, "Failed to encode %s\n", filename);
         return;
     }
 
-    // YUYV → RGB24
-    for (int i = 0, j = 0; i < width * height * 2; i += 4) {
-        int y0 = yuyv[i + 0];
-        int u  = yuyv[i + 1] - 128;
-        int y1 = yuyv[i + 2];
-        int v  = yuyv[i + 3] - 128;
-
-        int r0 = y0 + 1.402 * v;
-        int g0 = y0 - 0.344136 * u - 0.714136 * v;
-        int b0 = y0 + 1.772 * u;
-
-        int r1 = y1 + 1.402 * v;
-        int g1 = y1 - 0.344136 * u - 0.714136 * v;
-        int b1 = y1 + 1.772 * u;
-
-        rgb[j++] = r0 < 0 ? 0 : (r0 > 255 ? 255 : r0);
-        rgb[j++] = g0 < 0 ? 0 : (g0 > 255 ? 255 : g0);
-        rgb[j++] = b0 < 0 ? 0 : (b0 > 255 ? 255 : b0);
-
-        rgb[j++] = r1 < 0 ? 0 : (r1 > 255 ? 255 : r1);
-        rgb[j++] = g1 < 0 ? 0 : (g1 > 255 ? 255 : g1);
-        rgb[j++] = b1 < 0 ? 0 : (b1 > 255 ? 255 : b1);
+    FILE *outfile = fopen(filename, "wb");
+    if (!outfile) {
+        perror("fopen");
+        return;
     }
 
-    // JPEG compression
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
-    jpeg_stdio_dest(&cinfo, outfile);
-
-    cinfo.image_width = width;
-    cinfo.image_height = height;
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, 90, TRUE);
-    jpeg_start_compress(&cinfo, TRUE);
-
-    while (cinfo.next_scanline < cinfo.image_height) {
-        row_pointer[0] = &rgb[cinfo.next_scanline * width * 3];
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+    if (fwrite(jpeg, 1, jpeg_size, outfile) != jpeg_size) {
+        perror("fwrite");
     }
-
-    jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
     fclose(outfile);
-    free(rgb);
 
     printf("Saved %s\n", filename);
 }
@@ -167,7 +128,14 @@ int main() {
     }
 
     // Save to JPEG
-    yuyv_to_jpeg(buffers[0].start, fmt.fmt.pix.width, fmt.fmt.pix.height, "frame.jpg");
+    yuv_jpeg_encoder *enc = yuv_jpeg_create();
+    if (!enc) {
+        fprintf(stderr, "Failed to create JPEG encoder\n");
+        return 1;
+    }
+    yuyv_to_jpeg(enc, buffers[0].start, fmt.fmt.pix.width, fmt.fmt.pix.height,
+                 fmt.fmt.pix.bytesperline, "frame.jpg");
+    yuv_jpeg_destroy(enc);
 
     // Stop streaming
     if (ioctl(fd, VIDIOC_STREAMOFF, &type) < 0) {
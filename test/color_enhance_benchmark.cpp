@@ -0,0 +1,164 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+#include "DisplayEnhancement.h"
+#include "EnhancementPipeline.h"
+
+
+namespace {
+
+// EnhancementPipeline spelled out with plain OpenCV calls and float
+// arithmetic: the colour pass, then every channel plus amount times the
+// luma detail, blurred at half size as the pipeline does
+cv::Mat referencePipeline(DisplayEnhancement &enhancement, const cv::Mat &src,
+                          const EnhancementSettings &settings) {
+    cv::Mat colour = enhancement.enhanceColor(src, settings.contrast, settings.brightness,
+                                              settings.saturation);
+
+    cv::Mat luma, half, blurred;
+    cv::cvtColor(colour, luma, cv::COLOR_BGR2GRAY);
+    cv::resize(luma, half, cv::Size((luma.cols + 1) / 2, (luma.rows + 1) / 2), 0, 0, cv::INTER_AREA);
+    cv::GaussianBlur(half, half, cv::Size(0, 0), settings.sharpenSigma / 2);
+    cv::resize(half, blurred, luma.size(), 0, 0, cv::INTER_LINEAR);
+
+    cv::Mat out(colour.size(), colour.type());
+    for (int y = 0; y < out.rows; y++) {
+        const uchar *c = colour.ptr<uchar>(y);
+        const uchar *l = luma.ptr<uchar>(y);
+        const uchar *b = blurred.ptr<uchar>(y);
+        uchar *o = out.ptr<uchar>(y);
+        for (int x = 0; x < out.cols * 3; x++) {
+            double detail = settings.sharpness * (l[x / 3] - b[x / 3]);
+            o[x] = cv::saturate_cast<uchar>(c[x] + detail);
+        }
+    }
+
+    return out;
+}
+
+}   // namespace
+
+
+// times contrast + saturation for a 4x4 wall of 480x270 tiles, the
+// separate convertTo and HSV round trip against the fused ColorEnhancer,
+// then all three DisplayEnhancement steps against EnhancementPipeline.
+// checks the pipeline against a plain reference and that it keeps writing
+// into the same buffers. usage: color_enhance_benchmark [rounds]
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? std::max(1, atoi(argv[1])) : 20;
+    const int cameras = 16;
+    const double alpha = 1.2, saturation = 1.4;
+    const int beta = 10;
+
+    std::vector<cv::Mat> tiles;
+    for (int i = 0; i < cameras; i++) {
+        cv::Mat tile(270, 480, CV_8UC3);
+        cv::randu(tile, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::GaussianBlur(tile, tile, cv::Size(0, 0), 4);
+        tiles.push_back(tile);
+    }
+
+    DisplayEnhancement enhancement;
+    std::vector<cv::Mat> separate(cameras), fused(cameras);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < cameras; i++) {
+            separate[i] = enhancement.enhanceSaturation(enhancement.enhanceContrast(tiles[i], alpha, beta),
+                                                        saturation);
+        }
+    }
+    double separateMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count() / rounds;
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < cameras; i++) {
+            fused[i] = enhancement.enhanceColor(tiles[i], alpha, beta, saturation);
+        }
+    }
+    double fusedMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count() / rounds;
+
+    // luma-based saturation is not HSV, only report how far apart they are
+    double diff = 0;
+    for (int i = 0; i < cameras; i++) {
+        diff += cv::norm(separate[i], fused[i], cv::NORM_L1) / (double)(tiles[i].total() * 3);
+    }
+
+    std::cout << cameras << " cameras at 480x270: contrast + HSV saturation " << separateMs
+              << " ms, fused " << fusedMs << " ms per wall, mean difference "
+              << diff / cameras << " levels" << std::endl;
+
+    // the full chain, fresh Mats per step against preallocated outputs
+    EnhancementSettings settings;
+    settings.contrast = alpha;
+    settings.brightness = beta;
+    settings.saturation = saturation;
+    settings.sharpness = 0.8;
+    EnhancementPipeline pipeline(settings);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < cameras; i++) {
+            cv::Mat contrast = enhancement.enhanceContrast(tiles[i], alpha, beta);
+            separate[i] = enhancement.enhanceSharpness(enhancement.enhanceSaturation(contrast, saturation),
+                                                       settings.sharpness);
+        }
+    }
+    double chainMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count() / rounds;
+
+    // the outputs already have the tiles' size and type, the pipeline must
+    // write into them rather than allocate
+    std::vector<const uchar *> buffers;
+    for (int i = 0; i < cameras; i++) {
+        buffers.push_back(fused[i].data);
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < cameras; i++) {
+            pipeline.process(tiles[i], fused[i]);
+        }
+    }
+    double pipelineMs = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count() / rounds;
+
+    std::cout << "with sharpening: DisplayEnhancement " << chainMs << " ms, EnhancementPipeline "
+              << pipelineMs << " ms per wall" << std::endl;
+
+    bool ok = true;
+    for (int i = 0; i < cameras; i++) {
+        if (fused[i].data != buffers[i]) {
+            std::cerr << "EnhancementPipeline reallocated the output of tile " << i << std::endl;
+            ok = false;
+        }
+    }
+
+    // only the fixed-point sharpening amount and its rounding may differ
+    double worst = 0;
+    for (int i = 0; i < cameras; i++) {
+        cv::Mat reference = referencePipeline(enhancement, tiles[i], settings);
+        worst = std::max(worst, cv::norm(reference, fused[i], cv::NORM_INF));
+    }
+    std::cout << "EnhancementPipeline against the reference: at most " << worst << " levels apart"
+              << std::endl;
+    if (worst > 1) {
+        std::cerr << "EnhancementPipeline differs from the reference" << std::endl;
+        ok = false;
+    }
+
+    // brightness and contrast alone must match convertTo exactly
+    cv::Mat plain = enhancement.enhanceContrast(tiles[0], alpha, beta);
+    cv::Mat same = enhancement.enhanceColor(tiles[0], alpha, beta, 1.0);
+    if (cv::norm(plain, same, cv::NORM_INF) > 1) {
+        std::cerr << "Fused contrast differs from convertTo" << std::endl;
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
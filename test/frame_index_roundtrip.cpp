@@ -0,0 +1,154 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+
+#include "FrameIndex.h"
+
+
+namespace {
+
+const int kFrames = 1000;
+const int kFrameMs = 40;
+const int kKeyframeInterval = 25;
+
+
+bool check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+
+// motion in a few runs, the last one reaching the final frame
+bool hasMotion(int frame) {
+    return (frame >= 100 && frame < 130) || (frame >= 400 && frame < 401) ||
+           (frame >= 650 && frame < 700) || frame >= 990;
+}
+
+
+bool writeIndex(const std::string &path, uint32_t contents) {
+    FrameIndexWriter writer;
+    if (!writer.open(path, 25.0, cv::Size(640, 480), contents)) {
+        return false;
+    }
+
+    for (int i = 0; i < kFrames; i++) {
+        FrameIndexEntry entry;
+        entry.elapsedMs = (int64_t)i * kFrameMs - 200;  // pre-roll before the start
+        entry.offset = (contents & INDEX_HAS_OFFSETS) ? (uint64_t)i * 1000 : FRAME_OFFSET_UNKNOWN;
+        entry.frameNumber = i;
+        entry.flags = hasMotion(i) ? FRAME_MOTION : 0;
+        if ((contents & INDEX_HAS_KEYFRAMES) && i % kKeyframeInterval == 0) {
+            entry.flags |= FRAME_KEYFRAME;
+        }
+        if (!writer.append(entry)) {
+            return false;
+        }
+    }
+
+    return writer.close();
+}
+
+
+// the answers a linear scan gives
+int expectedSeek(int frame, bool keyframes) {
+    return keyframes ? frame - frame % kKeyframeInterval : frame;
+}
+
+
+int expectedMotion(int frame) {
+    for (int i = std::max(0, frame); i < kFrames; i++) {
+        if (hasMotion(i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+}   // namespace
+
+
+// writes frame indexes with and without keyframes, reads them back and
+// checks the header, every entry, seeks and motion lookups against a linear
+// scan, and that an index cut short mid-entry still opens
+int main() {
+    char scratch[] = "/tmp/frame_index_XXXXXX";
+    if (!mkdtemp(scratch)) {
+        std::cerr << "Error: can't create a scratch directory" << std::endl;
+        return -1;
+    }
+    std::string path = std::string(scratch) + "/recording.avi.idx";
+
+    bool ok = true;
+    const uint32_t variants[] = {INDEX_HAS_OFFSETS | INDEX_HAS_KEYFRAMES, 0};
+
+    for (uint32_t contents : variants) {
+        bool keyframes = (contents & INDEX_HAS_KEYFRAMES) != 0;
+        int64_t before = FrameIndexReader::nowMs();
+        ok &= check(writeIndex(path, contents), "index written");
+        int64_t after = FrameIndexReader::nowMs();
+
+        FrameIndexReader reader;
+        if (!check(reader.open(path), "index opened")) {
+            ok = false;
+            continue;
+        }
+
+        int64_t start = reader.getStartTime();
+        ok &= check(start >= before && start <= after, "start time is the wall clock");
+        ok &= check(reader.getFrameSize() == cv::Size(640, 480) && reader.getFps() == 25.0, "header");
+        ok &= check(reader.hasKeyframes() == keyframes && reader.hasOffsets() == keyframes, "contents");
+        ok &= check(reader.size() == (size_t)kFrames, "every entry read back");
+
+        bool entriesMatch = true;
+        for (int i = 0; i < kFrames && i < (int)reader.size(); i++) {
+            const FrameIndexEntry &entry = reader.at(i);
+            entriesMatch &= entry.frameNumber == (uint32_t)i &&
+                            reader.timeOf(entry) == start + i * kFrameMs - 200 &&
+                            ((entry.flags & FRAME_MOTION) != 0) == hasMotion(i);
+        }
+        ok &= check(entriesMatch, "entries round trip");
+        ok &= check(reader.getEndTime() == start + (kFrames - 1) * kFrameMs - 200, "end time");
+
+        // every frame time and the gaps between them
+        bool seeksMatch = true;
+        bool motionMatches = true;
+        for (int i = 0; i < kFrames; i++) {
+            for (int64_t delta = 0; delta < kFrameMs; delta += kFrameMs / 2) {
+                int64_t when = start + i * kFrameMs - 200 + delta;
+                FrameIndexEntry entry;
+                seeksMatch &= reader.seekToTime(when, entry) &&
+                              (int)entry.frameNumber == expectedSeek(i, keyframes);
+
+                int wanted = expectedMotion(delta ? i + 1 : i);
+                bool found = reader.nextMotion(when, entry);
+                motionMatches &= wanted < 0 ? !found : found && (int)entry.frameNumber == wanted;
+            }
+        }
+        ok &= check(seeksMatch, "seekToTime matches a linear scan");
+        ok &= check(motionMatches, "nextMotion matches a linear scan");
+
+        FrameIndexEntry entry;
+        ok &= check(!reader.seekToTime(start - 201, entry), "nothing before the first frame");
+        ok &= check(reader.nextMotion(start - 10000, entry) && entry.frameNumber == 100, "motion from before the start");
+    }
+
+    // a crash mid-write leaves a partial entry, the rest still reads
+    ok &= check(writeIndex(path, INDEX_HAS_KEYFRAMES), "index written");
+    ok &= check(truncate(path.c_str(), sizeof(FrameIndexHeader) + 10 * sizeof(FrameIndexEntry) + 7) == 0,
+                "index truncated");
+    FrameIndexReader reader;
+    ok &= check(reader.open(path) && reader.size() == 10, "truncated index reads its complete entries");
+    reader.close();
+
+    remove(path.c_str());
+    rmdir(scratch);
+
+    return ok ? 0 : 1;
+}
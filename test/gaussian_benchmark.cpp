@@ -0,0 +1,96 @@
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+#include "filters.h"
+#include "MatImage.h"
+
+
+namespace {
+
+// average milliseconds per call over iterations
+template <typename Fn>
+double timeMs(int iterations, Fn fn) {
+    fn();       // warm up caches and thread creation
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+}
+
+}   // namespace
+
+
+// times applyGaussianFilter against cv::GaussianBlur on a synthetic 1080p
+// frame and checks both agree. usage: gaussian_benchmark [iterations]
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 10;
+    const int width = 1920;
+    const int height = 1080;
+
+    // noise over a gradient, so the blur has edges and flat areas to work on
+    cv::Mat src(height, width, CV_8UC3);
+    cv::randu(src, cv::Scalar::all(0), cv::Scalar::all(64));
+    for (int y = 0; y < height; y++) {
+        uchar *row = src.ptr<uchar>(y);
+        for (int x = 0; x < width * 3; x++) {
+            row[x] = cv::saturate_cast<uchar>(row[x] + (x / 3 + y) % 192);
+        }
+    }
+
+    // the filter reads the Mat in place and writes into an aligned buffer
+    // that OpenCV then reads as a Mat, nothing is copied either way
+    ImageBuffer input;
+    OwnedImage output(width, height, PIXEL_FORMAT_BGR24);
+    if (!imageView(src, PIXEL_FORMAT_BGR24, input) || !output.valid()) {
+        std::cerr << "Failed to set up the image buffers" << std::endl;
+        return 1;
+    }
+    cv::Mat ours = output.mat();
+    cv::Mat reference;
+
+    std::cout << "Gaussian blur " << width << "x" << height << " BGR, SIMD path: "
+              << filterSimdPath() << std::endl;
+
+    bool ok = true;
+    const int sizes[] = {3, 5, 9, 15};
+    for (int size : sizes) {
+        GaussianKernel *kernel = createGaussianKernel(size, 0);
+        if (!kernel) {
+            std::cerr << "Failed to create kernel of size " << size << std::endl;
+            return 1;
+        }
+
+        // pass the derived sigma so both sides use the same weights
+        double sigma = kernel->sigma;
+        double singleMs = timeMs(iterations, [&]() {
+            applyGaussianFilter(&input, output.get(), kernel, FILTER_BORDER_REFLECT_101, 1);
+        });
+        double threadedMs = timeMs(iterations, [&]() {
+            applyGaussianFilter(&input, output.get(), kernel, FILTER_BORDER_REFLECT_101, 0);
+        });
+        double opencvMs = timeMs(iterations, [&]() {
+            cv::GaussianBlur(src, reference, cv::Size(size, size), sigma, sigma,
+                             cv::BORDER_REFLECT_101);
+        });
+
+        double maxDiff = cv::norm(ours, reference, cv::NORM_INF);
+        std::cout << "  " << size << "x" << size << " sigma " << sigma
+                  << ": filters.c " << singleMs << " ms (1 thread), "
+                  << threadedMs << " ms (all cores), OpenCV " << opencvMs
+                  << " ms, max diff " << maxDiff << std::endl;
+
+        // both round in fixed point, a level or two either way is expected
+        if (maxDiff > 2) {
+            std::cerr << "Result differs from cv::GaussianBlur" << std::endl;
+            ok = false;
+        }
+
+        freeKernel(kernel);
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+#include "image_buffer.h"
+#include "MatImage.h"
+
+
+namespace {
+
+// average microseconds per call over iterations
+template <typename Fn>
+double timeUs(int iterations, Fn fn) {
+    fn();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+
+bool aligned(const ImageBuffer &image) {
+    return (uintptr_t)image.data[0] % IMAGE_ALIGNMENT == 0 && image.stride[0] % IMAGE_ALIGNMENT == 0;
+}
+
+
+bool check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+}   // namespace
+
+
+// checks ImagePool the way SnapshotService uses it: aligned rows, the cap,
+// buffers coming back instead of new ones, Mat views that copyTo writes into
+// in place, and acquire and release from several threads at once. then times
+// a pooled 1080p BGR buffer against a fresh allocation.
+// usage: image_pool_benchmark [iterations]
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 1000;
+    const int width = 1920;
+    const int height = 1080;
+    const int slab = 4;
+    const int cap = 6;
+
+    bool ok = true;
+    ImagePool *pool = imagePoolCreate(width, height, PIXEL_FORMAT_BGR24, slab, cap);
+    if (!check(pool != nullptr, "pool created")) {
+        return 1;
+    }
+
+    // fill the pool to its cap, one more is refused
+    std::vector<OwnedImage> held;
+    for (int i = 0; i < cap; i++) {
+        held.push_back(OwnedImage(pool));
+        ok &= check(held.back().valid(), "acquire below the cap");
+        ok &= check(aligned(*held.back().get()), "rows aligned");
+    }
+    OwnedImage extra(pool);
+    ok &= check(!extra.valid(), "acquire past the cap refused");
+
+    int total = 0, available = 0;
+    imagePoolStats(pool, &total, &available);
+    ok &= check(total == cap && available == 0, "stats at the cap");
+
+    // a released buffer is handed out again
+    const unsigned char *first = held[0].get()->data[0];
+    held[0].reset();
+    OwnedImage again(pool);
+    ok &= check(again.valid() && again.get()->data[0] == first, "released buffer reused");
+    held.clear();
+    again.reset();
+
+    imagePoolStats(pool, &total, &available);
+    ok &= check(total == cap && available == cap, "every buffer back");
+
+    // a frame copied into the view lands in the pooled memory
+    cv::Mat frame(height, width, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    {
+        OwnedImage image(pool);
+        cv::Mat view = image.mat();
+        const uchar *data = view.data;
+        frame.copyTo(view);
+        ok &= check(view.data == data, "copyTo wrote into the pooled buffer");
+        cv::Mat diff;
+        cv::absdiff(view, frame, diff);
+        ok &= check(cv::countNonZero(diff.reshape(1)) == 0, "copy matches");
+    }
+
+    // several threads churning through the pool never get more than the cap
+    // and never the same buffer twice
+    std::atomic<int> refused(0);
+    std::atomic<int> inUse(0);
+    std::atomic<int> peak(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&] {
+            for (int i = 0; i < iterations; i++) {
+                OwnedImage image(pool);
+                if (!image.valid()) {
+                    refused++;
+                    continue;
+                }
+                int now = ++inUse;
+                int seen = peak.load();
+                while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+                }
+                image.get()->data[0][0] = (unsigned char)i;
+                inUse--;
+            }
+        }));
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    imagePoolStats(pool, &total, &available);
+    ok &= check(peak <= cap && total <= cap && available == total, "threads stayed within the cap");
+
+    double pooledUs = timeUs(iterations, [&] { OwnedImage image(pool); });
+    double heapUs = timeUs(iterations, [&] { OwnedImage image(width, height, PIXEL_FORMAT_BGR24); });
+
+    std::cout << width << "x" << height << " BGR: pooled acquire+release " << pooledUs
+              << " us, fresh allocation " << heapUs << " us, " << refused
+              << " acquires refused at the cap of " << cap << std::endl;
+
+    imagePoolDestroy(pool);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <opencv2/opencv.hpp>
+
+#include "MosaicCompositor.h"
+#include "LiveViewServer.h"
+
+
+namespace {
+
+int connectTo(int port, int timeoutMs) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+bool sendAll(int fd, const std::string &data) {
+    return send(fd, data.data(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size();
+}
+
+
+// reads until the server closes the connection or the receive timeout hits.
+// closed tells which
+std::string readAll(int fd, bool &closed) {
+    std::string data;
+    char buffer[4096];
+    closed = false;
+    while (true) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            data.append(buffer, n);
+            continue;
+        }
+        closed = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        return data;
+    }
+}
+
+
+// a whole request on a fresh connection, the response as the server closed it
+std::string request(int port, const std::string &text) {
+    int fd = connectTo(port, 3000);
+    if (fd < 0) {
+        return "";
+    }
+
+    bool closed;
+    sendAll(fd, text);
+    std::string response = readAll(fd, closed);
+    close(fd);
+
+    return response;
+}
+
+
+bool startsWith(const std::string &text, const std::string &prefix) {
+    return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+
+size_t countOf(const std::string &text, const std::string &needle) {
+    size_t count = 0;
+    for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1)) {
+        count++;
+    }
+    return count;
+}
+
+
+bool check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+}   // namespace
+
+
+// runs LiveViewServer on loopback against a compositor fed with synthetic
+// frames: request parsing and the index page's escaping, the 404, 405 and
+// 503 answers, dropping a client that never finishes its request, and one
+// encode per new frame however many clients watch a stream
+int main() {
+    const std::string odd = "<lobby&\"door\">";
+    std::vector<std::string> cameras;
+    cameras.push_back("front");
+    cameras.push_back(odd);
+    MosaicSettings mosaicSettings;
+    mosaicSettings.canvasSize = cv::Size(320, 240);
+    MosaicCompositor mosaic(cameras, mosaicSettings);
+
+    LiveViewSettings settings;
+    settings.maxClients = 3;
+    settings.maxFps = 20;
+    settings.encoderThreads = 2;
+
+    // a free port somewhere above the default
+    LiveViewServer *server = nullptr;
+    int port = 0;
+    for (int candidate = 18080; candidate < 18180 && !server; candidate++) {
+        settings.port = candidate;
+        server = new LiveViewServer(mosaic, settings);
+        if (server->start()) {
+            port = candidate;
+        }
+        else {
+            delete server;
+            server = nullptr;
+        }
+    }
+    if (!server) {
+        std::cerr << "No free port for the live view server" << std::endl;
+        return 1;
+    }
+
+    bool ok = true;
+
+    // parsing and the index page
+    std::string index = request(port, "GET / HTTP/1.0\r\nHost: test\r\n\r\n");
+    ok &= check(startsWith(index, "HTTP/1.0 200 OK"), "index served");
+    ok &= check(index.find(odd) == std::string::npos, "camera id not written as markup");
+    ok &= check(index.find("&lt;lobby&amp;&quot;door&quot;&gt;") != std::string::npos, "camera id escaped");
+    ok &= check(index.find("/camera/%3Clobby%26%22door%22%3E") != std::string::npos, "camera link encoded");
+
+    // a request split over several sends is put together
+    {
+        int fd = connectTo(port, 3000);
+        bool closed;
+        sendAll(fd, "GET /came");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        sendAll(fd, "ra/nowhere HTTP/1.0\r\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        sendAll(fd, "\r\n");
+        ok &= check(startsWith(readAll(fd, closed), "HTTP/1.0 404 Not Found") && closed, "split request answered 404");
+        close(fd);
+    }
+
+    ok &= check(startsWith(request(port, "POST / HTTP/1.0\r\n\r\n"), "HTTP/1.0 405"), "POST refused");
+    ok &= check(startsWith(request(port, "GET /mosaicx HTTP/1.0\r\n\r\n"), "HTTP/1.0 404"), "unknown path 404");
+    ok &= check(request(port, std::string(9000, 'x')).empty(), "oversized request dropped");
+
+    // a client that never finishes its request is dropped without an answer
+    {
+        auto start = std::chrono::steady_clock::now();
+        int fd = connectTo(port, 10000);
+        bool closed;
+        sendAll(fd, "GET / HTTP/1.0\r\n");
+        std::string response = readAll(fd, closed);
+        double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ok &= check(closed && response.empty() && waited < 9, "idle client dropped");
+        close(fd);
+    }
+
+    // three viewers of one camera fill the server, a fourth gets 503
+    std::vector<int> viewers;
+    for (int i = 0; i < 3; i++) {
+        int fd = connectTo(port, 200);
+        sendAll(fd, "GET /camera/%3Clobby%26%22door%22%3E HTTP/1.0\r\n\r\n");
+        viewers.push_back(fd);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ok &= check(startsWith(request(port, "GET / HTTP/1.0\r\n\r\n"), "HTTP/1.0 503"), "client limit answered 503");
+
+    // each new frame is encoded once for all three, nothing for a camera
+    // nobody watches
+    const int frames = 6;
+    for (int i = 0; i < frames; i++) {
+        cv::Mat frame(120, 160, CV_8UC3, cv::Scalar(i * 40, 80, 200 - i * 30));
+        mosaic.publishFrame(odd, frame);
+        mosaic.publishFrame("front", frame.clone());
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    }
+
+    size_t received = 0;
+    for (int fd : viewers) {
+        bool closed;
+        std::string stream = readAll(fd, closed);
+        size_t parts = countOf(stream, "Content-Type: image/jpeg");
+        ok &= check(startsWith(stream, "HTTP/1.0 200 OK") && parts > 0, "viewer got frames");
+        received += parts;
+        close(fd);
+    }
+
+    LiveViewStats stats = server->getStats();
+    std::cout << frames << " frames published, " << stats.framesEncoded << " encoded, " << received
+              << " received by 3 viewers, " << stats.connections << " connections" << std::endl;
+
+    ok &= check(stats.framesEncoded <= (uint64_t)frames, "one encode per frame");
+    ok &= check(received > stats.framesEncoded, "encodes shared between viewers");
+
+    server->stop();
+    delete server;
+
+    return ok ? 0 : 1;
+}
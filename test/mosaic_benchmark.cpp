@@ -0,0 +1,133 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+#include "MosaicCompositor.h"
+
+
+namespace {
+
+bool check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+
+bool pixelIs(const cv::Mat &canvas, int x, int y, const cv::Scalar &colour) {
+    cv::Vec3b pixel = canvas.at<cv::Vec3b>(y, x);
+    return pixel[0] == colour[0] && pixel[1] == colour[1] && pixel[2] == colour[2];
+}
+
+
+// four cameras in a 2x2 grid on a 640x480 canvas with a 2 pixel gap: each
+// frame lands in its own tile, the gaps stay black, and a render only redraws
+// the tile that got a new frame
+bool checkLayout() {
+    std::vector<std::string> ids = {"a", "b", "c", "d"};
+    MosaicSettings settings;
+    settings.canvasSize = cv::Size(640, 480);
+    settings.drawLabels = false;
+    MosaicCompositor mosaic(ids, settings);
+
+    const cv::Scalar colours[] = {cv::Scalar(200, 0, 0), cv::Scalar(0, 200, 0),
+                                  cv::Scalar(0, 0, 200), cv::Scalar(200, 200, 0)};
+    for (int i = 0; i < 4; i++) {
+        mosaic.publishFrame(ids[i], cv::Mat(240, 320, CV_8UC3, colours[i]));
+    }
+
+    cv::Mat canvas;
+    uint64_t seq = mosaic.render(canvas);
+    const int tileWidth = 319;      // (640 - 2) / 2
+    const int tileHeight = 239;     // (480 - 2) / 2
+
+    bool ok = check(canvas.size() == settings.canvasSize, "canvas size");
+    for (int i = 0; i < 4; i++) {
+        int x = (i % 2) * (tileWidth + 2);
+        int y = (i / 2) * (tileHeight + 2);
+        ok &= check(pixelIs(canvas, x, y, colours[i]) &&
+                    pixelIs(canvas, x + tileWidth - 1, y + tileHeight - 1, colours[i]),
+                    "frame fills its tile");
+    }
+    ok &= check(pixelIs(canvas, tileWidth, 10, cv::Scalar::all(0)) &&
+                pixelIs(canvas, tileWidth + 1, 300, cv::Scalar::all(0)) &&
+                pixelIs(canvas, 10, tileHeight + 1, cv::Scalar::all(0)), "gaps stay black");
+
+    // nothing new, nothing redrawn
+    MosaicStats before = mosaic.getStats();
+    ok &= check(mosaic.render(canvas) == seq, "unchanged canvas keeps its sequence");
+
+    // one new frame, one tile redrawn, the others left as they were
+    mosaic.publishFrame("b", cv::Mat(240, 320, CV_8UC3, cv::Scalar(50, 60, 70)));
+    ok &= check(mosaic.render(canvas) != seq, "changed canvas gets a new sequence");
+    MosaicStats after = mosaic.getStats();
+    ok &= check(after.tilesDrawn - before.tilesDrawn == 1 && after.tilesSkipped - before.tilesSkipped == 3 + 4,
+                "only the changed tile redrawn");
+    ok &= check(pixelIs(canvas, tileWidth + 2 + 100, 100, cv::Scalar(50, 60, 70)) &&
+                pixelIs(canvas, 100, 100, colours[0]) &&
+                pixelIs(canvas, 100, tileHeight + 2 + 100, colours[2]), "other tiles untouched");
+
+    return ok;
+}
+
+}   // namespace
+
+
+// checks tile placement and that unchanged tiles are skipped, then renders a
+// 64-camera 1080p mosaic on one core, once with every camera delivering a new
+// 720p frame and once with a quarter of them.
+// usage: mosaic_benchmark [cameras] [rounds]
+int main(int argc, char **argv) {
+    int cameras = argc > 1 ? std::max(1, atoi(argv[1])) : 64;
+    int rounds = argc > 2 ? std::max(1, atoi(argv[2])) : 20;
+
+    bool ok = checkLayout();
+    cv::setNumThreads(1);
+
+    // a few distinct sources, cameras share them
+    std::vector<cv::Mat> sources;
+    for (int i = 0; i < 8; i++) {
+        cv::Mat frame(720, 1280, CV_8UC3);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+        sources.push_back(frame);
+    }
+
+    std::vector<std::string> ids;
+    for (int i = 0; i < cameras; i++) {
+        ids.push_back("cam" + std::to_string(i));
+    }
+
+    MosaicCompositor mosaic(ids);
+    std::vector<cv::Rect> boxes = {cv::Rect(200, 150, 300, 200)};
+    cv::Mat canvas;
+
+    const int everyNth[] = {1, 4};
+    for (int nth : everyNth) {
+        double totalMs = 0;
+        for (int r = 0; r < rounds; r++) {
+            for (int i = 0; i < cameras; i++) {
+                if ((i + r) % nth == 0) {
+                    mosaic.publishFrame(ids[i], sources[(i + r) % sources.size()], boxes);
+                }
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            mosaic.render(canvas);
+            totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        std::cout << cameras << " cameras, " << (cameras + nth - 1) / nth << " new frames per render: "
+                  << totalMs / rounds << " ms per render on one thread" << std::endl;
+    }
+
+    MosaicStats stats = mosaic.getStats();
+    std::cout << "tiles drawn " << stats.tilesDrawn << ", skipped " << stats.tilesSkipped << std::endl;
+
+    ok &= check(canvas.size() == cv::Size(1920, 1080), "benchmark canvas size");
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+#include "RegionExtractor.h"
+
+
+namespace {
+
+// average microseconds per call over iterations
+template <typename Fn>
+double timeUs(int iterations, Fn fn) {
+    fn();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / iterations;
+}
+
+
+bool check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+
+bool sameOrder(const MotionRegion &a, const MotionRegion &b) {
+    if (a.bbox.y != b.bbox.y) {
+        return a.bbox.y < b.bbox.y;
+    }
+    return a.bbox.x < b.bbox.x;
+}
+
+
+// the 8-connected components OpenCV finds, unfiltered
+std::vector<MotionRegion> referenceRegions(const cv::Mat &mask) {
+    cv::Mat labels, stats, centroids;
+    int count = cv::connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+
+    std::vector<MotionRegion> regions;
+    for (int i = 1; i < count; i++) {
+        MotionRegion region;
+        region.bbox = cv::Rect(stats.at<int>(i, cv::CC_STAT_LEFT), stats.at<int>(i, cv::CC_STAT_TOP),
+                               stats.at<int>(i, cv::CC_STAT_WIDTH), stats.at<int>(i, cv::CC_STAT_HEIGHT));
+        region.area = stats.at<int>(i, cv::CC_STAT_AREA);
+        regions.push_back(region);
+    }
+    std::sort(regions.begin(), regions.end(), sameOrder);
+    return regions;
+}
+
+
+// the old path: external contours of at least minArea
+int contourRegions(const cv::Mat &mask, double minArea, std::vector<cv::Rect> &regions) {
+    std::vector<std::vector<cv::Point> > contours;
+    cv::Mat work = mask.clone();
+    cv::findContours(work, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+    regions.clear();
+    for (const auto &contour : contours) {
+        if (cv::contourArea(contour) >= minArea) {
+            regions.push_back(cv::boundingRect(contour));
+        }
+    }
+    return (int)regions.size();
+}
+
+
+// a dilated motion mask: filled blobs of every size, some touching only
+// diagonally, some a pixel apart
+cv::Mat blobMask(int width, int height, int blobs) {
+    cv::Mat mask = cv::Mat::zeros(height, width, CV_8UC1);
+    cv::RNG rng(7);
+    for (int i = 0; i < blobs; i++) {
+        cv::Point center(rng.uniform(0, width), rng.uniform(0, height));
+        cv::circle(mask, center, rng.uniform(1, 40), cv::Scalar(255), cv::FILLED);
+    }
+    for (int i = 0; i < blobs; i++) {
+        int x = rng.uniform(0, width - 1);
+        int y = rng.uniform(0, height - 1);
+        mask.at<uchar>(y, x) = 255;
+        mask.at<uchar>(y + 1, x + 1) = 255;
+    }
+    return mask;
+}
+
+}   // namespace
+
+
+// checks RegionExtractor against OpenCV's 8-connected components on a mask
+// of mixed blobs, and that a field of small speckles a few pixels apart stays
+// below minArea the way it did with findContours instead of merging into a
+// false region. then times it against the findContours path.
+// usage: region_extractor_benchmark [iterations]
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 200;
+    const int width = 640;
+    const int height = 480;
+    const double minArea = 500;
+
+    bool ok = true;
+    RegionExtractor extractor(8, 100000);
+
+    // every component, with its exact area and bounding box
+    cv::Mat mask = blobMask(width, height, 150);
+    std::vector<MotionRegion> expected = referenceRegions(mask);
+    std::vector<MotionRegion> found;
+    extractor.extract(mask, 1, found);
+    std::sort(found.begin(), found.end(), sameOrder);
+
+    bool same = found.size() == expected.size();
+    for (size_t i = 0; same && i < found.size(); i++) {
+        same = found[i].bbox == expected[i].bbox && found[i].area == expected[i].area;
+    }
+    ok &= check(same, "components match connectedComponentsWithStats");
+
+    // 9x9 speckles 5 pixels apart, each far below minArea and all in
+    // neighbouring cells
+    cv::Mat speckles = cv::Mat::zeros(height, width, CV_8UC1);
+    for (int y = 2; y + 9 < height; y += 14) {
+        for (int x = 2; x + 9 < width; x += 14) {
+            cv::rectangle(speckles, cv::Rect(x, y, 9, 9), cv::Scalar(255), cv::FILLED);
+        }
+    }
+    std::vector<cv::Rect> boxes;
+    std::vector<cv::Rect> contourBoxes;
+    ok &= check(contourRegions(speckles, minArea, contourBoxes) == 0, "findContours finds no speckle region");
+    ok &= check(extractor.extract(speckles, minArea, boxes) == 0, "speckles stay separate");
+    ok &= check(!extractor.hasRegion(speckles, minArea), "hasRegion ignores speckles");
+
+    // every region findContours reported on the blob mask is still there.
+    // pixel counts are never below the contour's polygon area, so a few
+    // more can pass minArea
+    extractor.extract(mask, minArea, boxes);
+    contourRegions(mask, minArea, contourBoxes);
+    for (const auto &box : contourBoxes) {
+        ok &= check(std::find(boxes.begin(), boxes.end(), box) != boxes.end(),
+                    "findContours region found");
+    }
+
+    // bridging two cells joins the speckle field into one region
+    extractor.setMergeDistance(2);
+    ok &= check(extractor.extract(speckles, minArea, boxes) == 1, "merge distance bridges speckles");
+    extractor.setMergeDistance(0);
+
+    double extractUs = timeUs(iterations, [&] { extractor.extract(mask, minArea, boxes); });
+    double contourUs = timeUs(iterations, [&] { contourRegions(mask, minArea, contourBoxes); });
+    double speckleUs = timeUs(iterations, [&] { extractor.extract(speckles, minArea, boxes); });
+    double speckleContourUs = timeUs(iterations, [&] { contourRegions(speckles, minArea, contourBoxes); });
+
+    std::cout << width << "x" << height << " blobs: extractor " << extractUs << " us, findContours "
+              << contourUs << " us; speckles: extractor " << speckleUs << " us, findContours "
+              << speckleContourUs << " us, " << expected.size() << " components" << std::endl;
+
+    return ok ? 0 : 1;
+}
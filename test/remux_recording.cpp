@@ -0,0 +1,330 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+
+#include "StreamRemuxer.h"
+
+#ifdef HAVE_FFMPEG
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/channel_layout.h>
+}
+#endif
+
+
+#ifdef HAVE_FFMPEG
+
+namespace {
+
+const int kFps = 25;
+const int kSampleRate = 48000;
+const int kAudioPacketSamples = 960;        // 20 ms
+const double kVideoStart = 10.0;            // camera clocks never start at zero
+const double kAudioStart = 11.0;            // and audio often joins late
+const double kClipEnd = 16.0;
+
+
+bool check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+
+bool writePacket(AVFormatContext *ctx, AVPacket *packet) {
+    return av_interleaved_write_frame(ctx, packet) >= 0;
+}
+
+
+// a NUT file with H.264 video (MPEG-4 without an H.264 encoder), a keyframe
+// every second, and PCM audio starting a second later. each stream keeps its
+// own time base, so the remuxer has to convert between them
+bool generateClip(const std::string &path) {
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!codec) {
+        codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    }
+    if (!codec) {
+        std::cerr << "No video encoder available" << std::endl;
+        return false;
+    }
+
+    AVFormatContext *ctx = nullptr;
+    if (avformat_alloc_output_context2(&ctx, nullptr, "nut", path.c_str()) < 0 || !ctx) {
+        return false;
+    }
+
+    AVCodecContext *encoder = avcodec_alloc_context3(codec);
+    encoder->width = 320;
+    encoder->height = 240;
+    encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+    encoder->time_base = av_make_q(1, kFps);
+    encoder->framerate = av_make_q(kFps, 1);
+    encoder->gop_size = kFps;
+    encoder->max_b_frames = 0;
+    if (ctx->oformat->flags & AVFMT_GLOBALHEADER) {
+        encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    bool ok = avcodec_open2(encoder, codec, nullptr) >= 0;
+
+    AVStream *video = avformat_new_stream(ctx, nullptr);
+    AVStream *audio = avformat_new_stream(ctx, nullptr);
+    if (ok) {
+        avcodec_parameters_from_context(video->codecpar, encoder);
+        video->time_base = encoder->time_base;
+
+        AVCodecParameters *params = audio->codecpar;
+        params->codec_type = AVMEDIA_TYPE_AUDIO;
+        params->codec_id = AV_CODEC_ID_PCM_S16LE;
+        params->sample_rate = kSampleRate;
+        params->format = AV_SAMPLE_FMT_S16;
+        params->bits_per_coded_sample = 16;
+        params->block_align = 2;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100)
+        av_channel_layout_default(&params->ch_layout, 1);
+#else
+        params->channels = 1;
+        params->channel_layout = AV_CH_LAYOUT_MONO;
+#endif
+        audio->time_base = av_make_q(1, kSampleRate);
+
+        ok = avio_open(&ctx->pb, path.c_str(), AVIO_FLAG_WRITE) >= 0 &&
+             avformat_write_header(ctx, nullptr) >= 0;
+    }
+
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *packet = av_packet_alloc();
+    if (ok) {
+        frame->format = encoder->pix_fmt;
+        frame->width = encoder->width;
+        frame->height = encoder->height;
+        ok = av_frame_get_buffer(frame, 0) >= 0;
+    }
+
+    int64_t firstFrame = (int64_t)(kVideoStart * kFps);
+    int64_t frames = (int64_t)((kClipEnd - kVideoStart) * kFps);
+    int64_t audioPts = (int64_t)(kAudioStart * kSampleRate);
+    int64_t audioEnd = (int64_t)(kClipEnd * kSampleRate);
+    std::vector<uint8_t> silence(kAudioPacketSamples * 2, 0);
+
+    for (int64_t i = 0; ok && i <= frames; i++) {
+        if (i < frames) {
+            // a moving gradient, so frames differ
+            av_frame_make_writable(frame);
+            for (int plane = 0; plane < 3; plane++) {
+                int rows = plane ? frame->height / 2 : frame->height;
+                int cols = plane ? frame->width / 2 : frame->width;
+                for (int y = 0; y < rows; y++) {
+                    for (int x = 0; x < cols; x++) {
+                        frame->data[plane][y * frame->linesize[plane] + x] = (uint8_t)(x + y + i * 3 + plane * 64);
+                    }
+                }
+            }
+            frame->pts = firstFrame + i;
+            ok = avcodec_send_frame(encoder, frame) >= 0;
+        }
+        else {
+            ok = avcodec_send_frame(encoder, nullptr) >= 0;
+        }
+
+        while (ok && avcodec_receive_packet(encoder, packet) >= 0) {
+            av_packet_rescale_ts(packet, encoder->time_base, video->time_base);
+            packet->stream_index = video->index;
+
+            // audio up to the video frame just encoded
+            int64_t until = av_rescale_q(packet->pts + av_rescale_q(1, encoder->time_base, video->time_base),
+                                         video->time_base, audio->time_base);
+            ok = writePacket(ctx, packet);
+            while (ok && audioPts < audioEnd && audioPts < until) {
+                AVPacket *sound = av_packet_alloc();
+                av_new_packet(sound, (int)silence.size());
+                std::copy(silence.begin(), silence.end(), sound->data);
+                sound->pts = sound->dts = audioPts;
+                sound->duration = kAudioPacketSamples;
+                sound->stream_index = audio->index;
+                sound->flags |= AV_PKT_FLAG_KEY;
+                ok = writePacket(ctx, sound);
+                av_packet_free(&sound);
+                audioPts += kAudioPacketSamples;
+            }
+        }
+    }
+
+    if (ok) {
+        ok = av_write_trailer(ctx) >= 0;
+    }
+    if (ctx->pb) {
+        avio_closep(&ctx->pb);
+    }
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&encoder);
+    avformat_free_context(ctx);
+
+    return ok;
+}
+
+
+struct StreamSpan {
+    bool seen;
+    double start;
+    double end;
+
+    StreamSpan() : seen(false), start(0), end(0) {}
+};
+
+
+// first and last instant of every stream in a segment, in seconds from the
+// segment's start
+bool probeSegment(const std::string &path, StreamSpan &video, StreamSpan &audio) {
+    AVFormatContext *ctx = nullptr;
+    if (avformat_open_input(&ctx, path.c_str(), nullptr, nullptr) < 0) {
+        return false;
+    }
+    if (avformat_find_stream_info(ctx, nullptr) < 0) {
+        avformat_close_input(&ctx);
+        return false;
+    }
+
+    AVPacket *packet = av_packet_alloc();
+    while (av_read_frame(ctx, packet) >= 0) {
+        AVStream *stream = ctx->streams[packet->stream_index];
+        StreamSpan &span = stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? video : audio;
+        if (packet->pts != AV_NOPTS_VALUE) {
+            double start = packet->pts * av_q2d(stream->time_base);
+            double end = (packet->pts + packet->duration) * av_q2d(stream->time_base);
+            span.start = span.seen ? std::min(span.start, start) : start;
+            span.end = span.seen ? std::max(span.end, end) : end;
+            span.seen = true;
+        }
+        av_packet_unref(packet);
+    }
+
+    av_packet_free(&packet);
+    avformat_close_input(&ctx);
+    return true;
+}
+
+}   // namespace
+
+#endif
+
+
+// remuxes a local file standing in for an IP camera into short MKV segments.
+// without a source it generates a clip whose audio starts a second after
+// the video, and checks that every segment starts at its keyframe with the
+// audio still in place and ending with the video.
+// usage: remux_recording [source] [output dir]
+int main(int argc, char **argv) {
+    if (!StreamRemuxer::isSupported()) {
+        std::cout << "Built without FFmpeg, skipping remux test" << std::endl;
+        return 0;
+    }
+
+#ifdef HAVE_FFMPEG
+    std::string outputDir;
+    if (argc > 2) {
+        outputDir = argv[2];
+    }
+    else {
+        char scratch[] = "/tmp/remux_recording_XXXXXX";
+        if (!mkdtemp(scratch)) {
+            std::cerr << "Error: can't create a scratch directory" << std::endl;
+            return -1;
+        }
+        outputDir = scratch;
+    }
+
+    bool generated = argc < 2;
+    std::string source = generated ? outputDir + "/source.nut" : argv[1];
+    if (generated && !generateClip(source)) {
+        std::cerr << "Error: can't generate a test clip" << std::endl;
+        return -1;
+    }
+
+    SegmentSettings settings;
+    settings.segmentSeconds = 2;
+    settings.segmentBytes = 128 * 1024;     // files are read faster than real time
+
+    std::vector<std::string> segments;
+    StreamRemuxer remuxer(source);
+    remuxer.setFileClosedCallback([&segments](const std::string &path) {
+        std::cout << "Segment written: " << path << std::endl;
+        segments.push_back(path);
+    });
+
+    if (!remuxer.start(outputDir, "remux_test", settings, "mkv")) {
+        std::cerr << "Error: can't start remuxer" << std::endl;
+        return -1;
+    }
+
+    // a local file ends by itself once it has been read through
+    for (int i = 0; i < 300 && remuxer.isRunning(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    remuxer.stop();
+
+    RemuxStats stats = remuxer.getStats();
+    std::cout << stats.packetsWritten << " packets, " << stats.bytesWritten << " bytes, "
+              << stats.keyframes << " keyframes in " << stats.segments << " segments" << std::endl;
+
+    bool ok = check(stats.packetsWritten > 0 && !segments.empty(), "segments written");
+    ok &= check((int)segments.size() == stats.segments, "every segment closed");
+
+    // half a video frame, and an audio packet either side of a keyframe
+    const double frameSlack = 0.5 / kFps;
+    const double audioSlack = 0.05;
+    double videoTotal = 0;
+
+    for (size_t i = 0; i < segments.size(); i++) {
+        StreamSpan video, audio;
+        ok &= check(probeSegment(segments[i], video, audio), "segment readable");
+        ok &= check(video.seen && std::fabs(video.start) <= frameSlack, "segment starts at its keyframe");
+        videoTotal += video.end - video.start;
+
+        if (!generated || !audio.seen) {
+            continue;
+        }
+
+        // the first segment opens on the clip's first keyframe, a second
+        // before any audio. later ones have audio from the start
+        double audioStart = i == 0 ? kAudioStart - kVideoStart : 0;
+        std::cout << "  video " << video.start << "-" << video.end << " s, audio "
+                  << audio.start << "-" << audio.end << " s" << std::endl;
+        ok &= check(std::fabs(audio.start - audioStart) <= audioSlack, "audio starts in sync");
+        ok &= check(std::fabs(audio.end - video.end) <= audioSlack, "audio ends with the video");
+    }
+
+    if (generated) {
+        // muxers that leave packet durations out lose a frame per segment
+        ok &= check(std::fabs(videoTotal - (kClipEnd - kVideoStart)) <= 2 * frameSlack * segments.size(),
+                    "segments add up to the clip");
+        remove(source.c_str());
+    }
+
+    // nothing is left behind in a scratch directory
+    if (argc < 3) {
+        for (const auto &path : segments) {
+            remove(path.c_str());
+        }
+        rmdir(outputDir.c_str());
+    }
+
+    return ok ? 0 : 1;
+#else
+    (void)argc;
+    (void)argv;
+    return 0;
+#endif
+}
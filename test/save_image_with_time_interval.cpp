@@ -6,6 +6,9 @@
 #include <iomanip>
 #include <sstream>
 
+#include "SnapshotService.h"
+#include "SnapshotDeduplicator.h"
+
 using namespace cv;
 using namespace std;
 
@@ -33,6 +36,15 @@ int main() {
         return -1;
     }
 
+    // encoding and writing happen on the service's workers, the capture
+    // loop only copies the frame
+    SnapshotService snapshots;
+    snapshots.start();
+
+    // a scene that has not changed since the last saved image is only
+    // logged in the index, not encoded or written again
+    SnapshotDeduplicator dedup(4);
+
     cout << "Saving frames to /images/ every 10 seconds..." << endl;
 
     while (true) {
@@ -44,11 +56,26 @@ int main() {
         }
 
         string filename = getTimestampFilename();
-        if (!imwrite(filename, frame)) {
-            cerr << "Error: failed to write image: " << filename << endl;  
+        int64_t timestamp = chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+
+        DedupDecision decision = dedup.check(frame);
+        bool queued = !decision.duplicate && snapshots.submit(frame, filename);
+
+        if (decision.duplicate) {
+            cout << "Unchanged, skipped: " << filename << " (same as " << decision.reference << ")" << endl;
+        }
+        else if (!queued) {
+            cerr << "Error: snapshot queue full, dropped: " << filename << endl;
         }
         else {
-            cout << "Saved: " << filename << endl;
+            dedup.accept(decision, filename);
+            cout << "Queued: " << filename << endl;
+        }
+
+        if (decision.duplicate || queued) {
+            SnapshotDeduplicator::appendIndex("images/index.csv",
+                                              {SnapshotDeduplicator::indexLine(timestamp, filename, decision)});
         }
 
         // sleep
@@ -57,6 +84,7 @@ int main() {
     }
 
     cap.release();
+    snapshots.stop();
 
     return 0;
 }
@@ -0,0 +1,125 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+#include "MotionDetector.h"
+#include "StripPipeline.h"
+
+
+namespace {
+
+// textured background with a bright block moving across it
+std::vector<cv::Mat> makeFrames(const cv::Size &size, int count) {
+    cv::Mat background(size, CV_8UC3);
+    cv::randu(background, cv::Scalar::all(40), cv::Scalar::all(200));
+    cv::GaussianBlur(background, background, cv::Size(0, 0), 3);
+
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < count; i++) {
+        cv::Mat frame = background.clone();
+        cv::Rect block(size.width / 8 + i * size.width / 40, size.height / 3,
+                       size.width / 10, size.height / 6);
+        cv::rectangle(frame, block, cv::Scalar(250, 250, 250), cv::FILLED);
+        frames.push_back(frame);
+    }
+
+    return frames;
+}
+
+
+// average ms per frame of getMotionMask over the frames after the first
+double timeDetector(MotionDetector &detector, const std::vector<cv::Mat> &frames,
+                    std::vector<cv::Mat> &masks) {
+    detector.reset();
+    detector.getMotionMask(frames[0]);
+
+    masks.clear();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 1; i < frames.size(); i++) {
+        masks.push_back(detector.getMotionMask(frames[i]));
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return std::chrono::duration<double, std::milli>(elapsed).count() / (frames.size() - 1);
+}
+
+
+// bytes per frame that reach memory, counting each full-frame Mat an
+// operation reads or writes once. strip intermediates are assumed to stay
+// in cache, only the frame, the reference and the mask are counted for them
+double fullFrameMB(const cv::Size &size) {
+    double pixels = (double)size.area();
+    // frame 3 + gray w + blur r/w + absdiff r/r/w + threshold r/w + dilate r/w + copy r/w
+    return pixels * (3 + 1 + 2 + 3 + 2 + 2 + 2) / 1e6;
+}
+
+
+double stripMB(const cv::Size &size, double haloOverhead) {
+    double pixels = (double)size.area();
+    // frame 3 and reference 1 read with their halo, mask and new reference written
+    return pixels * ((3 + 1) * (1 + haloOverhead) + 1 + 1) / 1e6;
+}
+
+}   // namespace
+
+
+// compares MotionDetector's full-frame mask path with the strip pipeline at
+// 1080p and 4K, timing both and checking that the masks are identical.
+// usage: strip_pipeline_benchmark [frames]
+int main(int argc, char **argv) {
+    int frameCount = argc > 1 ? std::max(3, atoi(argv[1])) : 8;
+
+    bool ok = true;
+    const cv::Size sizes[] = {cv::Size(1920, 1080), cv::Size(3840, 2160)};
+    for (const cv::Size &size : sizes) {
+        std::vector<cv::Mat> frames = makeFrames(size, frameCount);
+        std::vector<cv::Mat> plainMasks, stripMasks, threadedMasks;
+
+        MotionDetector plain;
+        MotionDetector strips;
+        strips.enableStripPipeline(1);
+        int cores = std::max(1, (int)std::thread::hardware_concurrency());
+        MotionDetector threaded;
+        threaded.enableStripPipeline(cores);
+
+        double plainMs = timeDetector(plain, frames, plainMasks);
+        double stripMs = timeDetector(strips, frames, stripMasks);
+        double threadedMs = timeDetector(threaded, frames, threadedMasks);
+
+        // the strips carry enough halo to reproduce the full-frame mask exactly
+        int mismatch = 0;
+        cv::Mat diff;
+        for (size_t i = 0; i < plainMasks.size(); i++) {
+            cv::absdiff(plainMasks[i], stripMasks[i], diff);
+            mismatch += cv::countNonZero(diff);
+            cv::absdiff(plainMasks[i], threadedMasks[i], diff);
+            mismatch += cv::countNonZero(diff);
+        }
+
+        // the detector's pipeline is private, a standalone one reports the strip layout
+        StripPipelineSettings settings;
+        settings.workers = 1;
+        StripPipeline probe(settings);
+        cv::Mat reference = cv::Mat::zeros(size, CV_8UC1), mask;
+        probe.process(frames[0], reference, mask, 25);
+        StripPipelineStats stats = probe.getStats();
+
+        std::cout << size.width << "x" << size.height << ": full frame " << plainMs
+                  << " ms, strips " << stripMs << " ms (1 thread), " << threadedMs
+                  << " ms (" << cores << " threads)" << std::endl;
+        std::cout << "  " << stats.strips << " strips of " << stats.stripRows << " rows, halo overhead "
+                  << stats.haloOverhead * 100 << "%, modelled memory traffic "
+                  << fullFrameMB(size) << " MB -> " << stripMB(size, stats.haloOverhead)
+                  << " MB per frame, " << mismatch << " mask pixels differ" << std::endl;
+
+        if (mismatch != 0) {
+            std::cerr << "Strip pipeline mask differs from the full-frame mask" << std::endl;
+            ok = false;
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+
+#include "TemporalDenoiser.h"
+
+
+// static 1080p scene with gaussian sensor noise and one moving block,
+// reports the residual noise, the JPEG size as a stand-in for encoder
+// bitrate, and the time per frame. fails if the moving block is altered.
+// usage: temporal_denoise_benchmark [frames] [noise sigma]
+int main(int argc, char **argv) {
+    int frameCount = argc > 1 ? std::max(10, atoi(argv[1])) : 60;
+    double sigma = argc > 2 ? atof(argv[2]) : 4.0;
+    const cv::Size size(1920, 1080);
+
+    cv::Mat scene(size, CV_8UC3);
+    cv::randu(scene, cv::Scalar::all(30), cv::Scalar::all(220));
+    cv::GaussianBlur(scene, scene, cv::Size(0, 0), 6);
+
+    TemporalDenoiser denoiser;
+    cv::Mat noise(size, CV_16SC3);
+    std::vector<int> jpegParams = {cv::IMWRITE_JPEG_QUALITY, 80};
+    std::vector<uchar> jpeg;
+    size_t noisyBytes = 0, cleanBytes = 0;
+    double noisyError = 0, cleanError = 0, totalMs = 0;
+    int measured = 0;
+    bool ok = true;
+
+    for (int i = 0; i < frameCount; i++) {
+        cv::Rect block(100 + i * 20, 400, 200, 200);
+        cv::Mat clean = scene.clone();
+        cv::rectangle(clean, block, cv::Scalar(240, 240, 240), cv::FILLED);
+
+        cv::randn(noise, cv::Scalar::all(0), cv::Scalar::all(sigma));
+        cv::Mat frame;
+        cv::add(clean, noise, frame, cv::noArray(), CV_8UC3);
+        cv::Mat noisy = frame.clone();
+
+        auto start = std::chrono::steady_clock::now();
+        denoiser.process(frame, std::vector<cv::Rect>(1, block));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        cv::Mat moved;
+        cv::absdiff(noisy(block), frame(block), moved);
+        if (cv::countNonZero(moved.reshape(1)) != 0) {
+            std::cerr << "Denoiser altered the moving block in frame " << i << std::endl;
+            ok = false;
+        }
+
+        // skip the frames the average needs to settle
+        if (i >= 8) {
+            totalMs += ms;
+            noisyError += cv::norm(noisy, clean, cv::NORM_L2) / std::sqrt((double)clean.total() * 3);
+            cleanError += cv::norm(frame, clean, cv::NORM_L2) / std::sqrt((double)clean.total() * 3);
+            cv::imencode(".jpg", noisy, jpeg, jpegParams);
+            noisyBytes += jpeg.size();
+            cv::imencode(".jpg", frame, jpeg, jpegParams);
+            cleanBytes += jpeg.size();
+            measured++;
+        }
+    }
+
+    std::cout << "1920x1080, noise sigma " << sigma << ": " << totalMs / measured << " ms per frame, rms error "
+              << noisyError / measured << " -> " << cleanError / measured << ", JPEG "
+              << noisyBytes / measured / 1024 << " KB -> " << cleanBytes / measured / 1024 << " KB" << std::endl;
+
+    return ok ? 0 : 1;
+}